@@ -20,95 +20,299 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
-#include "hal_pic18.h"
+#include "hal.h"
 #include "MRF24J40.h"
 #include "ieee802154.h"
 
-static unsigned char seq_no = 0;
-static int internal_state = 0;
+static struct mrf24j40_state state0;
 
-static unsigned char
+#ifdef MRF24J40_MULTI
+static MRF24J40_TLS struct mrf24j40_state *mrf = &state0;
+#else
+#define mrf	(&state0)
+#endif
+
+#ifdef MRF24J40_MULTI
+/*
+ * Select the radio instance the following driver calls operate on. The
+ * HAL has to be pointed at the matching chip as well.
+ */
+void
+mrf24j40_bind(struct mrf24j40_state *st)
+{
+	mrf = (st != (void *)0) ? st : &state0;
+}
+#endif
+
+/*
+ * HALs with a finer grained delay provide DELAY_US(us); otherwise the
+ * short waits are rounded up to a DELAY_1MS.
+ */
+#ifndef DELAY_US
+#define DELAY_US(us)	DELAY_1MS()
+#endif
+
+/*
+ * Placed after the declarations of the public functions that access the
+ * chip. A HAL that traces SPI traffic (hal_trace.c) defines it to note
+ * which driver call the accesses belong to, until that call returns.
+ */
+#ifndef MRF24J40_TRACE_FN
+#define MRF24J40_TRACE_FN()
+#endif
+
+/*
+ * Forget a pending upper layer cipher operation, see mrf24j40_encdec.
+ * Used by the resets and by every public sender before it reuses the
+ * TXNFIFO; encdec itself loads through mrf24j40_txfifo_load, which must
+ * not use it, or its TXNIF would be reported as a plain transmission.
+ */
+#ifdef MRF24J40_NO_UPENC
+#define UPENC_IDLE()
+#else
+#define UPENC_IDLE()	(mrf->internal_state = 0)
+#endif
+
+#ifdef MRF24J40_NO_TIMESTAMP
+#undef MRF24J40_TIMESTAMP
+#endif
+
+/*
+ * Hot-path duration probes, compiled in with MRF24J40_PROBES. Each probe
+ * keeps its own start time, so an interrupt handler may run its probes
+ * while the main loop is inside another one.
+ */
+#ifdef MRF24J40_PROBES
+#ifndef MRF24J40_CYCLES
+#error "MRF24J40_PROBES needs MRF24J40_CYCLES() from the HAL"
+#endif
+
+static void
+mrf24j40_probe_add(int id, unsigned short d)
+{
+	struct mrf24j40_probe *p = &mrf->probe[id];
+	unsigned short v = d >> MRF24J40_PROBE_SHIFT;
+	int b = 0;
+
+	while (v != 0 && b < MRF24J40_PROBE_BUCKETS - 1) {
+		v >>= 1;
+		++b;
+	}
+
+	if (p->hist[b] != 0xFFFF)
+		++p->hist[b];
+	if (p->count != 0xFFFF)
+		++p->count;
+	if (d > p->max)
+		p->max = d;
+}
+
+#define PROBE_BEGIN(id)	(mrf->probe_start[id] = MRF24J40_CYCLES())
+#define PROBE_END(id)	mrf24j40_probe_add(id,				\
+			    (unsigned short)(MRF24J40_CYCLES() -	\
+			    mrf->probe_start[id]))
+#else
+#define PROBE_BEGIN(id)
+#define PROBE_END(id)
+#endif
+
+/*
+ * HALs that can do a whole chip select cycle at once (DMA, Linux spidev)
+ * define HAL_SPI_XFER and provide
+ *
+ *   void spi_xfer(unsigned char *a, int alen, unsigned char *d, int dlen,
+ *       int rd);
+ *
+ * which writes the alen address bytes, then writes (rd == 0) or reads
+ * (rd != 0) dlen data bytes, all with CS asserted. Otherwise the driver
+ * clocks the bytes through spi_write/spi_read itself.
+ *
+ * The address bytes are computed by the macros below, so they fold into
+ * constants when the accessors are inlined (HAL_INLINE, see hal.h).
+ */
+#define SHORT_RD(a)	(((a) & 0x3F) << 1)
+#define SHORT_WR(a)	((((a) & 0x3F) << 1) | 0x01)
+#define LONG_HI(a)	((((a) >> 3) & 0x7F) | 0x80)
+#define LONG_LO_RD(a)	(((a) & 0x07) << 5)
+#define LONG_LO_WR(a)	((((a) & 0x07) << 5) | (1<<4))
+
+#ifdef HAL_INLINE
+#define SPI_FN		static MRF24J40_INLINE
+#else
+#define SPI_FN		static
+#endif
+
+SPI_FN unsigned char
 SPI_READ_LONG(int addr)
 {
-	unsigned char a_msb, a_lsb, d;
+	unsigned char a[2], d;
 
-	a_msb = a_lsb = 0;
-	a_msb = (((addr >> 3) & 0x7F) | 0x80);
-	a_lsb = (((addr & 0x07) << 5));
+	a[0] = LONG_HI(addr);
+	a[1] = LONG_LO_RD(addr);
 
+#ifdef HAL_SPI_XFER
+	spi_xfer(a, 2, &d, 1, 1);
+#else
 	CS_LOW();
-	spi_write(a_msb);
-	spi_write(a_lsb);
+	spi_write(a[0]);
+	spi_write(a[1]);
 	d = spi_read();
 	CS_HIGH();
+#endif
 
 	return d;
 }
 
-static unsigned char
+SPI_FN unsigned char
 SPI_READ_SHORT(unsigned char addr)
 {
 	unsigned char d;
 
-	addr &= 0x3f;	/* Trim address to 6 bits */
-	addr <<= 1;		/* Shift into the right position */
-	addr &= ~0x01;	/* Clear write bit */
+	addr = SHORT_RD(addr);
 
+#ifdef HAL_SPI_XFER
+	spi_xfer(&addr, 1, &d, 1, 1);
+#else
 	CS_LOW();
 	spi_write(addr);
 	d = spi_read();
 	CS_HIGH();
+#endif
 
 	return d;
 }
 
-static void
+SPI_FN void
 SPI_WRITE_LONG(int addr, unsigned char d)
 {
-	unsigned char a_msb, a_lsb;
+	unsigned char a[2];
 
-	a_msb = a_lsb = 0;
-	a_msb = (((addr >> 3) & 0x7F) | 0x80);
-	a_lsb = (((addr & 0x07) << 5) | (1<<4));
+	a[0] = LONG_HI(addr);
+	a[1] = LONG_LO_WR(addr);
 
+#ifdef HAL_SPI_XFER
+	spi_xfer(a, 2, &d, 1, 0);
+#else
 	CS_LOW();
-	spi_write(a_msb);
-	spi_write(a_lsb);
+	spi_write(a[0]);
+	spi_write(a[1]);
 	spi_write(d);
 	CS_HIGH();
+#endif
 }
 
-static void
+SPI_FN void
 SPI_WRITE_SHORT(unsigned char addr, unsigned char d)
 {
-	addr &= 0x3f;	/* Trim address to 6 bits */
-	addr <<= 1;		/* Shift into the right position */
-	addr |= 0x01;	/* Set R/W bit to write */
+	addr = SHORT_WR(addr);
 
+#ifdef HAL_SPI_XFER
+	spi_xfer(&addr, 1, &d, 1, 0);
+#else
 	CS_LOW();
 	spi_write(addr);
 	spi_write(d);
 	CS_HIGH();
+#endif
 }
 
-static void
+/*
+ * Burst access to long address memory (FIFOs, keys). The chip
+ * increments the address after every data byte while CS stays low, so
+ * a whole FIFO transfer costs a single address phase.
+ */
+SPI_FN void
 SPI_WRITE_FIFO(int addr, unsigned char *d, int len)
 {
-	int i;
+	unsigned char a[2];
 
-	for (i = 0; i < len; i++) {
-		SPI_WRITE_LONG(addr++, d[i]);
-	}
+	if (len <= 0)
+		return;
+
+	a[0] = LONG_HI(addr);
+	a[1] = LONG_LO_WR(addr);
+
+#ifdef HAL_SPI_XFER
+	spi_xfer(a, 2, d, len, 0);
+#else
+	CS_LOW();
+	spi_write(a[0]);
+	spi_write(a[1]);
+	while (len-- > 0)
+		spi_write(*d++);
+	CS_HIGH();
+#endif
 }
 
-static void
+SPI_FN void
 SPI_READ_FIFO(int addr, unsigned char *d, int len)
 {
-	int i;
+	unsigned char a[2];
 
-	for (i = 0; i < len; i++) {
-		d[i] = SPI_READ_LONG(addr++);
-	}
+	if (len <= 0)
+		return;
+
+	a[0] = LONG_HI(addr);
+	a[1] = LONG_LO_RD(addr);
+
+#ifdef HAL_SPI_XFER
+	spi_xfer(a, 2, d, len, 1);
+#else
+	CS_LOW();
+	spi_write(a[0]);
+	spi_write(a[1]);
+	while (len-- > 0)
+		*d++ = spi_read();
+	CS_HIGH();
+#endif
+}
+
+/*
+ * Register tables. Addresses from RFCON0 (0x200) up are long ones, the
+ * others short ones.
+ */
+struct mrf24j40_reg {
+	unsigned short	addr;
+	unsigned char	val;
+};
+
+/* Initialization sequence as suggested in the datasheet */
+static MRF24J40_ROM struct mrf24j40_reg init_tab[] = {
+	{ PACON2,	FIFOEN | TXONTS(0x06) },
+	{ TXSTBL,	RFSTBL(9) | MSIFS(5) },
+	{ RFCON1,	VCOOPT(0x02) },
+	{ RFCON2,	PLLEN },
+	{ RFCON6,	TXFIL },
+	{ RFCON7,	SLPCLKSEL(0x02) },
+	{ RFCON8,	RFVCO },
+	{ SLPCON0,	INTEDGE },	/* Set Rising Edge INT Polarity */
+	{ SLPCON1,	SLPCLKDIV(1) | CLKOUTDIS },
+};
+
+/* Carrier Sense with energy above threshold, see mrf24j40_set_cca */
+#define CCA_DEFAULT_BBREG2	(CCAMODE(0x03) | CCASTH(0x02))
+#define CCA_DEFAULT_EDTH	0x60
+
+#define INIT_TAB_LEN	(sizeof(init_tab) / sizeof(init_tab[0]))
+
+static void
+mrf24j40_reg_write(unsigned short addr, unsigned char val)
+{
+	if (addr >= RFCON0)
+		SPI_WRITE_LONG(addr, val);
+	else
+		SPI_WRITE_SHORT(addr, val);
+}
+
+/* MRF24J40_LOST_* group a register belongs to */
+static unsigned char
+mrf24j40_reg_group(unsigned short addr)
+{
+	if (addr >= RFCON0)
+		return MRF24J40_LOST_RF;
+	if (addr >= BBREG0)
+		return MRF24J40_LOST_BB;
+	return MRF24J40_LOST_MAC;
 }
 
 void
@@ -119,47 +323,145 @@ mrf24j40_ie(void)
 	 * causes the interrupt to be disabled...
 	 */
 	SPI_WRITE_SHORT(INTCON, ~(TXNIE | RXIE | SECIE));
+
+#ifndef MRF24J40_NO_RX_POLL
+	/* RXIE is unmasked again; back to one interrupt per frame */
+	mrf->rx_mode = MRF24J40_RX_MODE_INT;
+	mrf->rx_pending = 0;
+#endif
 }
 
 void
 mrf24j40_pwr_reset(void)
 {
+	MRF24J40_TRACE_FN();
 	SPI_WRITE_SHORT(SOFTRST, RSTPWR);
 }
 
 void
 mrf24j40_bb_reset(void)
 {
+	MRF24J40_TRACE_FN();
 	SPI_WRITE_SHORT(SOFTRST, RSTBB);
 }
 
 void
 mrf24j40_mac_reset(void)
 {
+	MRF24J40_TRACE_FN();
+
 	/* NOTE: All control registers are reset by this! */
-	internal_state = 0;
+	UPENC_IDLE();
 	SPI_WRITE_SHORT(SOFTRST, RSTMAC);
 }
 
+/*
+ * Non-blocking operations. The *_start functions begin an operation and,
+ * like mrf24j40_step(), return how many microseconds to wait before the
+ * next call to mrf24j40_step(), or MRF24J40_STEP_DONE once it completed.
+ * Only one operation can be in progress per radio. The blocking versions
+ * run the same steps with the HAL delays in between.
+ */
+#define STEP_IDLE		0
+#define STEP_RESET_HIGH		1
+#define STEP_SOFTRST		2
+#define STEP_SOFTRST_WAIT	3
+#define STEP_INIT_REGS		4
+#define STEP_RF_RESET		5
+#define STEP_RF_SETTLED		6
+
+static void mrf24j40_restart_regs(int lost);
+
+int
+mrf24j40_step(void)
+{
+	unsigned char w;
+
+	MRF24J40_TRACE_FN();
+	switch (mrf->step) {
+	case STEP_RESET_HIGH:
+		RESET_HIGH();
+		mrf->step = STEP_SOFTRST;
+		return 1000;
+
+	case STEP_SOFTRST:
+		SPI_WRITE_SHORT(SOFTRST, (RSTPWR | RSTBB | RSTMAC));
+		mrf->step = STEP_SOFTRST_WAIT;
+		return 0;
+
+	case STEP_SOFTRST_WAIT:
+		if ((SPI_READ_SHORT(SOFTRST) & (RSTPWR | RSTBB | RSTMAC)) != 0)
+			return 0;
+		mrf->step = STEP_INIT_REGS;
+		return 1000;
+
+	case STEP_INIT_REGS:
+		/* Everything is at its reset value now */
+		mrf->cfg.set = 0;
+		mrf->cfg.channel = mrf->step_arg & 0x0F;
+		mrf->cfg.rxmcr = 0;
+		mrf->cfg.rxflush = 0;
+		mrf->cfg.turbo = 0;
+		mrf->cfg.txpower = 0;
+		mrf->cfg.bbreg2 = CCA_DEFAULT_BBREG2;
+		mrf->cfg.ccaedth = CCA_DEFAULT_EDTH;
+		mrf24j40_restart_regs(MRF24J40_LOST_ALL);
+		/* FALLTHROUGH */
+
+	case STEP_RF_RESET:
+		w = SPI_READ_SHORT(RFCTL);
+		SPI_WRITE_SHORT(RFCTL, w | RFRST);
+		SPI_WRITE_SHORT(RFCTL, w & ~RFRST);
+		mrf->step = STEP_RF_SETTLED;
+		return 192;	/* Delay min 192us */
+
+	default:
+		mrf->step = STEP_IDLE;
+		return MRF24J40_STEP_DONE;
+	}
+}
+
+/* Run the current operation to completion */
+static void
+mrf24j40_finish(int us)
+{
+	for (; us != MRF24J40_STEP_DONE; us = mrf24j40_step()) {
+		while (us >= 1000) {
+			DELAY_1MS();
+			us -= 1000;
+		}
+		if (us > 0)
+			DELAY_US(us);
+	}
+}
+
+int
+mrf24j40_rf_reset_start(void)
+{
+	MRF24J40_TRACE_FN();
+	mrf->step = STEP_RF_RESET;
+	return mrf24j40_step();
+}
+
 void
 mrf24j40_rf_reset(void)
 {
-	unsigned char old = SPI_READ_SHORT(RFCTL);
-
-	SPI_WRITE_SHORT(RFCTL, old | RFRST);
-	SPI_WRITE_SHORT(RFCTL, old & ~RFRST);
-	DELAY_1MS();	/* Delay min 192us */
+	MRF24J40_TRACE_FN();
+	mrf24j40_finish(mrf24j40_rf_reset_start());
 }
 
 void
 mrf24j40_rxfifo_flush(void)
 {
-	SPI_WRITE_SHORT(RXFLUSH, _RXFLUSH);
+	MRF24J40_TRACE_FN();
+	SPI_WRITE_SHORT(RXFLUSH, mrf->cfg.rxflush | _RXFLUSH);
 }
 
-void
-mrf24j40_set_channel(int ch)
+int
+mrf24j40_set_channel_start(int ch)
 {
+	MRF24J40_TRACE_FN();
+
 	/* translate channel */
 	/* 0x00 -> Ch 11 */
 	/* 0x01 -> Ch 12 */
@@ -167,21 +469,192 @@ mrf24j40_set_channel(int ch)
 	if (ch >= 11)
 		ch -= 11;
 
+	mrf->cfg.channel = ch;
 	SPI_WRITE_LONG(RFCON0, CHANNEL(ch) | RFOPT(0x03));
-	mrf24j40_rf_reset();
+	return mrf24j40_rf_reset_start();
+}
+
+/*
+ * Channel switch for channel hopping: nothing is done if ch is the
+ * current channel, and the RF state machine reset is not waited for.
+ * The caller has to leave at least 192us before the next transmission
+ * or expected reception, e.g. by switching at the start of a timeslot.
+ */
+void
+mrf24j40_set_channel_fast(int ch)
+{
+	unsigned char w;
+
+	MRF24J40_TRACE_FN();
+	if (ch >= 11)
+		ch -= 11;
+
+	if (ch == mrf->cfg.channel)
+		return;
+
+	mrf->cfg.channel = ch;
+	SPI_WRITE_LONG(RFCON0, CHANNEL(ch) | RFOPT(0x03));
+
+	w = SPI_READ_SHORT(RFCTL);
+	SPI_WRITE_SHORT(RFCTL, w | RFRST);
+	SPI_WRITE_SHORT(RFCTL, w & ~RFRST);
+}
+
+void
+mrf24j40_set_channel(int ch)
+{
+	MRF24J40_TRACE_FN();
+	mrf24j40_finish(mrf24j40_set_channel_start(ch));
 }
 
 unsigned char
 mrf24j40_get_channel(void)
 {
+	MRF24J40_TRACE_FN();
 	return (11 + (SPI_READ_LONG(RFCON0) >> 4));
 }
 
+/*
+ * Turbo mode (625 kbps, proprietary); both ends have to agree on it.
+ * Register values as given in the datasheet.
+ */
+static void
+mrf24j40_turbo_regs(int on)
+{
+	if (on) {
+		SPI_WRITE_SHORT(BBREG0, TURBO);
+		SPI_WRITE_SHORT(BBREG3, 0x38);
+		SPI_WRITE_SHORT(BBREG4, 0x5C);
+	} else {
+		SPI_WRITE_SHORT(BBREG0, 0);
+		SPI_WRITE_SHORT(BBREG3, 0xD8);
+		SPI_WRITE_SHORT(BBREG4, 0x9C);
+	}
+}
+
+void
+mrf24j40_set_turbo(int on)
+{
+	MRF24J40_TRACE_FN();
+	mrf->cfg.turbo = (on != 0);
+	mrf24j40_turbo_regs(on);
+	mrf24j40_rf_reset();
+}
+
+/*
+ * Set the TX power level, 0 (0 dBm, the reset value) to 31 (-36.3 dBm):
+ * bits 4-3 select the large (10 dB) and bits 2-0 the small steps of
+ * RFCON3. Levels outside that range are clamped to it. The register is
+ * only written when the level changes, so this can be called before
+ * every transmission.
+ */
+void
+mrf24j40_set_txpower(int level)
+{
+	MRF24J40_TRACE_FN();
+	if (level < 0)
+		level = 0;
+	else if (level > MRF24J40_TXPOWER_MAX)
+		level = MRF24J40_TXPOWER_MAX;
+
+	if (level == mrf->cfg.txpower)
+		return;
+
+	mrf->cfg.txpower = level;
+	SPI_WRITE_LONG(RFCON3, TXPWRL(level >> 3) | TXPWRS(level));
+}
+
+int
+mrf24j40_get_txpower(void)
+{
+	return mrf->cfg.txpower;
+}
+
+/* Unslotted CSMA-CA before transmissions, on by default */
+void
+mrf24j40_set_csma(int on)
+{
+	unsigned char w;
+
+	MRF24J40_TRACE_FN();
+	w = SPI_READ_SHORT(TXMCR);
+	if (on)
+		w &= ~NOCSMA;
+	else
+		w |= NOCSMA;
+
+	SPI_WRITE_SHORT(TXMCR, w);
+}
+
+/*
+ * Start the half symbol timer; MRF24J40_INT_TMR is signalled after hsym
+ * half symbol periods (8us each). Used for slot timing by tsch.c.
+ */
+void
+mrf24j40_timer_start(unsigned short hsym)
+{
+	MRF24J40_TRACE_FN();
+	SPI_WRITE_SHORT(INTCON, SPI_READ_SHORT(INTCON) & ~HSYMTMRIE);
+	SPI_WRITE_SHORT(HSYMTMRL, hsym & 0xFF);
+	SPI_WRITE_SHORT(HSYMTMRH, hsym >> 8);
+}
+
+/*
+ * Set the CCA mode (1: carrier sense, 2: energy above threshold, 3:
+ * both), the carrier sense threshold (CCASTH, 0-15) and the energy
+ * detection threshold (CCAEDTH, on the RSSI scale).
+ */
+void
+mrf24j40_set_cca(int mode, int cs_th, unsigned char ed_th)
+{
+	MRF24J40_TRACE_FN();
+	mrf->cfg.bbreg2 = CCAMODE(mode) | CCASTH(cs_th);
+	SPI_WRITE_SHORT(BBREG2, mrf->cfg.bbreg2);
+	mrf24j40_set_cca_edth(ed_th);
+}
+
+/* Only writes CCAEDTH on a change; for adaptive thresholds */
+void
+mrf24j40_set_cca_edth(unsigned char ed_th)
+{
+	MRF24J40_TRACE_FN();
+	if (ed_th == mrf->cfg.ccaedth)
+		return;
+
+	mrf->cfg.ccaedth = ed_th;
+	SPI_WRITE_SHORT(CCAEDTH, ed_th);
+}
+
+/*
+ * Measure the energy on the channel, on the RSSI scale. Reception is
+ * disabled while the result is read, as the datasheet's energy
+ * detection procedure has it.
+ */
+unsigned char
+mrf24j40_read_rssi(void)
+{
+	unsigned char v;
+
+	MRF24J40_TRACE_FN();
+	SPI_WRITE_SHORT(BBREG6, SPI_READ_SHORT(BBREG6) | RSSIMODE1);
+	while (!(SPI_READ_SHORT(BBREG6) & RSSIRDY))
+		;
+
+	SPI_WRITE_SHORT(BBREG1, SPI_READ_SHORT(BBREG1) | RXDECINV);
+	v = SPI_READ_LONG(RSSI);
+	SPI_WRITE_SHORT(BBREG1, SPI_READ_SHORT(BBREG1) & ~RXDECINV);
+
+	return v;
+}
+
+#ifndef MRF24J40_NO_PROMISC
 void
 mrf24j40_set_promiscuous(int crc_check)
 {
 	unsigned char w;
 
+	MRF24J40_TRACE_FN();
+
 	/*
 	 * Set promiscuous mode, disable auto-ACK and, if requested,
 	 * accept packets with a CRC error.
@@ -192,24 +665,62 @@ mrf24j40_set_promiscuous(int crc_check)
 	else
 		w |= PROMI;
 
+	mrf->cfg.rxmcr = w;
 	SPI_WRITE_SHORT(RXMCR, w);
 }
+#endif
+
+/*
+ * Receive only beacon, data or command frames (BCNONLY, DATAONLY,
+ * CMDONLY), or all of them with 0. RXFLUSH holds the filter, so the
+ * driver's FIFO flushes write it back every time.
+ */
+void
+mrf24j40_set_rx_filter(int only)
+{
+	MRF24J40_TRACE_FN();
+	mrf->cfg.rxflush &= ~(BCNONLY | DATAONLY | CMDONLY);
+	mrf->cfg.rxflush |= only & (BCNONLY | DATAONLY | CMDONLY);
+	SPI_WRITE_SHORT(RXFLUSH, mrf->cfg.rxflush);
+}
 
 void
 mrf24j40_set_coordinator(void)
 {
-	SPI_WRITE_SHORT(RXMCR, SPI_READ_SHORT(RXMCR) | PANCOORD);
+	MRF24J40_TRACE_FN();
+	mrf->cfg.rxmcr |= PANCOORD;
+	SPI_WRITE_SHORT(RXMCR, mrf->cfg.rxmcr);
 }
 
 void
 mrf24j40_clear_coordinator(void)
 {
-	SPI_WRITE_SHORT(RXMCR, SPI_READ_SHORT(RXMCR) & ~PANCOORD);
+	MRF24J40_TRACE_FN();
+	mrf->cfg.rxmcr &= ~PANCOORD;
+	SPI_WRITE_SHORT(RXMCR, mrf->cfg.rxmcr);
+}
+
+/*
+ * Frame pending bit of the hardware ACKs (TXPEND FPACK). It goes into
+ * every ACK, whoever the sender, so a coordinator sets it while it
+ * holds data for any of its sleeping devices.
+ */
+void
+mrf24j40_set_frame_pending(int on)
+{
+	unsigned char w;
+
+	MRF24J40_TRACE_FN();
+	w = SPI_READ_SHORT(TXPEND) & ~FPACK;
+	SPI_WRITE_SHORT(TXPEND, on ? (w | FPACK) : w);
 }
 
 void
 mrf24j40_set_pan(int pan)
 {
+	MRF24J40_TRACE_FN();
+	mrf->cfg.set |= MRF24J40_CFG_PAN;
+	mrf->cfg.pan = pan;
 	SPI_WRITE_SHORT(PANIDH, pan>>8);
 	SPI_WRITE_SHORT(PANIDL, pan & 0xFF);
 }
@@ -217,57 +728,115 @@ mrf24j40_set_pan(int pan)
 void
 mrf24j40_set_short_addr(int addr)
 {
+	MRF24J40_TRACE_FN();
+	mrf->cfg.set |= MRF24J40_CFG_ADDR;
+	mrf->cfg.short_addr = addr;
 	SPI_WRITE_SHORT(SADRH, addr>>8);
 	SPI_WRITE_SHORT(SADRL, addr & 0xFF);
 }
 
+int
+mrf24j40_init_start(int ch)
+{
+	MRF24J40_TRACE_FN();
+	RESET_LOW();
+
+	UPENC_IDLE();
+	mrf->step_arg = ch;
+	mrf->step = STEP_RESET_HIGH;
+
+	return 1000;
+}
+
 void
 mrf24j40_init(int ch)
 {
-	RESET_LOW();
+	MRF24J40_TRACE_FN();
+	mrf24j40_finish(mrf24j40_init_start(ch));
+}
+
+static void
+mrf24j40_restart_regs(int lost)
+{
+	unsigned char i;
 
-	internal_state = 0;
-	DELAY_1MS();
+	for (i = 0; i < INIT_TAB_LEN; i++) {
+		if (lost & mrf24j40_reg_group(init_tab[i].addr))
+			mrf24j40_reg_write(init_tab[i].addr, init_tab[i].val);
+	}
 
-	RESET_HIGH();
+	if (lost & MRF24J40_LOST_RF) {
+		SPI_WRITE_LONG(RFCON0, CHANNEL(mrf->cfg.channel) | RFOPT(0x03));
+		SPI_WRITE_LONG(RFCON3, TXPWRL(mrf->cfg.txpower >> 3) |
+		    TXPWRS(mrf->cfg.txpower));
+	}
 
-	DELAY_1MS();
+	if (lost & MRF24J40_LOST_BB) {
+		SPI_WRITE_SHORT(BBREG2, mrf->cfg.bbreg2);
+		SPI_WRITE_SHORT(CCAEDTH, mrf->cfg.ccaedth);
 
-	SPI_WRITE_SHORT(SOFTRST, (RSTPWR | RSTBB | RSTMAC));
-	while ((SPI_READ_SHORT(SOFTRST) & (RSTPWR | RSTBB | RSTMAC)) != 0);
+		/* The reset values are the ones for normal mode */
+		if (mrf->cfg.turbo)
+			mrf24j40_turbo_regs(1);
+	}
 
-	DELAY_1MS();
+	if (lost & MRF24J40_LOST_MAC) {
+		SPI_WRITE_SHORT(RXMCR, mrf->cfg.rxmcr);
+		if (mrf->cfg.set & MRF24J40_CFG_PAN)
+			mrf24j40_set_pan(mrf->cfg.pan);
+		if (mrf->cfg.set & MRF24J40_CFG_ADDR)
+			mrf24j40_set_short_addr(mrf->cfg.short_addr);
 
-	/* initialization sequence as suggested in datasheet */
-	SPI_WRITE_SHORT(PACON2, SPI_READ_SHORT(PACON2) | FIFOEN);
-	SPI_WRITE_SHORT(TXSTBL, RFSTBL(9) | MSIFS(5));
-	SPI_WRITE_LONG(RFCON0, CHANNEL(ch) | RFOPT(0x03));
-	SPI_WRITE_LONG(RFCON1, VCOOPT(0x02));
-	SPI_WRITE_LONG(RFCON2, PLLEN);
-	SPI_WRITE_LONG(RFCON6, TXFIL);
-	SPI_WRITE_LONG(RFCON7, SLPCLKSEL(0x02));
-	SPI_WRITE_LONG(RFCON8, RFVCO);
-	SPI_WRITE_LONG(SLPCON0, INTEDGE); /* Set Rising Edge INT Polarity */
-	SPI_WRITE_LONG(SLPCON1, SLPCLKDIV(1) | CLKOUTDIS);
+		/* Flush RX FIFO */
+		SPI_WRITE_SHORT(RXFLUSH, mrf->cfg.rxflush | _RXFLUSH);
+
+		/* Enable interrupts */
+		mrf24j40_ie();
+	}
+}
 
-	/* Carrier Sense with energy above threshold */
-	SPI_WRITE_SHORT(BBREG2, CCAMODE(0x03) | CCASTH(0x02));
-	SPI_WRITE_SHORT(CCAEDTH, 0x60);
+/*
+ * Warm restart: reprogram only the register groups given in lost
+ * (MRF24J40_LOST_*), from the init table and the configuration
+ * snapshot, and reset the RF state machine. This is what is needed
+ * after mrf24j40_mac_reset() or mrf24j40_bb_reset(); registers survive
+ * sleep, so a wakeup needs none of it.
+ *
+ * If cfg is given it replaces the driver's snapshot first, e.g. one
+ * saved with mrf24j40_get_config() before the MCU powered down.
+ */
+int
+mrf24j40_restart_start(const struct mrf24j40_config *cfg, int lost)
+{
+	MRF24J40_TRACE_FN();
+	if (cfg != (void *)0)
+		mrf->cfg = *cfg;
 
-	/* Flush RX FIFO */
-	SPI_WRITE_SHORT(RXFLUSH, _RXFLUSH);
+	mrf24j40_restart_regs(lost);
+	return mrf24j40_rf_reset_start();
+}
 
-	/* Enable interrupts */
-	mrf24j40_ie();
+void
+mrf24j40_restart(const struct mrf24j40_config *cfg, int lost)
+{
+	MRF24J40_TRACE_FN();
+	mrf24j40_finish(mrf24j40_restart_start(cfg, lost));
+}
 
-	mrf24j40_rf_reset();
+void
+mrf24j40_get_config(struct mrf24j40_config *cfg)
+{
+	*cfg = mrf->cfg;
 }
 
+#ifndef MRF24J40_NO_SLEEP
 void
 mrf24j40_sleep(int spi_wake)
 {
 	unsigned char r;
 
+	MRF24J40_TRACE_FN();
+
 	/* Enable immediate wakeup */
 	SPI_WRITE_SHORT(WAKECON, IMMWAKE);
 
@@ -281,17 +850,18 @@ mrf24j40_sleep(int spi_wake)
 		WAKE_LOW();
 
 		/* Enable WAKE pin, and set polarity to active high */
-		SPI_WRITE_SHORT(RXFLUSH, SPI_READ_SHORT(RXFLUSH) |
-		    WAKEPAD | WAKEPOL);
+		mrf->cfg.rxflush |= WAKEPAD | WAKEPOL;
+		SPI_WRITE_SHORT(RXFLUSH, mrf->cfg.rxflush);
 	}
 
 	mrf24j40_pwr_reset();
 	SPI_WRITE_SHORT(SLPACK, r | _SLPACK);
 }
 
-void
-mrf24j40_wakeup(int spi_wake)
+int
+mrf24j40_wakeup_start(int spi_wake)
 {
+	MRF24J40_TRACE_FN();
 	if (spi_wake) {
 		/* Wake up on register by setting and then clearing REGWAKE */
 		SPI_WRITE_SHORT(WAKECON, REGWAKE);
@@ -301,62 +871,68 @@ mrf24j40_wakeup(int spi_wake)
 		WAKE_HIGH();
 	}
 
-	mrf24j40_rf_reset();
+	return mrf24j40_rf_reset_start();
+}
+
+void
+mrf24j40_wakeup(int spi_wake)
+{
+	MRF24J40_TRACE_FN();
+	mrf24j40_finish(mrf24j40_wakeup_start(spi_wake));
 }
+#endif
 
+#ifndef MRF24J40_NO_SEC
 void
 mrf24j40_set_encdec(int types, int mode, unsigned char *key, int klen)
 {
-	unsigned char *keyp;
 	unsigned char w;
-	int addr;
-	int len;
 
+	MRF24J40_TRACE_FN();
 	w = SPI_READ_SHORT(SECCON0);
 
 	if (types & MRF24J40_TX_KEY) {
-		addr = SECKTXNFIFO;
-		len = klen;
-		keyp = key;
-
-		while (len-- > 0)
-			SPI_WRITE_LONG(addr++, *keyp++);
+		SPI_WRITE_FIFO(SECKTXNFIFO, key, klen);
 
 		w |= TXNCIPHER(mode);
 		SPI_WRITE_SHORT(SECCON0, w);
 	}
 
 	if (types & MRF24J40_RX_KEY) {
-		addr = SECKRXFIFO;
-		len = klen;
-		keyp = key;
-
-		while (len-- > 0)
-			SPI_WRITE_LONG(addr++, *keyp++);
+		SPI_WRITE_FIFO(SECKRXFIFO, key, klen);
 
 		w |= RXCIPHER(mode);
 		SPI_WRITE_SHORT(SECCON0, w);
 	}
 }
+#endif
 
-void
-mrf24j40_txpkt_raw(unsigned char *frame, int hdr_len, int frame_len, int enc)
+/*
+ * Load a complete frame into the TXNFIFO and trigger it. Unlike the
+ * public senders these leave internal_state alone, so mrf24j40_encdec
+ * can use them for its cipher operation.
+ */
+static void
+mrf24j40_txfifo_load(unsigned char *frame, int hdr_len, int frame_len)
 {
-	unsigned char w;
-	int addr = TXNFIFO;
-
-	internal_state = 0;
+	unsigned char lens[2];
 
 	/* Request ACK */
 	SPI_WRITE_SHORT(TXNCON, SPI_READ_SHORT(TXNCON) | TXNACKREQ);
 
 	/* Write the header and total frame length into the TXNFIFO */
-	SPI_WRITE_LONG(addr++, hdr_len);
-	SPI_WRITE_LONG(addr++, frame_len);
+	lens[0] = hdr_len;
+	lens[1] = frame_len;
+	SPI_WRITE_FIFO(TXNFIFO, lens, 2);
 
 	/* Write the frame (header + payload) into the TXNFIFO */
-	while (frame_len-- > 0)
-		SPI_WRITE_LONG(addr++, *frame++);
+	SPI_WRITE_FIFO(TXNFIFO + 2, frame, frame_len);
+}
+
+static void
+mrf24j40_txfifo_trig(int enc)
+{
+	unsigned char w;
 
 	w = SPI_READ_SHORT(TXNCON);
 	w &= ~(TXNSECEN);
@@ -369,70 +945,160 @@ mrf24j40_txpkt_raw(unsigned char *frame, int hdr_len, int frame_len, int enc)
 }
 
 void
-mrf24j40_txpkt_trigger(void)
+mrf24j40_txpkt_raw(unsigned char *frame, int hdr_len, int frame_len, int enc)
 {
-	unsigned char w;
+	MRF24J40_TRACE_FN();
+	PROBE_BEGIN(MRF24J40_PROBE_TX);
+	UPENC_IDLE();
 
-	internal_state = 0;
-
-	w = SPI_READ_SHORT(TXNCON);
-	w &= ~(TXNSECEN);
+	mrf24j40_txfifo_load(frame, hdr_len, frame_len);
+	mrf24j40_txfifo_trig(enc);
+	PROBE_END(MRF24J40_PROBE_TX);
+}
+
+/*
+ * Sends a frame given as cnt segments, streamed into the TXNFIFO in order
+ * without assembling it first. The first hdr_cnt segments make up the
+ * MAC header, which must start with the frame control field; an ACK is
+ * requested when its FCREQACK bit is set. Returns EIO if the segments
+ * do not describe a header of at least the frame control field, and
+ * ENOMEM if the frame would not fit; the chip is not touched then.
+ */
+int
+mrf24j40_txpkt_iov(const struct mrf24j40_iov *iov, int cnt, int hdr_cnt,
+    int enc)
+{
+	unsigned char w, lens[2];
+	int i, hlen = 0, flen = 0;
+
+	MRF24J40_TRACE_FN();
+	if (cnt < 1 || hdr_cnt < 1 || hdr_cnt > cnt || iov[0].len < 2)
+		return EIO;
+
+	for (i = 0; i < cnt; i++) {
+		if (i < hdr_cnt)
+			hlen += iov[i].len;
+		flen += iov[i].len;
+	}
+
+	/* The FCS is appended by the hardware */
+	if (flen > 127 - 2)
+		return ENOMEM;
+
+	PROBE_BEGIN(MRF24J40_PROBE_TX);
+	UPENC_IDLE();
+
+	w = SPI_READ_SHORT(TXNCON) & ~(TXNACKREQ | TXNSECEN);
+	if (iov[0].base[0] & FCREQACK)
+		w |= TXNACKREQ;
+	if (enc)
+		w |= TXNSECEN;
+	SPI_WRITE_SHORT(TXNCON, w);
+
+	lens[0] = hlen;
+	lens[1] = flen;
+	SPI_WRITE_FIFO(TXNFIFO, lens, 2);
+
+	for (i = 0, flen = 2; i < cnt; flen += iov[i++].len)
+		SPI_WRITE_FIFO(TXNFIFO + flen, iov[i].base, iov[i].len);
+
+	/* Trigger transmission */
+	SPI_WRITE_SHORT(TXNCON, w | TXNTRIG);
+	PROBE_END(MRF24J40_PROBE_TX);
+
+	return 0;
+}
+
+void
+mrf24j40_txpkt_trigger(void)
+{
+	unsigned char w;
+
+	MRF24J40_TRACE_FN();
+	UPENC_IDLE();
+
+	w = SPI_READ_SHORT(TXNCON);
+	w &= ~(TXNSECEN);
 
 	SPI_WRITE_SHORT(TXNCON, w | TXNTRIG);
 }
 
+/*
+ * Sequence number, PAN and short addresses of the header built by
+ * mrf24j40_txpkt and mrf24j40_fwd. PAN and source address come from the
+ * configuration snapshot once set, saving the SPI reads.
+ */
+static void
+mrf24j40_txhdr_addr(unsigned char *h, unsigned short dest)
+{
+	h[0] = mrf->seq_no++;
+	if (mrf->cfg.set & MRF24J40_CFG_PAN) {
+		h[1] = mrf->cfg.pan & 0xFF;
+		h[2] = mrf->cfg.pan >> 8;
+	} else {
+		h[1] = SPI_READ_SHORT(PANIDL);
+		h[2] = SPI_READ_SHORT(PANIDH);
+	}
+	h[3] = dest & 0xFF;
+	h[4] = dest >> 8;
+	if (mrf->cfg.set & MRF24J40_CFG_ADDR) {
+		h[5] = mrf->cfg.short_addr & 0xFF;
+		h[6] = mrf->cfg.short_addr >> 8;
+	} else {
+		h[5] = SPI_READ_SHORT(SADRL);
+		h[6] = SPI_READ_SHORT(SADRH);
+	}
+}
+
 /*
  * mrf24j40_txpkt sends a packet with the following frame header format:
  *
  * - src PAN == dst PAN (FCPANCOMP)
  * - short src and dst addresses
- * - ACK requested (FCREQACK)
+ * - ACK requested (FCREQACK), unless sent to the broadcast address
  * - type is set to data (FCFRTYP_DATA)
  *
  */
 void
 mrf24j40_txpkt(unsigned short dest, unsigned char *pkt, int payload_len, int enc)
 {
-	struct ieee802_15_4_MAChdr	pkt_header;
+	unsigned char hdr[2 + 9];
 	unsigned char w;
 	int hlen = 0;
 	int flen = 0;
-	int addr = TXNFIFO;
-	int i;
 
-	internal_state = 0;
+	MRF24J40_TRACE_FN();
+	PROBE_BEGIN(MRF24J40_PROBE_TX);
+	UPENC_IDLE();
 
-	hlen = sizeof(pkt_header);
+	hlen = sizeof(hdr) - 2;
 	flen += hlen;
-	flen += len;
+	flen += payload_len;
 
-	/* Request ACK */
-	SPI_WRITE_SHORT(TXNCON, SPI_READ_SHORT(TXNCON) | TXNACKREQ);
+	/* Request ACK; broadcasts are not acknowledged */
+	w = SPI_READ_SHORT(TXNCON) & ~TXNACKREQ;
+	if (dest != IEEE802154_BCAST)
+		w |= TXNACKREQ;
+	SPI_WRITE_SHORT(TXNCON, w);
 
-	/* Populate the header as described in the comment above */
-	pkt_header.dest_addr = (dest << 8) | (dest >> 8);
-	pkt_header.src_addr = ((short)SPI_READ_SHORT(SADRH) << 8) |
-	    SPI_READ_SHORT(SADRL);
-	pkt_header.dest_pan = ((short)SPI_READ_SHORT(PANIDH) << 8) |
-	    SPI_READ_SHORT(PANIDL);
-	pkt_header.seq_no = seq_no++;
-	pkt_header.fc_low = FCFRTYP(FCFRTYP_DATA) | FCREQACK | FCPANCOMP;
-	pkt_header.fc_high = FCDADDRM(FCADDR_SHORT) | FCFRVER(0) |
-	    FCSADDRM(FCADDR_SHORT);
+	/* Header and total frame length, as they go into the TXNFIFO */
+	hdr[0] = hlen;
+	hdr[1] = flen;
 
-	/* Write the header and total frame length into the TXNFIFO */
-	SPI_WRITE_LONG(addr++, hlen);
-	SPI_WRITE_LONG(addr++, flen);
-
-	/* Write the header into the TXNFIFO */
-	for (i = 0; i < sizeof(pkt_header); i++) {
-		SPI_WRITE_LONG(addr++, ((unsigned char *)&pkt_header)[i]);
-	}
+	/*
+	 * Populate the header as described in the comment above. It is
+	 * assembled byte by byte, since the fields are little endian and
+	 * unaligned.
+	 */
+	hdr[2] = FCFRTYP(FCFRTYP_DATA) | FCPANCOMP;
+	if (dest != IEEE802154_BCAST)
+		hdr[2] |= FCREQACK;
+	hdr[3] = FCDADDRM(FCADDR_SHORT) | FCFRVER(0) | FCSADDRM(FCADDR_SHORT);
+	mrf24j40_txhdr_addr(&hdr[4], dest);
 
-	/* Write the payload into the TXNFIFO */
-	for (i = 0; i < len; i++) {
-		SPI_WRITE_LONG(addr++, pkt[i]);
-	}
+	/* Write lengths and header, then the payload into the TXNFIFO */
+	SPI_WRITE_FIFO(TXNFIFO, hdr, sizeof(hdr));
+	SPI_WRITE_FIFO(TXNFIFO + sizeof(hdr), pkt, payload_len);
 
 	w = SPI_READ_SHORT(TXNCON);
 	if (enc)
@@ -440,12 +1106,16 @@ mrf24j40_txpkt(unsigned short dest, unsigned char *pkt, int payload_len, int enc
 
 	/* Trigger transmission */
 	SPI_WRITE_SHORT(TXNCON, w | TXNTRIG);
+	PROBE_END(MRF24J40_PROBE_TX);
 }
 
 int
 mrf24j40_txpkt_intcb(void)
 {
-	unsigned char stat = SPI_READ_SHORT(TXSTAT);
+	unsigned char stat;
+
+	MRF24J40_TRACE_FN();
+	stat = SPI_READ_SHORT(TXSTAT);
 	if (stat & TXNSTAT) {
 		if (stat & CCAFAIL)
 			return EBUSY;
@@ -456,11 +1126,52 @@ mrf24j40_txpkt_intcb(void)
 	}
 }
 
+/*
+ * Retransmissions needed by the last TXNFIFO frame (0-3); with an error
+ * from mrf24j40_txpkt_intcb() all of them were used up.
+ */
+int
+mrf24j40_txpkt_retries(void)
+{
+	MRF24J40_TRACE_FN();
+	return TXNRETRY(SPI_READ_SHORT(TXSTAT));
+}
+
+/* Frame pending bit of the ACK to the last TXNFIFO frame (FPSTAT) */
+int
+mrf24j40_txpkt_pending(void)
+{
+	MRF24J40_TRACE_FN();
+	return ((SPI_READ_SHORT(TXNCON) & FPSTAT) != 0);
+}
+
+#ifndef MRF24J40_NO_TIMESTAMP
+/*
+ * Time of the interrupt for the last received frame and the end of the
+ * last transmission, from the HAL's MRF24J40_TIMESTAMP() clock; both
+ * are taken in mrf24j40_int_tasks(), before INTSTAT is read. Without a
+ * clock they stay 0. A frame read in polled mode has no timestamp.
+ */
+unsigned long
+mrf24j40_rx_stamp(void)
+{
+	return mrf->rx_stamp;
+}
+
+unsigned long
+mrf24j40_tx_stamp(void)
+{
+	return mrf->tx_stamp;
+}
+#endif
+
+#ifndef MRF24J40_NO_SEC
 int
 mrf24j40_sec_intcb(int accept)
 {
 	unsigned char w;
 
+	MRF24J40_TRACE_FN();
 	w = SPI_READ_SHORT(SECCON0);
 	w &= ~(SECSTART | SECIGNORE);
 
@@ -468,8 +1179,10 @@ mrf24j40_sec_intcb(int accept)
 		SPI_WRITE_SHORT(SECCON0, w | SECSTART);
 	} else {
 		SPI_WRITE_SHORT(SECCON0, w | SECIGNORE);
-		SPI_WRITE_SHORT(RXFLUSH, _RXFLUSH);
+		SPI_WRITE_SHORT(RXFLUSH, mrf->cfg.rxflush | _RXFLUSH);
 	}
+
+	return 0;
 }
 
 int
@@ -477,128 +1190,306 @@ mrf24j40_check_rx_dec(int no_err_flush)
 {
 	int err;
 
+	MRF24J40_TRACE_FN();
 	err = (SPI_READ_SHORT(RXSR) & SECDECERR) ? EIO : 0;
 
 	if (err && !no_err_flush)
-		SPI_WRITE_SHORT(RXFLUSH, _RXFLUSH);
+		SPI_WRITE_SHORT(RXFLUSH, mrf->cfg.rxflush | _RXFLUSH);
 
 	return err;
 }
+#endif
 
 int
 mrf24j40_rxpkt_intcb(unsigned char *d, int len, unsigned char *plqi,
     unsigned char *prssi)
 {
 	int flen;
-	int addr = RXFIFO;
-	unsigned char lqi, rssi;
+	unsigned char lqi[2];
+
+	MRF24J40_TRACE_FN();
+	PROBE_BEGIN(MRF24J40_PROBE_RX);
 
 	/* Disable receiving more packets */
 	SPI_WRITE_SHORT(BBREG1, SPI_READ_SHORT(BBREG1) | RXDECINV);
 
 	/* Read frame length */
-	flen = SPI_READ_LONG(addr++);
+	flen = SPI_READ_LONG(RXFIFO);
 	*d++ = flen;
 
 	/* Check whether the provided buffer is large enough */
 	if (flen > len) {
 		/* Re-enable packet reception */
 		SPI_WRITE_SHORT(BBREG1, SPI_READ_SHORT(BBREG1) & ~RXDECINV);
+		PROBE_END(MRF24J40_PROBE_RX);
 		return ENOMEM;
 	}
 
-	/* Read out frame */
-	while (flen-- > 0)
-		*d++ = SPI_READ_LONG(addr++);
-
-	lqi = SPI_READ_LONG(addr++);
-	rssi = SPI_READ_LONG(addr++);
+	/* Read out frame, followed by LQI and RSSI */
+	SPI_READ_FIFO(RXFIFO + 1, d, flen);
+	SPI_READ_FIFO(RXFIFO + 1 + flen, lqi, 2);
 
 	if (plqi != (void *)0)
-		*plqi = lqi;
+		*plqi = lqi[0];
 
 	if (prssi != (void *)0)
-		*prssi = rssi;
+		*prssi = lqi[1];
 
 	/*
 	 * Flush RX FIFO (silicon errata #1 workaround, strictly
 	 * speaking only needed if using promiscuous mode).
 	 */
-	SPI_WRITE_SHORT(RXFLUSH, _RXFLUSH);
+	SPI_WRITE_SHORT(RXFLUSH, mrf->cfg.rxflush | _RXFLUSH);
 
 	/* Re-enable packet reception */
 	SPI_WRITE_SHORT(BBREG1, SPI_READ_SHORT(BBREG1) & ~RXDECINV);
+	PROBE_END(MRF24J40_PROBE_RX);
 	return 0;
 }
 
+#ifndef MRF24J40_NO_PART_RX
+/*
+ * Chunked reception through a caller-owned cursor. mrf24j40_rx_open()
+ * stops reception, so the frame at the head of the RXFIFO stays put
+ * until mrf24j40_rx_close(); in between it can be read in pieces and in
+ * any order, e.g. from a task rather than the interrupt handler. Closing
+ * early discards the rest of the frame.
+ *
+ * Returns the frame length, including the FCS. LQI and RSSI are read
+ * into the cursor.
+ */
+int
+mrf24j40_rx_open(struct mrf24j40_rx_cursor *c)
+{
+	unsigned char lqi[2];
+
+	MRF24J40_TRACE_FN();
+
+	/* Disable receiving more packets */
+	SPI_WRITE_SHORT(BBREG1, SPI_READ_SHORT(BBREG1) | RXDECINV);
+
+	c->flen = SPI_READ_LONG(RXFIFO);
+	c->pos = 0;
+
+	/* LQI and RSSI follow the frame */
+	SPI_READ_FIFO(RXFIFO + 1 + c->flen, lqi, 2);
+	c->lqi = lqi[0];
+	c->rssi = lqi[1];
+
+	return c->flen;
+}
+
+/*
+ * Reads up to len bytes from the cursor position on; returns the number
+ * of bytes read, 0 at the end of the frame.
+ */
+int
+mrf24j40_rx_read(struct mrf24j40_rx_cursor *c, unsigned char *d, int len)
+{
+	MRF24J40_TRACE_FN();
+	if (len > c->flen - c->pos)
+		len = c->flen - c->pos;
+
+	SPI_READ_FIFO(RXFIFO + 1 + c->pos, d, len);
+	if (len > 0)
+		c->pos += len;
+
+	return len;
+}
+
+/* Moves the cursor to offset off, at most the end of the frame */
+int
+mrf24j40_rx_seek(struct mrf24j40_rx_cursor *c, int off)
+{
+	if (off < 0)
+		off = 0;
+	if (off > c->flen)
+		off = c->flen;
+
+	c->pos = off;
+
+	return off;
+}
+
+void
+mrf24j40_rx_close(struct mrf24j40_rx_cursor *c)
+{
+	MRF24J40_TRACE_FN();
+	c->flen = c->pos = 0;
+
+	/*
+	 * Flush RX FIFO (silicon errata #1 workaround, strictly
+	 * speaking only needed if using promiscuous mode).
+	 */
+	SPI_WRITE_SHORT(RXFLUSH, mrf->cfg.rxflush | _RXFLUSH);
+
+	/* Re-enable packet reception */
+	SPI_WRITE_SHORT(BBREG1, SPI_READ_SHORT(BBREG1) & ~RXDECINV);
+}
+
 int
 mrf24j40_rxpkt_part_intcb(unsigned char *d, int len, int flags,
     unsigned char *plqi, unsigned char *prssi)
 {
-	static int flen;
-	static int addr;
-	unsigned char lqi, rssi;
+	struct mrf24j40_rx_cursor *c = &mrf->part;
+
+	MRF24J40_TRACE_FN();
 
 	/* Abort; flush and re-enable reception */
 	if (flags & MRF24J40_PART_RX_ABORT) {
-		/* Flush RX FIFO */
-		SPI_WRITE_SHORT(RXFLUSH, _RXFLUSH);
-
-		/* Re-enable packet reception */
-		SPI_WRITE_SHORT(BBREG1, SPI_READ_SHORT(BBREG1) & ~RXDECINV);
+		mrf24j40_rx_close(c);
 		return -1;
 	}
 
 	/* First chunk; disable packet reception and read frame length */
 	if (flags & MRF24J40_PART_RX_FIRST) {
-		/* Disable receiving more packets */
-		SPI_WRITE_SHORT(BBREG1, SPI_READ_SHORT(BBREG1) | RXDECINV);
-
-		addr = RXFIFO;
-		flen = SPI_READ_LONG(addr++);
-
 		/* Account for frame len */
 		--len;
-		*d++ = flen;
+		*d++ = mrf24j40_rx_open(c);
 	}
 
-	if (flen < len)
-		len = flen;
-
-	/* Adjust remaining frame length */
-	flen -= len;
-
-	/* Read out frame */
-	while (len-- > 0)
-		*d++ = SPI_READ_LONG(addr++);
+	mrf24j40_rx_read(c, d, len);
 
 	/* Have we finished reading the frame? */
-	if (flen == 0) {
-		lqi = SPI_READ_LONG(addr++);
-		rssi = SPI_READ_LONG(addr++);
-
+	len = c->flen - c->pos;
+	if (len == 0) {
 		if (plqi != (void *)0)
-			*plqi = lqi;
+			*plqi = c->lqi;
 
 		if (prssi != (void *)0)
-			*prssi = rssi;
+			*prssi = c->rssi;
 
-		/*
-		 * Flush RX FIFO (silicon errata #1 workaround, strictly
-		 * speaking only needed if using promiscuous mode).
-		 */
-		SPI_WRITE_SHORT(RXFLUSH, _RXFLUSH);
+		mrf24j40_rx_close(c);
+	}
 
-		/* Re-enable packet reception */
+	return len;
+}
+#endif
+
+#ifndef MRF24J40_NO_FWD
+/*
+ * Length of the MAC header at f, or -1 if it cannot be rewritten for
+ * forwarding (security enabled, reserved addressing mode) or does not
+ * fit in the len bytes read.
+ */
+static int
+mrf24j40_fwd_hdr_len(unsigned char *f, int len)
+{
+	unsigned char dm = (f[1] >> 2) & 0x03;
+	unsigned char sm = (f[1] >> 6) & 0x03;
+	int hlen = 3;
+
+	if ((f[0] & FCSECEN) || dm == 0x01 || sm == 0x01)
+		return -1;
+
+	if (dm != FCADDR_NONE)
+		hlen += 2 + ((dm == FCADDR_SHORT) ? 2 : 8);
+	if (sm != FCADDR_NONE) {
+		if (dm == FCADDR_NONE || !(f[0] & FCPANCOMP))
+			hlen += 2;
+		hlen += (sm == FCADDR_SHORT) ? 2 : 8;
+	}
+
+	return (hlen <= len) ? hlen : -1;
+}
+
+/*
+ * Forward the frame in the RXFIFO without reading it into a buffer.
+ *
+ * The first MRF24J40_FWD_CHUNK bytes of the frame (starting at the frame
+ * control field) are handed to route, which returns 0 and sets
+ * *next_hop to have the frame forwarded. The header is then replaced by
+ * the mrf24j40_txpkt one (short addresses, PAN compression, our PAN,
+ * source address and sequence number, ACK requested unless next_hop is
+ * the broadcast address), keeping frame type and version. The payload
+ * is copied from the RXFIFO into the TXNFIFO a chunk at a time, after
+ * which reception is re-enabled and transmission started; completion
+ * is reported through mrf24j40_txpkt_intcb() as usual. The TXNFIFO must
+ * not hold a frame still being sent.
+ *
+ * Returns 0 once forwarding started, or ENOMEM if the rewritten frame
+ * does not fit (it is dropped). If route declines, or the frame is
+ * secured or malformed, -1 is returned and the frame is left in the
+ * RXFIFO, reception still disabled, for mrf24j40_rxpkt_intcb() or
+ * mrf24j40_rxpkt_part_intcb().
+ */
+int
+mrf24j40_fwd(mrf24j40_route_fn route)
+{
+	unsigned char buf[MRF24J40_FWD_CHUNK];
+	unsigned char fc_low, fc_high, w;
+	unsigned short next_hop;
+	int flen, hlen, plen, off, n;
+
+	MRF24J40_TRACE_FN();
+
+	/* Disable receiving more packets */
+	SPI_WRITE_SHORT(BBREG1, SPI_READ_SHORT(BBREG1) | RXDECINV);
+
+	/* Frame length, without FCS */
+	flen = SPI_READ_LONG(RXFIFO) - 2;
+	if (flen < 3)
+		return -1;
+
+	n = (flen < (int)sizeof(buf)) ? flen : (int)sizeof(buf);
+	SPI_READ_FIFO(RXFIFO + 1, buf, n);
+
+	hlen = mrf24j40_fwd_hdr_len(buf, n);
+	if (hlen < 0 || route(buf, n, &next_hop) != 0)
+		return -1;
+
+	plen = flen - hlen;
+	if (plen > MRF24J40_TXPKT_MAX) {
+		SPI_WRITE_SHORT(RXFLUSH, mrf->cfg.rxflush | _RXFLUSH);
 		SPI_WRITE_SHORT(BBREG1, SPI_READ_SHORT(BBREG1) & ~RXDECINV);
+		return ENOMEM;
 	}
 
-	return flen;
+	UPENC_IDLE();
+
+	fc_low = buf[0] & FCFRTYP(0x07);
+	fc_high = buf[1] & FCFRVER(0x03);
+
+	/* Lengths and new header, as mrf24j40_txpkt writes them */
+	buf[0] = 9;
+	buf[1] = 9 + plen;
+	buf[2] = fc_low | FCPANCOMP;
+	if (next_hop != IEEE802154_BCAST)
+		buf[2] |= FCREQACK;
+	buf[3] = fc_high | FCDADDRM(FCADDR_SHORT) | FCSADDRM(FCADDR_SHORT);
+	mrf24j40_txhdr_addr(&buf[4], next_hop);
+	SPI_WRITE_FIFO(TXNFIFO, buf, 2 + 9);
+
+	/* Stream the payload across */
+	for (off = 0; off < plen; off += n) {
+		n = plen - off;
+		if (n > (int)sizeof(buf))
+			n = sizeof(buf);
+
+		SPI_READ_FIFO(RXFIFO + 1 + hlen + off, buf, n);
+		SPI_WRITE_FIFO(TXNFIFO + 2 + 9 + off, buf, n);
+	}
+
+	/* Flush RX FIFO and re-enable packet reception */
+	SPI_WRITE_SHORT(RXFLUSH, mrf->cfg.rxflush | _RXFLUSH);
+	SPI_WRITE_SHORT(BBREG1, SPI_READ_SHORT(BBREG1) & ~RXDECINV);
+
+	w = SPI_READ_SHORT(TXNCON) & ~(TXNSECEN | TXNACKREQ);
+	if (next_hop != IEEE802154_BCAST)
+		w |= TXNACKREQ;
+
+	/* Trigger transmission */
+	SPI_WRITE_SHORT(TXNCON, w | TXNTRIG);
+
+	return 0;
 }
+#endif
 
+#ifndef MRF24J40_NO_UPENC
 int
 mrf24j40_check_enc(void)
 {
+	MRF24J40_TRACE_FN();
 	return mrf24j40_txpkt_intcb();
 }
 
@@ -608,6 +1499,7 @@ mrf24j40_check_dec(void)
 	unsigned char w;
 	int error;
 
+	MRF24J40_TRACE_FN();
 	if ((error = mrf24j40_txpkt_intcb()) != 0)
 		return error;
 		/* NOT REACHED */
@@ -615,45 +1507,295 @@ mrf24j40_check_dec(void)
 	w = SPI_READ_SHORT(RXSR);
 	return (w & UPSECERR) ? EIO : 0;
 }
+#endif
+
+/*
+ * Translate the INTSTAT bits into MRF24J40_INT_* flags. RXIF is left
+ * to the caller, since its meaning depends on the receive mode.
+ */
+static int
+mrf24j40_int_decode(unsigned char stat)
+{
+	int ret = 0;
+
+	if (stat & TXNIF) {
+#ifdef MRF24J40_NO_UPENC
+		ret |= MRF24J40_INT_TX;
+#else
+		switch (mrf->internal_state) {
+		case MRF24J40_STATE_UPENC:
+			ret |= MRF24J40_INT_ENC;
+			mrf->internal_state = 0;
+			break;
+
+		case MRF24J40_STATE_UPDEC:
+			ret |= MRF24J40_INT_DEC;
+			mrf->internal_state = 0;
+			break;
+
+		default:
+			ret |= MRF24J40_INT_TX;
+		}
+#endif
+	}
+
+	if (stat & SECIF) {
+#ifdef MRF24J40_NO_SEC
+		/* Nobody to decide on secured frames; drop them */
+		SPI_WRITE_SHORT(SECCON0, SPI_READ_SHORT(SECCON0) | SECIGNORE);
+		SPI_WRITE_SHORT(RXFLUSH, mrf->cfg.rxflush | _RXFLUSH);
+#else
+		ret |= MRF24J40_INT_SEC;
+#endif
+	}
+
+	if (stat & HSYMTMRIF) {
+		ret |= MRF24J40_INT_TMR;
+	}
+
+	return ret;
+}
 
 int
 mrf24j40_int_tasks(void)
 {
 	unsigned char stat;
 	int ret = 0;
+#ifdef MRF24J40_TIMESTAMP
+	unsigned long now = MRF24J40_TIMESTAMP();
+#endif
+
+	MRF24J40_TRACE_FN();
+	PROBE_BEGIN(MRF24J40_PROBE_ISR);
 
 	/* Read INTSTAT register; this clears the interrupt flags */
 	stat = SPI_READ_SHORT(INTSTAT);
 
+#ifdef MRF24J40_TIMESTAMP
+	if (stat & RXIF)
+		mrf->rx_stamp = now;
+	if (stat & TXNIF)
+		mrf->tx_stamp = now;
+#endif
+
 	/* Check which interrupts occured and set return value accordingly */
 	if (stat & RXIF) {
+#ifdef MRF24J40_NO_RX_POLL
 		ret |= MRF24J40_INT_RX;
+#else
+		if (mrf->rx_mode == MRF24J40_RX_MODE_POLL) {
+			/*
+			 * Some other interrupt source cleared RXIF while
+			 * we are polling; remember it for mrf24j40_rx_poll.
+			 */
+			mrf->rx_pending = 1;
+		} else {
+			ret |= MRF24J40_INT_RX;
+			++mrf->rx_stats.int_frames;
+			if (mrf->rx_irqs != 0xFF)
+				++mrf->rx_irqs;
+		}
+#endif
 	}
 
-	if (stat & TXNIF) {
-		switch (internal_state) {
-		MRF24J40_STATE_UPENC:
-			ret |= MRF24J40_INT_ENC;
-			internal_state = 0;
-			break;
+	ret |= mrf24j40_int_decode(stat);
 
-		MRF24J40_STATE_UPDEC:
-			ret |= MRF24J40_INT_DEC;
-			internal_state = 0;
-			break;
+	PROBE_END(MRF24J40_PROBE_ISR);
+	return ret;
+}
 
-		default:
-			ret |= MRF24J40_INT_TX;
+#ifndef MRF24J40_NO_RX_POLL
+/*
+ * Polled (NAPI-style) receive.
+ *
+ * In the default interrupt mode every frame costs an interrupt. If
+ * adaptive switching is enabled (enter_thresh > 0), the application
+ * calls mrf24j40_rx_poll_tick() at a fixed interval; once a tick window
+ * saw at least enter_thresh RX interrupts, RXIE is masked and the
+ * application is expected to call mrf24j40_rx_poll() from its main loop
+ * instead. After exit_idle consecutive polls that found no frame, RXIE
+ * is unmasked again and the driver goes back to interrupt mode.
+ *
+ * Both counts are kept in a byte: enter_thresh is clamped to 1..255
+ * (0 or less disables switching), exit_idle to 1..255.
+ */
+void
+mrf24j40_rx_poll_setup(int enter_thresh, int exit_idle)
+{
+	if (enter_thresh < 0)
+		enter_thresh = 0;
+	else if (enter_thresh > 0xFF)
+		enter_thresh = 0xFF;
+	if (exit_idle < 1)
+		exit_idle = 1;
+	else if (exit_idle > 0xFF)
+		exit_idle = 0xFF;
+
+	mrf->rx_enter_thresh = enter_thresh;
+	mrf->rx_exit_idle = exit_idle;
+	mrf->rx_irqs = 0;
+	mrf->rx_idle = 0;
+}
+
+static void
+mrf24j40_rx_mode(unsigned char mode)
+{
+	unsigned char w;
+
+	w = SPI_READ_SHORT(INTCON);
+	if (mode == MRF24J40_RX_MODE_POLL) {
+		/* Setting the IE bit masks the interrupt, see mrf24j40_ie */
+		SPI_WRITE_SHORT(INTCON, w | RXIE);
+		++mrf->rx_stats.to_poll;
+	} else {
+		SPI_WRITE_SHORT(INTCON, w & ~RXIE);
+		++mrf->rx_stats.to_int;
+	}
+
+	mrf->rx_mode = mode;
+	mrf->rx_irqs = 0;
+	mrf->rx_idle = 0;
+}
+
+void
+mrf24j40_rx_poll_tick(void)
+{
+	MRF24J40_TRACE_FN();
+	if (mrf->rx_mode == MRF24J40_RX_MODE_INT && mrf->rx_enter_thresh != 0 &&
+	    mrf->rx_irqs >= mrf->rx_enter_thresh)
+		mrf24j40_rx_mode(MRF24J40_RX_MODE_POLL);
+
+	mrf->rx_irqs = 0;
+}
+
+/*
+ * Read up to budget frames into d (see mrf24j40_rxpkt_intcb) and hand
+ * each one to cb. Any other interrupt events seen while polling are
+ * returned through pflags as MRF24J40_INT_* flags, since reading
+ * INTSTAT here clears them before the interrupt handler gets to them.
+ *
+ * Returns the number of frames received.
+ */
+int
+mrf24j40_rx_poll(int budget, unsigned char *d, int len, mrf24j40_rx_cb cb,
+    int *pflags)
+{
+	unsigned char stat, lqi, rssi;
+	int flags = 0;
+	int n = 0;
+
+	MRF24J40_TRACE_FN();
+	++mrf->rx_stats.polls;
+
+	while (n < budget) {
+		stat = SPI_READ_SHORT(INTSTAT);
+		flags |= mrf24j40_int_decode(stat);
+
+		if (!(stat & RXIF) && !mrf->rx_pending) {
+			if (mrf->rx_mode == MRF24J40_RX_MODE_INT ||
+			    n != 0 || ++mrf->rx_idle < mrf->rx_exit_idle)
+				break;
+
+			/*
+			 * Queue drained; unmask RXIE and check once more for
+			 * a frame that raced with the switch, since it would
+			 * not raise an interrupt of its own.
+			 */
+			mrf24j40_rx_mode(MRF24J40_RX_MODE_INT);
+			continue;
+		}
+
+		mrf->rx_pending = 0;
+		mrf->rx_idle = 0;
+
+		if (mrf24j40_rxpkt_intcb(d, len, &lqi, &rssi) != 0) {
+			/* Frame does not fit; drop it */
+			mrf24j40_rxfifo_flush();
+			continue;
 		}
+
+		++mrf->rx_stats.poll_frames;
+		++n;
+		cb(d, lqi, rssi);
 	}
 
-	if (stat & SECIF) {
-		ret |= MRF24J40_INT_SEC;
+	if (n == 0)
+		++mrf->rx_stats.empty_polls;
+
+	if (pflags != (void *)0)
+		*pflags = flags;
+
+	return n;
+}
+
+int
+mrf24j40_rx_polling(void)
+{
+	return (mrf->rx_mode == MRF24J40_RX_MODE_POLL);
+}
+
+void
+mrf24j40_rx_poll_stats(struct mrf24j40_rx_poll_stats *st)
+{
+	mrf->rx_stats.mode = mrf->rx_mode;
+	mrf->rx_stats.enter_thresh = mrf->rx_enter_thresh;
+	mrf->rx_stats.exit_idle = mrf->rx_exit_idle;
+	*st = mrf->rx_stats;
+}
+#endif
+
+#ifdef MRF24J40_PROBES
+/*
+ * Copies the MRF24J40_PROBE_NUM probe histograms to st and optionally
+ * starts them over.
+ */
+void
+mrf24j40_probe_stats(struct mrf24j40_probe *st, int clear)
+{
+	struct mrf24j40_probe *p;
+	int i, b;
+
+	for (i = 0; i < MRF24J40_PROBE_NUM; i++) {
+		p = &mrf->probe[i];
+		st[i] = *p;
+		if (!clear)
+			continue;
+
+		p->count = p->max = 0;
+		for (b = 0; b < MRF24J40_PROBE_BUCKETS; b++)
+			p->hist[b] = 0;
 	}
+}
 
-	return ret;
+/*
+ * Upper bound of the bucket holding the pct-th percentile of p, e.g. 50
+ * or 99, capped by the maximum seen.
+ */
+unsigned short
+mrf24j40_probe_pct(const struct mrf24j40_probe *p, int pct)
+{
+	unsigned long n = 0, sum = 0, top;
+	int b;
+
+	for (b = 0; b < MRF24J40_PROBE_BUCKETS; b++)
+		n += p->hist[b];
+
+	for (b = 0; b < MRF24J40_PROBE_BUCKETS - 1; b++) {
+		sum += p->hist[b];
+		if (sum * 100 >= n * pct)
+			break;
+	}
+
+	if (b == MRF24J40_PROBE_BUCKETS - 1 || n == 0)
+		return p->max;
+
+	top = (1UL << (MRF24J40_PROBE_SHIFT + b)) - 1;
+
+	return (top < p->max) ? top : p->max;
 }
+#endif
 
+#ifndef MRF24J40_NO_UPENC
 /*
  * NOTE: header length can be a maximum of 31 bytes due to a hardware
  *	 limitation.
@@ -664,11 +1806,8 @@ mrf24j40_encdec(unsigned char *nonce, int nonce_len, unsigned char *frame,
 {
 	int addr;
 
-	/* Upper layer encryption / decryption */
-	if (enc)
-		internal_state = MRF24J40_STATE_UPENC;
-	else
-		internal_state = MRF24J40_STATE_UPDEC;
+	MRF24J40_TRACE_FN();
+	PROBE_BEGIN(MRF24J40_PROBE_CRYPT);
 
 	/*
 	 * Load the 13-byte NONCE into UPNONCE...
@@ -685,10 +1824,23 @@ mrf24j40_encdec(unsigned char *nonce, int nonce_len, unsigned char *frame,
 	else
 		SPI_WRITE_SHORT(SECCR2, UPDEC);
 
+	/*
+	 * Load the frame the way mrf24j40_txpkt_raw does, but note the
+	 * pending operation only once it is in the TXNFIFO, so that the
+	 * TXNIF it raises is reported as MRF24J40_INT_ENC/DEC.
+	 */
+	mrf24j40_txfifo_load(frame, hdr_len, frame_len);
+
+	/* Upper layer encryption / decryption */
+	if (enc)
+		mrf->internal_state = MRF24J40_STATE_UPENC;
+	else
+		mrf->internal_state = MRF24J40_STATE_UPDEC;
+
 	/*
 	 * Encrypt frame by setting TXNTRIG and TXNSECEN
 	 */
-	mrf24j40_txpkt_raw(frame, hdr_len, frame_len, enc);
+	mrf24j40_txfifo_trig(enc);
 
 	/*
 	 * TXNIF interrupt issued when encryption or decryption complete.
@@ -697,5 +1849,8 @@ mrf24j40_encdec(unsigned char *nonce, int nonce_len, unsigned char *frame,
 	 *
 	 * TXNFIFO contains encrypted/decrypted frame.
 	 */
+
+	PROBE_END(MRF24J40_PROBE_CRYPT);
 }
+#endif
 
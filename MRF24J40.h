@@ -20,6 +20,52 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#ifndef _MRF24J40_H_
+#define _MRF24J40_H_
+
+/*
+ * Feature selection. Each MRF24J40_NO_* leaves out the code, state and
+ * declarations of one subsystem; MRF24J40_MINIMAL leaves out all of
+ * them. They change struct mrf24j40_state, so they have to be the same
+ * for every file including this header. tools/footprint.sh reports the
+ * resulting sizes.
+ *
+ *   MRF24J40_NO_SEC		MAC security (keys, SECIF handling)
+ *   MRF24J40_NO_UPENC		upper layer encryption, mrf24j40_encdec()
+ *   MRF24J40_NO_PART_RX	partial and cursor based reception
+ *   MRF24J40_NO_SLEEP		sleep and wakeup
+ *   MRF24J40_NO_PROMISC	promiscuous mode
+ *   MRF24J40_NO_RX_POLL	polled receive
+ *   MRF24J40_NO_FWD		mrf24j40_fwd()
+ *   MRF24J40_NO_TIMESTAMP	frame timestamps
+ */
+#ifdef MRF24J40_MINIMAL
+#ifndef MRF24J40_NO_SEC
+#define MRF24J40_NO_SEC
+#endif
+#ifndef MRF24J40_NO_UPENC
+#define MRF24J40_NO_UPENC
+#endif
+#ifndef MRF24J40_NO_PART_RX
+#define MRF24J40_NO_PART_RX
+#endif
+#ifndef MRF24J40_NO_SLEEP
+#define MRF24J40_NO_SLEEP
+#endif
+#ifndef MRF24J40_NO_PROMISC
+#define MRF24J40_NO_PROMISC
+#endif
+#ifndef MRF24J40_NO_RX_POLL
+#define MRF24J40_NO_RX_POLL
+#endif
+#ifndef MRF24J40_NO_FWD
+#define MRF24J40_NO_FWD
+#endif
+#ifndef MRF24J40_NO_TIMESTAMP
+#define MRF24J40_NO_TIMESTAMP
+#endif
+#endif
+
 /* Return values */
 #define MRF24J40_INT_RX		0x01
 #define MRF24J40_INT_TX		0x02
@@ -27,6 +73,7 @@
 #define MRF24J40_INT_SLP	0x08
 #define MRF24J40_INT_ENC	0x10
 #define MRF24J40_INT_DEC	0x20
+#define MRF24J40_INT_TMR	0x40
 
 #define EIO			5
 #define ENOMEM			12
@@ -36,6 +83,36 @@
 #define MRF24J40_STATE_UPENC	0x01
 #define MRF24J40_STATE_UPDEC	0x02
 
+/* Receive modes */
+#define MRF24J40_RX_MODE_INT	0	/* one interrupt per received frame */
+#define MRF24J40_RX_MODE_POLL	1	/* RXIE masked, frames polled */
+
+/* Largest payload for mrf24j40_txpkt: 127 - 9 byte header - 2 byte FCS */
+#define MRF24J40_TXPKT_MAX	116
+
+/* Highest mrf24j40_set_txpower() level, i.e. the lowest power */
+#define MRF24J40_TXPOWER_MAX	31
+
+/* Register groups lost by a reset, see mrf24j40_restart */
+#define MRF24J40_LOST_MAC	0x01	/* short 0x00-0x37, SOFTRST RSTMAC */
+#define MRF24J40_LOST_BB	0x02	/* short 0x38-0x3F, SOFTRST RSTBB */
+#define MRF24J40_LOST_RF	0x04	/* long control registers */
+#define MRF24J40_LOST_ALL	0x07	/* power-on or RESET pin */
+
+/* Returned by mrf24j40_step() and the *_start functions when done */
+#define MRF24J40_STEP_DONE	(-1)
+
+/* Hot-path probes, see MRF24J40_PROBES */
+#define MRF24J40_PROBE_ISR	0	/* mrf24j40_int_tasks */
+#define MRF24J40_PROBE_TX	1	/* mrf24j40_txpkt, _raw, _iov */
+#define MRF24J40_PROBE_RX	2	/* mrf24j40_rxpkt_intcb */
+#define MRF24J40_PROBE_CRYPT	3	/* mrf24j40_encdec */
+#define MRF24J40_PROBE_NUM	4
+
+/* Configured fields in struct mrf24j40_config */
+#define MRF24J40_CFG_PAN	0x01
+#define MRF24J40_CFG_ADDR	0x02
+
 /* Partial reception flags */
 #define MRF24J40_PART_RX_ABORT	(1 << 1)
 #define MRF24J40_PART_RX_FIRST	(1)
@@ -192,6 +269,7 @@
 
 /* PACON2 */
 #define FIFOEN		(1<<7)
+#define TXONTS(x)	((x & 0x0F) << 2)
 
 /* TXNCON */
 #define FPSTAT		(1<<4)
@@ -208,6 +286,7 @@
 #define REGWAKE		(1<<6)
 
 /* TXSTAT */
+#define TXNRETRY(x)	((x >> 6) & 0x03)
 #define CCAFAIL		(1<<5)
 #define TXNSTAT		(1)
 
@@ -324,34 +403,244 @@
 #define SLPCLKDIV(x)	((x & 0x1F))	/* division ratio: 2^(SLPCLKDIV) */
 
 
+/*
+ * Polled receive statistics. The thresholds are the ones currently in
+ * effect, as set by mrf24j40_rx_poll_setup().
+ */
+struct mrf24j40_rx_poll_stats {
+	unsigned char	mode;		/* MRF24J40_RX_MODE_* */
+	unsigned char	enter_thresh;	/* RX interrupts per tick to poll */
+	unsigned char	exit_idle;	/* empty polls to go back to int */
+	unsigned short	to_poll;	/* int -> poll mode switches */
+	unsigned short	to_int;		/* poll -> int mode switches */
+	unsigned short	int_frames;	/* frames signalled by interrupt */
+	unsigned short	poll_frames;	/* frames read by mrf24j40_rx_poll */
+	unsigned short	polls;		/* calls to mrf24j40_rx_poll */
+	unsigned short	empty_polls;	/* ... which found nothing */
+};
+
+/*
+ * Duration histograms of the hot paths, built with MRF24J40_PROBES. The
+ * HAL provides the time base as MRF24J40_CYCLES(), a free-running
+ * counter of at least 16 bits (CPU cycles, a timer, microseconds), so
+ * durations are in its units. Bucket 0 counts durations below
+ * 2^MRF24J40_PROBE_SHIFT, every further bucket twice the range of the
+ * previous one and the last bucket everything longer. Counters saturate.
+ *
+ * mrf24j40_encdec() loads the FIFO directly and only adds a crypt
+ * sample, not a TX one.
+ */
+#ifndef MRF24J40_PROBE_BUCKETS
+#define MRF24J40_PROBE_BUCKETS	12
+#endif
+#ifndef MRF24J40_PROBE_SHIFT
+#define MRF24J40_PROBE_SHIFT	5
+#endif
+
+struct mrf24j40_probe {
+	unsigned short	count;
+	unsigned short	max;
+	unsigned short	hist[MRF24J40_PROBE_BUCKETS];
+};
+
+/*
+ * Read position in the frame at the head of the RXFIFO, see
+ * mrf24j40_rx_open(). Offsets count from the frame control field.
+ */
+struct mrf24j40_rx_cursor {
+	unsigned char	flen;		/* frame length, including the FCS */
+	unsigned char	pos;		/* offset of the next byte to read */
+	unsigned char	lqi;
+	unsigned char	rssi;
+};
+
+/*
+ * Configuration snapshot; everything set through the mrf24j40_set_*
+ * calls that is not covered by the fixed init table. It is kept up to
+ * date by the driver and can be saved by the application across a
+ * power down of the MCU, see mrf24j40_restart().
+ */
+struct mrf24j40_config {
+	unsigned char	set;		/* MRF24J40_CFG_* */
+	unsigned char	channel;	/* 0 -> channel 11 */
+	unsigned char	rxmcr;
+	unsigned char	rxflush;	/* RX filter and WAKE pin bits */
+	unsigned char	turbo;
+	unsigned char	txpower;	/* mrf24j40_set_txpower() level */
+	unsigned char	bbreg2;		/* CCA mode and CS threshold */
+	unsigned char	ccaedth;
+	unsigned short	pan;
+	unsigned short	short_addr;
+};
+
+/*
+ * Per-radio driver state. A zeroed structure is a valid initial state.
+ *
+ * Normally the driver keeps a single static instance. When built with
+ * MRF24J40_MULTI, mrf24j40_bind() selects the instance used by the
+ * following calls; defining MRF24J40_TLS as a thread-local storage class
+ * (e.g. _Thread_local) makes that selection per thread, so one thread
+ * can service each radio.
+ */
+struct mrf24j40_state {
+	unsigned char	seq_no;
+#ifndef MRF24J40_NO_UPENC
+	unsigned char	internal_state;
+#endif
+	struct mrf24j40_config cfg;
+
+	/* Non-blocking operation in progress */
+	unsigned char	step;
+	unsigned char	step_arg;
+
+#ifndef MRF24J40_NO_RX_POLL
+	/* Polled receive */
+	unsigned char	rx_mode;
+	unsigned char	rx_pending;
+	unsigned char	rx_irqs;
+	unsigned char	rx_idle;
+	unsigned char	rx_enter_thresh;
+	unsigned char	rx_exit_idle;
+	struct mrf24j40_rx_poll_stats rx_stats;
+#endif
+
+#ifndef MRF24J40_NO_PART_RX
+	/* Partial reception, mrf24j40_rxpkt_part_intcb() */
+	struct mrf24j40_rx_cursor part;
+#endif
+
+#ifndef MRF24J40_NO_TIMESTAMP
+	/* MRF24J40_TIMESTAMP() at the last RXIF and TXNIF */
+	unsigned long	rx_stamp;
+	unsigned long	tx_stamp;
+#endif
+
+#ifdef MRF24J40_PROBES
+	unsigned short	probe_start[MRF24J40_PROBE_NUM];
+	struct mrf24j40_probe probe[MRF24J40_PROBE_NUM];
+#endif
+};
+
+#ifndef MRF24J40_TLS
+#define MRF24J40_TLS
+#endif
+
+typedef void (*mrf24j40_rx_cb)(unsigned char *d, unsigned char lqi,
+    unsigned char rssi);
+
+/*
+ * Routing hook for mrf24j40_fwd(). f holds the first len bytes of the
+ * received frame, from the frame control field on; the whole MAC header
+ * is always included. Returns 0 and sets *next_hop to forward the frame.
+ */
+typedef int (*mrf24j40_route_fn)(unsigned char *f, int len,
+    unsigned short *next_hop);
+
+/*
+ * Frame segment for mrf24j40_txpkt_iov(). The leading segments hold the
+ * MAC header (with any auxiliary security header), the rest the payload.
+ */
+struct mrf24j40_iov {
+	unsigned char	*base;
+	unsigned char	len;
+};
+
+/* Bounce buffer of mrf24j40_fwd(); at least 23, the longest header */
+#ifndef MRF24J40_FWD_CHUNK
+#define MRF24J40_FWD_CHUNK	32
+#endif
+
+#ifdef MRF24J40_MULTI
+void mrf24j40_bind(struct mrf24j40_state *st);
+#endif
 void mrf24j40_rxfifo_flush(void);
 void mrf24j40_init(int ch);
+void mrf24j40_pwr_reset(void);
+void mrf24j40_bb_reset(void);
+void mrf24j40_mac_reset(void);
+void mrf24j40_rf_reset(void);
+void mrf24j40_restart(const struct mrf24j40_config *cfg, int lost);
+void mrf24j40_get_config(struct mrf24j40_config *cfg);
+int mrf24j40_step(void);
+int mrf24j40_init_start(int ch);
+int mrf24j40_restart_start(const struct mrf24j40_config *cfg, int lost);
+int mrf24j40_rf_reset_start(void);
+int mrf24j40_set_channel_start(int ch);
+#ifndef MRF24J40_NO_SLEEP
+int mrf24j40_wakeup_start(int spi_wake);
 void mrf24j40_sleep(int spi_wake);
 void mrf24j40_wakeup(int spi_wake);
+#endif
 void mrf24j40_set_short_addr(int addr);
 void mrf24j40_set_pan(int pan);
 void mrf24j40_set_channel(int ch);
+void mrf24j40_set_channel_fast(int ch);
+void mrf24j40_set_csma(int on);
+void mrf24j40_timer_start(unsigned short hsym);
+void mrf24j40_set_turbo(int on);
+void mrf24j40_set_txpower(int level);
+int mrf24j40_get_txpower(void);
+void mrf24j40_set_cca(int mode, int cs_th, unsigned char ed_th);
+void mrf24j40_set_cca_edth(unsigned char ed_th);
+unsigned char mrf24j40_read_rssi(void);
+#ifndef MRF24J40_NO_PROMISC
 void mrf24j40_set_promiscuous(int crc_check);
+#endif
+void mrf24j40_set_rx_filter(int only);
 void mrf24j40_set_coordinator(void);
 void mrf24j40_clear_coordinator(void);
+void mrf24j40_set_frame_pending(int on);
 void mrf24j40_txpkt_trigger(void);
 void mrf24j40_txpkt_raw(unsigned char *frame, int hdr_len, int frame_len,
     int enc);
 void mrf24j40_txpkt(unsigned short dest, unsigned char *pkt, int len, int enc);
+int mrf24j40_txpkt_iov(const struct mrf24j40_iov *iov, int cnt, int hdr_cnt,
+    int enc);
 unsigned char mrf24j40_get_channel(void);
 int mrf24j40_int_tasks(void);
+#ifndef MRF24J40_NO_RX_POLL
+void mrf24j40_rx_poll_setup(int enter_thresh, int exit_idle);
+void mrf24j40_rx_poll_tick(void);
+int mrf24j40_rx_poll(int budget, unsigned char *d, int len, mrf24j40_rx_cb cb,
+    int *pflags);
+int mrf24j40_rx_polling(void);
+void mrf24j40_rx_poll_stats(struct mrf24j40_rx_poll_stats *st);
+#endif
+#ifdef MRF24J40_PROBES
+void mrf24j40_probe_stats(struct mrf24j40_probe *st, int clear);
+unsigned short mrf24j40_probe_pct(const struct mrf24j40_probe *p, int pct);
+#endif
 int mrf24j40_rxpkt_intcb(unsigned char *d, int len, unsigned char *plqi,
     unsigned char *prssi);
+#ifndef MRF24J40_NO_PART_RX
 int mrf24j40_rxpkt_part_intcb(unsigned char *d, int len, int flags,
     unsigned char *plqi, unsigned char *prssi);
+int mrf24j40_rx_open(struct mrf24j40_rx_cursor *c);
+int mrf24j40_rx_read(struct mrf24j40_rx_cursor *c, unsigned char *d, int len);
+int mrf24j40_rx_seek(struct mrf24j40_rx_cursor *c, int off);
+void mrf24j40_rx_close(struct mrf24j40_rx_cursor *c);
+#endif
+#ifndef MRF24J40_NO_FWD
+int mrf24j40_fwd(mrf24j40_route_fn route);
+#endif
 int mrf24j40_txpkt_intcb(void);
+int mrf24j40_txpkt_retries(void);
+int mrf24j40_txpkt_pending(void);
+#ifndef MRF24J40_NO_TIMESTAMP
+unsigned long mrf24j40_rx_stamp(void);
+unsigned long mrf24j40_tx_stamp(void);
+#endif
+#ifndef MRF24J40_NO_SEC
 int mrf24j40_sec_intcb(int accept);
 int mrf24j40_check_rx_dec(int no_err_flush);
+void mrf24j40_set_encdec(int types, int mode, unsigned char *key, int klen);
+#endif
+#ifndef MRF24J40_NO_UPENC
 int mrf24j40_check_enc(void);
 int mrf24j40_check_dec(void);
-void mrf24j40_set_encdec(int types, int mode, unsigned char *key, int klen);
 void mrf24j40_encdec(unsigned char *nonce, int nonce_len, unsigned char *frame,
     int hdr_len, int frame_len, int enc);
+#endif
 
 
 /*
@@ -402,3 +691,4 @@ Received packet source address:
 
 */
 
+#endif /* _MRF24J40_H_ */
@@ -0,0 +1,168 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include "aggr.h"
+
+void
+aggr_init(struct aggr *a)
+{
+	memset(a, 0, sizeof(*a));
+}
+
+/* Hand the open batch to the radio, or mark it to go out next */
+static void
+aggr_send(struct aggr *a)
+{
+	if (a->len == 0)
+		return;
+
+	if (a->tx_busy) {
+		a->pending = 1;
+		return;
+	}
+
+	/* The driver copies the payload into the TXNFIFO right away */
+	mrf24j40_txpkt(a->dest, a->buf, a->len, 0);
+	++a->stats.frames;
+
+	a->tx_busy = 1;
+	a->pending = 0;
+	a->len = 0;
+}
+
+/*
+ * Queue msg for dest; it will be on its way after at most max_delay
+ * ticks. Returns ENOMEM if msg is larger than AGGR_MSG_MAX, or EBUSY if
+ * it can not be queued until the batch waiting for the radio went out.
+ */
+int
+aggr_put(struct aggr *a, unsigned short dest, unsigned char *msg, int len,
+    unsigned short max_delay)
+{
+	unsigned short deadline = a->now + max_delay;
+
+	if (len > AGGR_MSG_MAX)
+		return ENOMEM;
+
+	if (a->len != 0 &&
+	    (dest != a->dest || a->len + 1 + len > MRF24J40_TXPKT_MAX)) {
+		if (a->pending) {
+			++a->stats.busy;
+			return EBUSY;
+		}
+
+		if (dest != a->dest)
+			++a->stats.flush_dest;
+		else
+			++a->stats.flush_full;
+		aggr_send(a);
+
+		/* Still open if the radio was busy */
+		if (a->len != 0) {
+			++a->stats.busy;
+			return EBUSY;
+		}
+	}
+
+	if (a->len == 0) {
+		a->buf[0] = AGGR_DISPATCH;
+		a->len = 1;
+		a->dest = dest;
+		a->deadline = deadline;
+	} else if ((short)(deadline - a->deadline) < 0) {
+		a->deadline = deadline;
+	}
+
+	a->buf[a->len++] = len;
+	memcpy(a->buf + a->len, msg, len);
+	a->len += len;
+	++a->stats.msgs;
+
+	if (max_delay == 0)
+		aggr_send(a);
+
+	return 0;
+}
+
+void
+aggr_flush(struct aggr *a)
+{
+	aggr_send(a);
+}
+
+/* Advance the clock; call it at a fixed interval */
+void
+aggr_tick(struct aggr *a)
+{
+	++a->now;
+
+	if (a->len != 0 && !a->pending &&
+	    (short)(a->now - a->deadline) >= 0) {
+		++a->stats.flush_deadline;
+		aggr_send(a);
+	}
+}
+
+/*
+ * To be called when the radio signals the end of a transmission started
+ * by the aggregator, with the result of mrf24j40_txpkt_intcb().
+ */
+void
+aggr_tx_done(struct aggr *a, int err)
+{
+	if (err)
+		++a->stats.tx_errors;
+
+	a->tx_busy = 0;
+	if (a->pending)
+		aggr_send(a);
+}
+
+/*
+ * Call cb for every message in the batch carried by the received frame
+ * fr (see ieee802154_parse). Returns the number of messages, or 0 if fr
+ * holds no well-formed batch, in which case cb is not called.
+ */
+int
+aggr_unpack(struct ieee802154_frame *fr, aggr_cb cb)
+{
+	unsigned char *p = fr->payload;
+	int off, n;
+
+	if (fr->payload_len < 1 || p[0] != AGGR_DISPATCH)
+		return 0;
+
+	/* Check the whole batch first */
+	n = 0;
+	for (off = 1; off < fr->payload_len; off += 1 + p[off])
+		n++;
+	if (off != fr->payload_len)
+		return 0;
+
+	for (off = 1; off < fr->payload_len; off += 1 + p[off])
+		cb(fr, p + off + 1, p[off]);
+
+	return n;
+}
@@ -0,0 +1,81 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef _AGGR_H_
+#define _AGGR_H_
+
+#include "MRF24J40.h"
+#include "ieee802154.h"
+
+/*
+ * Aggregation of small messages into one frame.
+ *
+ * Messages for the same destination are collected into a batch
+ *
+ *   AGGR_DISPATCH | len | msg | len | msg ...
+ *
+ * which is sent with mrf24j40_txpkt() once the next message would not
+ * fit, the destination changes, or the earliest message deadline runs
+ * out. Deadlines are in ticks, counted by calls to aggr_tick(). If the
+ * radio is still busy with the previous batch, the batch is sent from
+ * aggr_tx_done() and keeps collecting messages until then.
+ *
+ * The dispatch byte is in the 6LoWPAN "not a LoWPAN frame" range, so
+ * batches can share a link with frag.c and lowpan.c traffic.
+ */
+#define AGGR_DISPATCH		0x3A
+#define AGGR_MSG_MAX		(MRF24J40_TXPKT_MAX - 2)
+
+struct aggr_stats {
+	unsigned short	msgs;
+	unsigned short	frames;
+	unsigned short	flush_full;	/* next message did not fit */
+	unsigned short	flush_dest;	/* destination changed */
+	unsigned short	flush_deadline;
+	unsigned short	busy;		/* aggr_put returned EBUSY */
+	unsigned short	tx_errors;
+};
+
+struct aggr {
+	unsigned char	buf[MRF24J40_TXPKT_MAX];
+	unsigned char	len;		/* 0 if no batch is open */
+	unsigned char	tx_busy;	/* a batch is on the air */
+	unsigned char	pending;	/* batch waits for tx_busy to clear */
+	unsigned short	dest;
+	unsigned short	now;		/* ticks */
+	unsigned short	deadline;
+	struct aggr_stats stats;
+};
+
+typedef void (*aggr_cb)(struct ieee802154_frame *fr, unsigned char *msg,
+    int len);
+
+void aggr_init(struct aggr *a);
+int aggr_put(struct aggr *a, unsigned short dest, unsigned char *msg,
+    int len, unsigned short max_delay);
+void aggr_flush(struct aggr *a);
+void aggr_tick(struct aggr *a);
+void aggr_tx_done(struct aggr *a, int err);
+int aggr_unpack(struct ieee802154_frame *fr, aggr_cb cb);
+
+#endif /* _AGGR_H_ */
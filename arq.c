@@ -0,0 +1,392 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include "arq.h"
+
+/* Slot states */
+#define ARQ_FREE	0
+#define ARQ_QUEUED	1	/* to be sent, or sent again */
+#define ARQ_SENT	2
+#define ARQ_ACKED	3	/* selectively acknowledged */
+
+#define SLOT(t, seq)	(&(t)->slot[(seq) & (ARQ_WIN_MAX - 1)])
+#define SEQ_LT(a, b)	((short)((a) - (b)) < 0)
+
+/*
+ * Sender
+ */
+void
+arq_tx_init(struct arq_tx *t, unsigned short dest, unsigned char stream,
+    int win)
+{
+	memset(t, 0, sizeof(*t));
+
+	if (win < 1)
+		win = 1;
+	if (win > ARQ_WIN_MAX)
+		win = ARQ_WIN_MAX;
+
+	t->dest = dest;
+	t->stream = stream;
+	t->win = win;
+	t->rto = ARQ_RTO_INIT;
+}
+
+/*
+ * Queue len bytes of data as the next frame of the stream. data has to
+ * stay around until it was acknowledged, see arq_tx_pending(). Returns
+ * EBUSY if the window is full and ENOMEM if len exceeds ARQ_DATA_MAX.
+ */
+int
+arq_tx_put(struct arq_tx *t, unsigned char *data, int len)
+{
+	struct arq_slot *s;
+
+	if (len > ARQ_DATA_MAX)
+		return ENOMEM;
+	if ((unsigned short)(t->next - t->base) >= t->win)
+		return EBUSY;
+
+	s = SLOT(t, t->next);
+	s->data = data;
+	s->len = len;
+	s->state = ARQ_QUEUED;
+	s->tries = 0;
+	t->next++;
+
+	return 0;
+}
+
+/* Frames not acknowledged yet */
+int
+arq_tx_pending(struct arq_tx *t)
+{
+	return (unsigned short)(t->next - t->base);
+}
+
+static void
+arq_tx_send(struct arq_tx *t, unsigned short seq)
+{
+	unsigned char buf[MRF24J40_TXPKT_MAX];
+	struct arq_slot *s = SLOT(t, seq);
+
+	buf[0] = ARQ_DISPATCH_DATA;
+	buf[1] = t->stream;
+	buf[2] = seq & 0xFF;
+	buf[3] = seq >> 8;
+	memcpy(buf + ARQ_DATA_HDR_LEN, s->data, s->len);
+
+	mrf24j40_txpkt(t->dest, buf, ARQ_DATA_HDR_LEN + s->len, 0);
+
+	s->state = ARQ_SENT;
+	s->tries++;
+	s->sent_at = t->now;
+	s->order = t->order++;
+
+	t->last = seq;
+	t->tx_busy = 1;
+	++t->stats.frames;
+}
+
+/*
+ * Give the oldest frame that needs to be sent to the radio, if it is
+ * idle. Returns 1 if a frame was sent.
+ */
+int
+arq_tx_poll(struct arq_tx *t)
+{
+	unsigned short seq;
+
+	if (t->tx_busy)
+		return 0;
+
+	for (seq = t->base; seq != t->next; seq++) {
+		if (SLOT(t, seq)->state == ARQ_QUEUED) {
+			arq_tx_send(t, seq);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* The radio finished a transmission; err from mrf24j40_txpkt_intcb() */
+void
+arq_tx_done(struct arq_tx *t, int err)
+{
+	struct arq_slot *s;
+
+	if (!t->tx_busy)
+		return;
+
+	t->tx_busy = 0;
+
+	s = SLOT(t, t->last);
+	if (err && s->state == ARQ_SENT) {
+		s->state = ARQ_QUEUED;
+		++t->stats.tx_errors;
+	}
+}
+
+static void
+arq_rtt_sample(struct arq_tx *t, unsigned short m)
+{
+	short err;
+
+	if (t->stats.rtt_samples++ == 0) {
+		t->srtt = m << 3;
+		t->rttvar = m << 1;
+	} else {
+		err = m - (t->srtt >> 3);
+		t->srtt += err;
+		if (err < 0)
+			err = -err;
+		t->rttvar += err - (t->rttvar >> 2);
+	}
+
+	t->rto = (t->srtt >> 3) + (t->rttvar ? t->rttvar : 1);
+	if (t->rto < ARQ_RTO_MIN)
+		t->rto = ARQ_RTO_MIN;
+	if (t->rto > ARQ_RTO_MAX)
+		t->rto = ARQ_RTO_MAX;
+}
+
+/*
+ * Process a received frame; returns 1 if it was an ACK for this stream.
+ */
+int
+arq_tx_input(struct arq_tx *t, struct ieee802154_frame *fr)
+{
+	struct arq_slot *s, *sample = (void *)0;
+	unsigned char *p = fr->payload;
+	unsigned short base, seq, hi_order = 0;
+	unsigned long nack;
+	unsigned char i, n;
+
+	if (fr->payload_len < ARQ_ACK_LEN || p[0] != ARQ_DISPATCH_ACK ||
+	    p[1] != t->stream)
+		return 0;
+
+	++t->stats.acks;
+
+	base = p[2] | (p[3] << 8);
+	n = p[4];
+	nack = p[5] | ((unsigned long)p[6] << 8) |
+	    ((unsigned long)p[7] << 16) | ((unsigned long)p[8] << 24);
+
+	/* Stale or bogus */
+	if (SEQ_LT(base, t->base) || SEQ_LT(t->next, base))
+		return 1;
+
+	/* Cumulative part; Karn's rule, no samples from retransmissions */
+	for (; t->base != base; t->base++) {
+		s = SLOT(t, t->base);
+		if (s->state == ARQ_SENT && s->tries == 1)
+			sample = s;
+		s->state = ARQ_FREE;
+	}
+
+	if (n > ARQ_WIN_MAX)
+		n = ARQ_WIN_MAX;
+	if (n > 0 && SEQ_LT(base + n - 1, t->next))
+		hi_order = SLOT(t, base + n - 1)->order;
+	else
+		n = 0;
+
+	/*
+	 * Selective part. A missing frame is only sent again if it went
+	 * out before the highest one that arrived; anything later may
+	 * still be on its way.
+	 */
+	for (i = 0; i < n; i++) {
+		seq = base + i;
+		s = SLOT(t, seq);
+
+		if (nack & (1UL << i)) {
+			if (s->state == ARQ_SENT &&
+			    SEQ_LT(s->order, hi_order)) {
+				s->state = ARQ_QUEUED;
+				++t->stats.retx_nack;
+			}
+		} else if (s->state != ARQ_FREE) {
+			if (s->state == ARQ_SENT && s->tries == 1)
+				sample = s;
+			s->state = ARQ_ACKED;
+		}
+	}
+
+	while (t->base != t->next && SLOT(t, t->base)->state == ARQ_ACKED) {
+		SLOT(t, t->base)->state = ARQ_FREE;
+		t->base++;
+	}
+
+	if (sample != (void *)0)
+		arq_rtt_sample(t, t->now - sample->sent_at);
+
+	return 1;
+}
+
+/* Advance the clock and handle retransmission timeouts */
+void
+arq_tx_tick(struct arq_tx *t)
+{
+	struct arq_slot *s;
+	unsigned short seq;
+	unsigned char fired = 0;
+
+	++t->now;
+
+	for (seq = t->base; seq != t->next; seq++) {
+		s = SLOT(t, seq);
+		if (s->state == ARQ_SENT &&
+		    (unsigned short)(t->now - s->sent_at) >= t->rto) {
+			s->state = ARQ_QUEUED;
+			++t->stats.retx_timeout;
+			fired = 1;
+		}
+	}
+
+	/* Back off */
+	if (fired) {
+		t->rto = (t->rto < ARQ_RTO_MAX / 2) ? 2 * t->rto : ARQ_RTO_MAX;
+	}
+}
+
+/*
+ * Receiver
+ */
+void
+arq_rx_init(struct arq_rx *r, unsigned char stream, int win, int ack_every)
+{
+	memset(r, 0, sizeof(*r));
+
+	if (win < 1)
+		win = 1;
+	if (win > ARQ_WIN_MAX)
+		win = ARQ_WIN_MAX;
+	if (ack_every < 1)
+		ack_every = 1;
+
+	r->stream = stream;
+	r->win = win;
+	r->ack_every = ack_every;
+}
+
+/*
+ * Process a received frame; data frames of the stream that were not
+ * seen before are handed to cb. Returns 1 if it was a data frame for
+ * this stream.
+ */
+int
+arq_rx_input(struct arq_rx *r, struct ieee802154_frame *fr, arq_rx_cb cb)
+{
+	unsigned char *p = fr->payload;
+	unsigned short seq, d;
+
+	if (fr->payload_len < ARQ_DATA_HDR_LEN || p[0] != ARQ_DISPATCH_DATA ||
+	    p[1] != r->stream)
+		return 0;
+
+	r->peer = fr->src.short_addr;
+	seq = p[2] | (p[3] << 8);
+	d = seq - r->base;
+
+	/* Seen before; the ACK was probably lost */
+	if (d >= 0x8000 || (d < ARQ_WIN_MAX && (r->map & (1UL << d)))) {
+		++r->stats.dups;
+		r->ack_due = 1;
+		return 1;
+	}
+
+	if (d >= r->win) {
+		++r->stats.out_of_window;
+		r->ack_due = 1;
+		return 1;
+	}
+
+	cb(seq, p + ARQ_DATA_HDR_LEN, fr->payload_len - ARQ_DATA_HDR_LEN);
+	++r->stats.frames;
+
+	r->map |= 1UL << d;
+	if (d != 0)
+		++r->stats.out_of_order;
+
+	while (r->map & 1) {
+		r->map >>= 1;
+		r->base++;
+	}
+
+	/* Report holes right away */
+	if (r->map != 0 || ++r->since_ack >= r->ack_every)
+		r->ack_due = 1;
+
+	return 1;
+}
+
+/* Send an ACK if one is due and the radio is idle; returns 1 if sent */
+int
+arq_rx_poll(struct arq_rx *r)
+{
+	unsigned char buf[ARQ_ACK_LEN];
+	unsigned long nack;
+	unsigned char n;
+
+	if (!r->ack_due)
+		return 0;
+
+	/* Cover up to the highest frame received */
+	for (n = ARQ_WIN_MAX; n > 0 && !(r->map & (1UL << (n - 1))); n--)
+		;
+
+	nack = ~r->map;
+	if (n < 32)
+		nack &= (1UL << n) - 1;
+
+	buf[0] = ARQ_DISPATCH_ACK;
+	buf[1] = r->stream;
+	buf[2] = r->base & 0xFF;
+	buf[3] = r->base >> 8;
+	buf[4] = n;
+	buf[5] = nack & 0xFF;
+	buf[6] = (nack >> 8) & 0xFF;
+	buf[7] = (nack >> 16) & 0xFF;
+	buf[8] = (nack >> 24) & 0xFF;
+
+	mrf24j40_txpkt(r->peer, buf, ARQ_ACK_LEN, 0);
+
+	r->ack_due = 0;
+	r->since_ack = 0;
+	++r->stats.acks;
+
+	return 1;
+}
+
+/* Flush delayed ACKs; call it at a fixed interval */
+void
+arq_rx_tick(struct arq_rx *r)
+{
+	if (r->since_ack != 0)
+		r->ack_due = 1;
+}
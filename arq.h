@@ -0,0 +1,149 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef _ARQ_H_
+#define _ARQ_H_
+
+#include "MRF24J40.h"
+#include "ieee802154.h"
+
+/*
+ * Selective-repeat ARQ for bulk transfers between two nodes.
+ *
+ * The sender keeps up to win (<= ARQ_WIN_MAX) frames of a stream in
+ * flight. The receiver answers with
+ *
+ *   ARQ_DISPATCH_ACK | stream | base:16 | n | nack:32
+ *
+ * where base is the next sequence number it needs in order, and bit i
+ * of the NACK bitmap, for i < n, is set if base + i is still missing;
+ * the n - 1 frames covered beyond base are the highest one received and
+ * those below it. Missing frames that were sent before a frame that did
+ * arrive are retransmitted right away; everything else is retransmitted
+ * once the retransmission timeout runs out. The timeout follows the
+ * measured round trip time as in TCP (RFC 6298, Karn's rule), in ticks
+ * counted by arq_tx_tick().
+ *
+ * Data frames are
+ *
+ *   ARQ_DISPATCH_DATA | stream | seq:16 | data
+ *
+ * The receiver hands frames to the application once each, as they
+ * arrive; in-order delivery is up to the application, e.g. by writing a
+ * firmware image at seq times the chunk size. This needs no reorder
+ * buffer on the receiver.
+ *
+ * Only one frame is given to the radio at a time. The application calls
+ * arq_tx_poll()/arq_rx_poll() when the radio is idle and reports the end
+ * of each transmission with arq_tx_done().
+ */
+#define ARQ_DISPATCH_DATA	0x3B
+#define ARQ_DISPATCH_ACK	0x3C
+#define ARQ_DATA_HDR_LEN	4
+#define ARQ_ACK_LEN		9
+#define ARQ_DATA_MAX		(MRF24J40_TXPKT_MAX - ARQ_DATA_HDR_LEN)
+
+#define ARQ_WIN_MAX		32
+
+/* Retransmission timeout limits and initial value, in ticks */
+#define ARQ_RTO_INIT		100
+#define ARQ_RTO_MIN		2
+#define ARQ_RTO_MAX		2000
+
+struct arq_slot {
+	unsigned char	*data;
+	unsigned char	len;
+	unsigned char	state;
+	unsigned char	tries;
+	unsigned short	sent_at;	/* tick */
+	unsigned short	order;		/* transmission counter when sent */
+};
+
+struct arq_tx_stats {
+	unsigned short	frames;		/* transmissions */
+	unsigned short	retx_nack;
+	unsigned short	retx_timeout;
+	unsigned short	tx_errors;	/* no MAC level ACK */
+	unsigned short	acks;
+	unsigned short	rtt_samples;
+};
+
+struct arq_tx {
+	unsigned short	dest;
+	unsigned char	stream;
+	unsigned char	win;
+	unsigned char	tx_busy;
+	unsigned short	base;		/* oldest unacknowledged */
+	unsigned short	next;		/* sequence number of the next put */
+	unsigned short	last;		/* last sequence number sent */
+	unsigned short	order;
+	unsigned short	now;
+
+	/* Round trip estimate, scaled by 8 and 4 */
+	unsigned short	srtt;
+	unsigned short	rttvar;
+	unsigned short	rto;
+
+	struct arq_slot	slot[ARQ_WIN_MAX];
+	struct arq_tx_stats stats;
+};
+
+struct arq_rx_stats {
+	unsigned short	frames;		/* delivered */
+	unsigned short	dups;
+	unsigned short	out_of_order;
+	unsigned short	out_of_window;
+	unsigned short	acks;
+};
+
+struct arq_rx {
+	unsigned short	peer;
+	unsigned char	stream;
+	unsigned char	win;
+	unsigned char	ack_every;	/* in-order frames per ACK */
+	unsigned char	since_ack;
+	unsigned char	ack_due;
+	unsigned short	base;		/* next sequence number in order */
+	unsigned long	map;		/* bit i: base + i received */
+	struct arq_rx_stats stats;
+};
+
+typedef void (*arq_rx_cb)(unsigned short seq, unsigned char *data, int len);
+
+void arq_tx_init(struct arq_tx *t, unsigned short dest, unsigned char stream,
+    int win);
+int arq_tx_put(struct arq_tx *t, unsigned char *data, int len);
+int arq_tx_pending(struct arq_tx *t);
+int arq_tx_poll(struct arq_tx *t);
+void arq_tx_done(struct arq_tx *t, int err);
+int arq_tx_input(struct arq_tx *t, struct ieee802154_frame *fr);
+void arq_tx_tick(struct arq_tx *t);
+
+void arq_rx_init(struct arq_rx *r, unsigned char stream, int win,
+    int ack_every);
+int arq_rx_input(struct arq_rx *r, struct ieee802154_frame *fr,
+    arq_rx_cb cb);
+int arq_rx_poll(struct arq_rx *r);
+void arq_rx_tick(struct arq_rx *r);
+
+#endif /* _ARQ_H_ */
@@ -0,0 +1,120 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include "cca.h"
+
+/*
+ * Starts from the threshold currently set; the first window sets the
+ * noise floor.
+ */
+void
+cca_init(struct cca *c, unsigned char min_edth, unsigned char max_edth)
+{
+	struct mrf24j40_config cfg;
+
+	memset(c, 0, sizeof(*c));
+	c->min_edth = min_edth;
+	c->max_edth = max_edth;
+
+	mrf24j40_get_config(&cfg);
+	c->edth = cfg.ccaedth;
+}
+
+static void
+cca_window(struct cca *c)
+{
+	struct cca_hist *h;
+	int busy_pct = 0, th;
+
+	if (c->stats.windows++ == 0)
+		c->floor = c->win_min;
+	else
+		c->floor += ((int)c->win_min - (int)c->floor) / 4;
+
+	if (c->win_tx != 0)
+		busy_pct = c->win_busy * 100 / c->win_tx;
+
+	if (busy_pct > CCA_BUSY_HI && c->offset < CCA_OFFSET_MAX)
+		c->offset += CCA_STEP;
+	else if (busy_pct < CCA_BUSY_LO && c->offset > CCA_OFFSET_MIN)
+		c->offset -= CCA_STEP;
+
+	th = c->floor + CCA_MARGIN + c->offset;
+	if (th < c->min_edth)
+		th = c->min_edth;
+	if (th > c->max_edth)
+		th = c->max_edth;
+
+	if (th > c->edth)
+		++c->stats.raised;
+	else if (th < c->edth)
+		++c->stats.lowered;
+	c->edth = th;
+	mrf24j40_set_cca_edth(th);
+
+	h = &c->hist[c->hist_pos];
+	h->floor = c->floor;
+	h->max = c->win_max;
+	h->edth = th;
+	h->busy_pct = busy_pct;
+	c->hist_pos = (c->hist_pos + 1) % CCA_HIST;
+
+	c->nsamples = 0;
+	c->win_tx = c->win_busy = 0;
+}
+
+/* Take an RSSI sample; call while the radio is idle */
+void
+cca_sample(struct cca *c)
+{
+	unsigned char v = mrf24j40_read_rssi();
+
+	if (c->nsamples == 0 || v < c->win_min)
+		c->win_min = v;
+	if (c->nsamples == 0 || v > c->win_max)
+		c->win_max = v;
+
+	++c->stats.samples;
+	if (++c->nsamples == CCA_WINDOW)
+		cca_window(c);
+}
+
+/* With the result of mrf24j40_txpkt_intcb() */
+void
+cca_tx_done(struct cca *c, int err)
+{
+	++c->stats.tx;
+	if (err == EBUSY)
+		++c->stats.ccafail;
+
+	/* Saturate, the ratio is what counts */
+	if (c->win_tx == 255) {
+		c->win_tx /= 2;
+		c->win_busy /= 2;
+	}
+	++c->win_tx;
+	if (err == EBUSY)
+		++c->win_busy;
+}
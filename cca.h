@@ -0,0 +1,96 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef _CCA_H_
+#define _CCA_H_
+
+#include "MRF24J40.h"
+
+/*
+ * Adaptive energy detection threshold for CCA.
+ *
+ * The application calls cca_sample() while the radio is idle (nothing
+ * being received or sent); it reads the RSSI register. Every
+ * CCA_WINDOW samples the lowest one of the window updates the noise
+ * floor estimate (an EWMA, weight 1/4), and CCAEDTH is set to
+ *
+ *   floor + CCA_MARGIN + offset
+ *
+ * within the limits given to cca_init(). The offset follows the share
+ * of transmissions that failed CCA, reported through cca_tx_done(): it
+ * is raised by CCA_STEP when more than CCA_BUSY_HI percent failed
+ * during the window and lowered when less than CCA_BUSY_LO did.
+ *
+ * The last CCA_HIST windows are kept in hist[], hist[hist_pos - 1]
+ * being the most recent one. All values are on the RSSI scale. The
+ * threshold only matters in CCA modes 2 and 3 (mrf24j40_set_cca).
+ */
+#define CCA_WINDOW	16
+#define CCA_HIST	8
+#define CCA_MARGIN	30	/* about 10 dB */
+#define CCA_STEP	4
+#define CCA_OFFSET_MIN	(-CCA_MARGIN / 2)
+#define CCA_OFFSET_MAX	90
+#define CCA_BUSY_HI	25
+#define CCA_BUSY_LO	5
+
+struct cca_hist {
+	unsigned char	floor;
+	unsigned char	max;		/* highest sample of the window */
+	unsigned char	edth;
+	unsigned char	busy_pct;
+};
+
+struct cca_stats {
+	unsigned short	samples;
+	unsigned short	windows;
+	unsigned short	tx;
+	unsigned short	ccafail;
+	unsigned short	raised;
+	unsigned short	lowered;
+};
+
+struct cca {
+	unsigned char	min_edth;
+	unsigned char	max_edth;
+	unsigned char	edth;
+	unsigned char	floor;
+	signed char	offset;
+
+	/* Current window */
+	unsigned char	nsamples;
+	unsigned char	win_min;
+	unsigned char	win_max;
+	unsigned char	win_tx;
+	unsigned char	win_busy;
+
+	unsigned char	hist_pos;
+	struct cca_hist	hist[CCA_HIST];
+	struct cca_stats stats;
+};
+
+void cca_init(struct cca *c, unsigned char min_edth, unsigned char max_edth);
+void cca_sample(struct cca *c);
+void cca_tx_done(struct cca *c, int err);
+
+#endif /* _CCA_H_ */
@@ -0,0 +1,307 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include "MRF24J40.h"
+#include "frag.h"
+
+/*
+ * Datagram bytes per fragment. All but the last end on the 8 byte grid
+ * of the uncompressed datagram; e bytes of FRAG1 were elided.
+ */
+#define FRAG1_ROOM(e)	(((MRF24J40_TXPKT_MAX - FRAG1_HDR_LEN + (e)) & ~7) - (e))
+#define FRAGN_ROOM	((MRF24J40_TXPKT_MAX - FRAGN_HDR_LEN) & ~7)
+
+static unsigned short frag_tag;
+
+/*
+ * Prepare sending the datagram d of len bytes to dest; it has to stay
+ * around until the last fragment went out. size is the length before
+ * header compression (lowpan_compress), or 0 if d is not compressed.
+ * Returns ENOMEM if it is too large for the size field.
+ */
+int
+frag_tx_start(struct frag_tx *t, unsigned short dest, unsigned char *d,
+    int len, int size)
+{
+	if (size < len)
+		size = len;
+	if (size > FRAG_SIZE_MAX)
+		return ENOMEM;
+
+	t->data = d;
+	t->len = len;
+	t->size = size;
+	t->off = 0;
+	t->n = 0;
+	t->dest = dest;
+	t->tag = frag_tag++;
+
+	return 0;
+}
+
+/*
+ * Build the current fragment into buf (MRF24J40_TXPKT_MAX bytes) and
+ * return its length, or 0 once the whole datagram has been sent. The
+ * same fragment is built again until frag_tx_done() is called, so a
+ * failed transmission can simply be repeated.
+ */
+int
+frag_tx_build(struct frag_tx *t, unsigned char *buf)
+{
+	int hlen, room, elided = t->size - t->len;
+
+	if (t->off >= t->len)
+		return 0;
+
+	/* Fits into one frame */
+	if (t->len <= MRF24J40_TXPKT_MAX) {
+		memcpy(buf, t->data, t->len);
+		t->n = t->len;
+		return t->len;
+	}
+
+	if (t->off == 0) {
+		buf[0] = FRAG1_DISPATCH;
+		hlen = FRAG1_HDR_LEN;
+		room = FRAG1_ROOM(elided);
+	} else {
+		buf[0] = FRAGN_DISPATCH;
+		buf[4] = (t->off + elided) >> 3;
+		hlen = FRAGN_HDR_LEN;
+		room = FRAGN_ROOM;
+	}
+
+	buf[0] |= (t->size >> 8) & 0x07;
+	buf[1] = t->size & 0xFF;
+	buf[2] = t->tag >> 8;
+	buf[3] = t->tag & 0xFF;
+
+	t->n = (t->len - t->off < room) ? t->len - t->off : room;
+	memcpy(buf + hlen, t->data + t->off, t->n);
+
+	return hlen + t->n;
+}
+
+/*
+ * Send the current fragment with mrf24j40_txpkt(); returns 0 if there
+ * is nothing left to send. Call frag_tx_done() once it was sent
+ * successfully (see mrf24j40_txpkt_intcb), then frag_tx_send() again.
+ */
+int
+frag_tx_send(struct frag_tx *t)
+{
+	unsigned char buf[MRF24J40_TXPKT_MAX];
+	int n;
+
+	if ((n = frag_tx_build(t, buf)) > 0)
+		mrf24j40_txpkt(t->dest, buf, n, 0);
+
+	return n;
+}
+
+void
+frag_tx_done(struct frag_tx *t)
+{
+	t->off += t->n;
+	t->n = 0;
+}
+
+/*
+ * hc expands the compressed header in FRAG1, see frag_hc_fn; without
+ * one, fragments are taken as they come.
+ */
+void
+frag_rx_init(struct frag_rx *r, unsigned short timeout, frag_hc_fn hc)
+{
+	unsigned char i;
+
+	for (i = 0; i < FRAG_SLOTS; i++)
+		r->slot[i].size = 0;
+
+	r->timeout = timeout;
+	r->hc = hc;
+	memset(&r->stats, 0, sizeof(r->stats));
+}
+
+/* Sender key; extended addresses are folded into 16 bits */
+static unsigned short
+frag_src(struct ieee802154_addr *a)
+{
+	unsigned short k;
+	unsigned char i;
+
+	if (a->mode != FCADDR_EXT)
+		return a->short_addr;
+
+	k = 0;
+	for (i = 0; i < 8; i += 2)
+		k ^= a->ext[i] | (a->ext[i + 1] << 8);
+
+	return k;
+}
+
+static struct frag_slot *
+frag_slot_get(struct frag_rx *r, unsigned short src, unsigned short tag,
+    unsigned short size)
+{
+	struct frag_slot *s, *free_slot = (void *)0;
+	unsigned char i;
+
+	for (i = 0; i < FRAG_SLOTS; i++) {
+		s = &r->slot[i];
+		if (s->size == 0) {
+			if (free_slot == (void *)0)
+				free_slot = s;
+		} else if (s->src == src && s->tag == tag && s->size == size) {
+			return s;
+		}
+	}
+
+	if ((s = free_slot) != (void *)0) {
+		s->src = src;
+		s->tag = tag;
+		s->size = size;
+		s->got = 0;
+		memset(s->map, 0, sizeof(s->map));
+	}
+
+	return s;
+}
+
+/*
+ * Feed the payload of a received data frame (see ieee802154_parse) to
+ * the reassembly. Returns the length of a completed datagram and points
+ * *pd at it, or 0 if none completed. A frame without fragment header is
+ * returned as is. A reassembled datagram stays valid until the next
+ * call.
+ */
+int
+frag_rx_input(struct frag_rx *r, struct ieee802154_frame *fr,
+    unsigned char **pd)
+{
+	struct frag_slot *s;
+	unsigned char *p = fr->payload;
+	unsigned short size, tag, off, u, end, added;
+	int hlen, n = fr->payload_len;
+
+	if (n <= 0)
+		return 0;
+
+	if ((p[0] & FRAG_DISPATCH_MASK) == FRAG1_DISPATCH) {
+		hlen = FRAG1_HDR_LEN;
+	} else if ((p[0] & FRAG_DISPATCH_MASK) == FRAGN_DISPATCH) {
+		hlen = FRAGN_HDR_LEN;
+	} else {
+		*pd = p;
+		return n;
+	}
+
+	++r->stats.fragments;
+
+	n -= hlen;
+	if (n <= 0) {
+		++r->stats.bad;
+		return 0;
+	}
+
+	size = ((p[0] & 0x07) << 8) | p[1];
+	tag = (p[2] << 8) | p[3];
+	off = (hlen == FRAGN_HDR_LEN) ? p[4] << 3 : 0;
+	p += hlen;
+
+	if (size > FRAG_DGRAM_MAX) {
+		++r->stats.bad;
+		return 0;
+	}
+
+	if ((s = frag_slot_get(r, frag_src(&fr->src), tag, size)) == (void *)0) {
+		++r->stats.no_slot;
+		return 0;
+	}
+
+	/* Expanded right into place; it covers the start of the datagram */
+	if (hlen == FRAG1_HDR_LEN && r->hc != (void *)0) {
+		memcpy(s->buf, p, n);
+		n = r->hc(s->buf, n, size, size, &fr->src, &fr->dst);
+		p = (void *)0;
+	}
+	end = off + n;
+
+	/* Only the last fragment may end off the 8 byte grid */
+	if (n <= 0 || end > size || (end < size && (n & 7) != 0)) {
+		if (s->got == 0)
+			s->size = 0;
+		++r->stats.bad;
+		return 0;
+	}
+
+	s->age = 0;
+
+	/*
+	 * Count the 8 byte units this fragment adds; ones seen before do
+	 * not count again, so overlapping fragments cannot complete the
+	 * datagram early.
+	 */
+	for (u = off >> 3, added = 0; u < ((end + 7) >> 3); u++) {
+		if (!(s->map[u >> 3] & (1 << (u & 7)))) {
+			s->map[u >> 3] |= 1 << (u & 7);
+			added++;
+		}
+	}
+
+	if (added == 0) {
+		++r->stats.dups;
+		return 0;
+	}
+
+	if (p != (void *)0)
+		memcpy(s->buf + off, p, n);
+
+	s->got += added;
+	if (s->got < ((size + 7) >> 3))
+		return 0;
+
+	s->size = 0;
+	++r->stats.datagrams;
+	*pd = s->buf;
+
+	return size;
+}
+
+/* Age the incomplete datagrams; call it at a fixed interval */
+void
+frag_rx_tick(struct frag_rx *r)
+{
+	struct frag_slot *s;
+	unsigned char i;
+
+	for (i = 0; i < FRAG_SLOTS; i++) {
+		s = &r->slot[i];
+		if (s->size != 0 && ++s->age >= r->timeout) {
+			s->size = 0;
+			++r->stats.timeouts;
+		}
+	}
+}
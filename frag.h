@@ -0,0 +1,122 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef _FRAG_H_
+#define _FRAG_H_
+
+#include "ieee802154.h"
+
+/*
+ * Fragmentation and reassembly of datagrams larger than one frame, with
+ * the 6LoWPAN fragment headers (RFC 4944):
+ *
+ *   FRAG1  11000 | size:11 | tag:16               4 bytes
+ *   FRAGN  11100 | size:11 | tag:16 | offset:8    5 bytes
+ *
+ * The offset is in units of 8 bytes. A datagram that fits into a single
+ * frame is sent without a fragment header, so its first byte must not
+ * look like one (0xC0-0xC7, 0xE0-0xE7); IPv6 and 6LoWPAN payloads never
+ * do.
+ *
+ * For a datagram whose header was compressed (lowpan.c), size and
+ * offsets count the uncompressed datagram, as RFC 6282 requires: the
+ * compressed header goes into FRAG1 only, and FRAG1 ends where the
+ * uncompressed datagram reaches the 8 byte grid. The receiver expands
+ * FRAG1 with the frag_hc_fn given to frag_rx_init().
+ *
+ * The receiver reassembles into a fixed pool of FRAG_SLOTS buffers, so
+ * fragments of several datagrams from several senders may come in
+ * interleaved and out of order. A datagram that sees no fragment for
+ * timeout calls of frag_rx_tick() is dropped.
+ */
+#ifndef FRAG_SLOTS
+#define FRAG_SLOTS		2
+#endif
+#ifndef FRAG_DGRAM_MAX
+#define FRAG_DGRAM_MAX		1280	/* IPv6 minimum MTU */
+#endif
+
+#define FRAG_SIZE_MAX		2047	/* 11 bit size field */
+
+#define FRAG1_DISPATCH		0xC0
+#define FRAGN_DISPATCH		0xE0
+#define FRAG_DISPATCH_MASK	0xF8
+#define FRAG1_HDR_LEN		4
+#define FRAGN_HDR_LEN		5
+
+struct frag_tx {
+	unsigned char	*data;
+	unsigned short	len;
+	unsigned short	size;		/* announced; len plus bytes elided */
+	unsigned short	off;		/* of the current fragment */
+	unsigned short	tag;
+	unsigned short	dest;
+	unsigned char	n;		/* datagram bytes in it */
+};
+
+struct frag_slot {
+	unsigned short	src;
+	unsigned short	tag;
+	unsigned short	size;		/* 0 if the slot is free */
+	unsigned short	got;		/* 8 byte units received so far */
+	unsigned short	age;		/* ticks since the last fragment */
+	unsigned char	map[(FRAG_DGRAM_MAX / 8 + 7) / 8];
+	unsigned char	buf[FRAG_DGRAM_MAX];
+};
+
+struct frag_stats {
+	unsigned short	datagrams;	/* reassembled */
+	unsigned short	fragments;
+	unsigned short	dups;
+	unsigned short	timeouts;
+	unsigned short	no_slot;	/* pool exhausted */
+	unsigned short	bad;		/* malformed or too large */
+};
+
+/*
+ * Expands the payload of a FRAG1, len bytes at p in a buffer of size
+ * bytes, in place for a datagram of dgram_size bytes; returns the new
+ * length or 0 if it is malformed. lowpan_decompress() is one.
+ */
+typedef int (*frag_hc_fn)(unsigned char *p, int len, int size,
+    int dgram_size, struct ieee802154_addr *src, struct ieee802154_addr *dst);
+
+struct frag_rx {
+	struct frag_slot slot[FRAG_SLOTS];
+	frag_hc_fn	hc;
+	unsigned short	timeout;
+	struct frag_stats stats;
+};
+
+int frag_tx_start(struct frag_tx *t, unsigned short dest, unsigned char *d,
+    int len, int size);
+int frag_tx_build(struct frag_tx *t, unsigned char *buf);
+int frag_tx_send(struct frag_tx *t);
+void frag_tx_done(struct frag_tx *t);
+
+void frag_rx_init(struct frag_rx *r, unsigned short timeout, frag_hc_fn hc);
+int frag_rx_input(struct frag_rx *r, struct ieee802154_frame *fr,
+    unsigned char **pd);
+void frag_rx_tick(struct frag_rx *r);
+
+#endif /* _FRAG_H_ */
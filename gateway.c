@@ -0,0 +1,304 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+#include "gateway.h"
+
+#if !defined(MRF24J40_MULTI)
+#error "the gateway engine requires a driver built with MRF24J40_MULTI"
+#endif
+
+#define RELAXED	memory_order_relaxed
+#define ACQUIRE	memory_order_acquire
+#define RELEASE	memory_order_release
+
+void
+gw_init(struct gw *gw)
+{
+	unsigned long i;
+
+	memset(gw, 0, sizeof(*gw));
+
+	for (i = 0; i < GW_RXQ_SIZE; i++)
+		atomic_init(&gw->rxq[i].seq, i);
+	atomic_init(&gw->rxq_tail, 0);
+	atomic_init(&gw->stop, 0);
+}
+
+int
+gw_add_radio(struct gw *gw, const struct gw_radio_cfg *cfg)
+{
+	struct gw_radio *r;
+
+	if (gw->nradios == GW_MAX_RADIOS)
+		return -1;
+
+	r = &gw->radios[gw->nradios];
+	r->gw = gw;
+	r->id = gw->nradios;
+	r->cfg = *cfg;
+	atomic_init(&r->txq_head, 0);
+	atomic_init(&r->txq_tail, 0);
+
+	return gw->nradios++;
+}
+
+/*
+ * Multi-producer enqueue on the RX queue (bounded ring with per-slot
+ * sequence numbers). A slot is free for position pos when its sequence
+ * equals pos and holds a frame for the consumer when it equals pos + 1.
+ */
+static int
+gw_rxq_put(struct gw *gw, const struct gw_frame *f)
+{
+	struct gw_slot *slot;
+	unsigned long pos, seq;
+	long diff;
+
+	pos = atomic_load_explicit(&gw->rxq_tail, RELAXED);
+	for (;;) {
+		slot = &gw->rxq[pos & (GW_RXQ_SIZE - 1)];
+		seq = atomic_load_explicit(&slot->seq, ACQUIRE);
+		diff = (long)seq - (long)pos;
+
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(
+			    &gw->rxq_tail, &pos, pos + 1, RELAXED, RELAXED))
+				break;
+		} else if (diff < 0) {
+			/* Queue full */
+			return -1;
+		} else {
+			pos = atomic_load_explicit(&gw->rxq_tail, RELAXED);
+		}
+	}
+
+	memcpy(&slot->f, f, sizeof(*f));
+	atomic_store_explicit(&slot->seq, pos + 1, RELEASE);
+
+	return 0;
+}
+
+/*
+ * Dequeue up to max frames from all radios. Must only be called from a
+ * single consumer thread. Returns the number of frames copied to f.
+ */
+int
+gw_recv(struct gw *gw, struct gw_frame *f, int max)
+{
+	struct gw_slot *slot;
+	unsigned long pos = gw->rxq_head;
+	int n = 0;
+
+	while (n < max) {
+		slot = &gw->rxq[pos & (GW_RXQ_SIZE - 1)];
+		if (atomic_load_explicit(&slot->seq, ACQUIRE) != pos + 1)
+			break;
+
+		memcpy(&f[n++], &slot->f, sizeof(*f));
+		atomic_store_explicit(&slot->seq, pos + GW_RXQ_SIZE, RELEASE);
+		++pos;
+	}
+
+	gw->rxq_head = pos;
+
+	return n;
+}
+
+/*
+ * Queue a frame for transmission on the given radio. For each radio,
+ * gw_send must only be called from one thread at a time. Returns EBUSY
+ * if the radio's transmit ring is full, ENOMEM if the payload is longer
+ * than MRF24J40_TXPKT_MAX.
+ */
+int
+gw_send(struct gw *gw, int radio, unsigned short dest,
+    const unsigned char *pkt, int len, int enc)
+{
+	struct gw_radio *r;
+	struct gw_tx *tx;
+	unsigned int tail;
+
+	if (radio < 0 || radio >= gw->nradios)
+		return EIO;
+
+	if (len < 0 || len > MRF24J40_TXPKT_MAX)
+		return ENOMEM;
+
+	r = &gw->radios[radio];
+	tail = atomic_load_explicit(&r->txq_tail, RELAXED);
+	if (tail - atomic_load_explicit(&r->txq_head, ACQUIRE) == GW_TXQ_SIZE)
+		return EBUSY;
+
+	tx = &r->txq[tail & (GW_TXQ_SIZE - 1)];
+	tx->dest = dest;
+	tx->len = len;
+	tx->enc = enc;
+	memcpy(tx->data, pkt, len);
+
+	atomic_store_explicit(&r->txq_tail, tail + 1, RELEASE);
+
+	return 0;
+}
+
+static void
+gw_tx_next(struct gw_radio *r)
+{
+	struct gw_tx *tx;
+	unsigned int head;
+
+	head = atomic_load_explicit(&r->txq_head, RELAXED);
+	if (head == atomic_load_explicit(&r->txq_tail, ACQUIRE))
+		return;
+
+	tx = &r->txq[head & (GW_TXQ_SIZE - 1)];
+	mrf24j40_txpkt(tx->dest, tx->data, tx->len, tx->enc);
+	r->tx_busy = 1;
+
+	atomic_store_explicit(&r->txq_head, head + 1, RELEASE);
+}
+
+static void
+gw_count(atomic_ulong *c)
+{
+	atomic_fetch_add_explicit(c, 1, RELAXED);
+}
+
+static void *
+gw_worker(void *arg)
+{
+	struct gw_radio *r = arg;
+	struct gw *gw = r->gw;
+	struct gw_frame f;
+	cpu_set_t cpus;
+	int ev, err;
+
+	if (r->cfg.cpu >= 0) {
+		CPU_ZERO(&cpus);
+		CPU_SET(r->cfg.cpu, &cpus);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	}
+
+	/* Everything below talks to this radio only */
+	hal_host_bind(r->cfg.ops, r->cfg.hal);
+	mrf24j40_bind(&r->drv);
+
+	mrf24j40_init(r->cfg.channel - 11);
+	mrf24j40_set_pan(r->cfg.pan);
+	mrf24j40_set_short_addr(r->cfg.short_addr);
+	if (r->cfg.filt != (void *)0)
+		mrf24j40_set_promiscuous(1);
+
+	f.radio = r->id;
+
+	while (!atomic_load_explicit(&gw->stop, RELAXED)) {
+		if (!r->tx_busy)
+			gw_tx_next(r);
+
+		if (hal_host_wait_irq(GW_IRQ_TIMEOUT) <= 0)
+			continue;
+
+		ev = mrf24j40_int_tasks();
+
+		if (ev & MRF24J40_INT_RX) {
+			if (r->cfg.filt != (void *)0)
+				err = rxfilt_rx(r->cfg.filt, f.data,
+				    GW_FRAME_MAX, &f.lqi, &f.rssi);
+			else
+				err = mrf24j40_rxpkt_intcb(f.data,
+				    GW_FRAME_MAX, &f.lqi, &f.rssi);
+
+			if (err == ENOENT) {
+				gw_count(&r->cnt.rx_filtered);
+			} else if (err != 0) {
+				mrf24j40_rxfifo_flush();
+				gw_count(&r->cnt.rx_errors);
+			} else if (gw_rxq_put(gw, &f) != 0) {
+				gw_count(&r->cnt.rx_drops);
+			} else {
+				gw_count(&r->cnt.rx_frames);
+			}
+		}
+
+		if (ev & MRF24J40_INT_TX) {
+			r->tx_busy = 0;
+			err = mrf24j40_txpkt_intcb();
+			if (err == 0)
+				gw_count(&r->cnt.tx_frames);
+			else if (err == EBUSY)
+				gw_count(&r->cnt.tx_busy);
+			else
+				gw_count(&r->cnt.tx_errors);
+		}
+	}
+
+	return (void *)0;
+}
+
+int
+gw_start(struct gw *gw)
+{
+	int i, error;
+
+	atomic_store(&gw->stop, 0);
+
+	for (i = 0; i < gw->nradios; i++) {
+		error = pthread_create(&gw->radios[i].thr, (void *)0,
+		    gw_worker, &gw->radios[i]);
+		if (error) {
+			gw->nradios = i;
+			gw_stop(gw);
+			return error;
+		}
+	}
+
+	return 0;
+}
+
+void
+gw_stop(struct gw *gw)
+{
+	int i;
+
+	atomic_store(&gw->stop, 1);
+
+	for (i = 0; i < gw->nradios; i++)
+		pthread_join(gw->radios[i].thr, (void *)0);
+}
+
+void
+gw_radio_stats(struct gw *gw, int radio, struct gw_radio_stats *st)
+{
+	struct gw_counters *c = &gw->radios[radio].cnt;
+
+	st->rx_frames = atomic_load_explicit(&c->rx_frames, RELAXED);
+	st->rx_drops = atomic_load_explicit(&c->rx_drops, RELAXED);
+	st->rx_errors = atomic_load_explicit(&c->rx_errors, RELAXED);
+	st->rx_filtered = atomic_load_explicit(&c->rx_filtered, RELAXED);
+	st->tx_frames = atomic_load_explicit(&c->tx_frames, RELAXED);
+	st->tx_errors = atomic_load_explicit(&c->tx_errors, RELAXED);
+	st->tx_busy = atomic_load_explicit(&c->tx_busy, RELAXED);
+}
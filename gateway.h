@@ -0,0 +1,136 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _GATEWAY_H_
+#define _GATEWAY_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "hal_host.h"
+#include "MRF24J40.h"
+#include "rxfilt.h"
+
+/*
+ * Multi-radio gateway engine.
+ *
+ * Every radio is serviced by its own worker thread, which binds the HAL
+ * backend and the driver state of that radio (this requires building the
+ * driver with MRF24J40_MULTI and MRF24J40_TLS=_Thread_local). Received
+ * frames from all radios are delivered through a single bounded,
+ * lock-free multi-producer/single-consumer queue; transmit requests go
+ * to each radio through a single-producer/single-consumer ring.
+ */
+
+#define GW_MAX_RADIOS		16
+#define GW_RXQ_SIZE		1024	/* must be a power of two */
+#define GW_TXQ_SIZE		32	/* must be a power of two */
+#define GW_FRAME_MAX		127
+#define GW_IRQ_TIMEOUT		10	/* ms, worker stop latency */
+
+struct gw_frame {
+	unsigned char	radio;
+	unsigned char	lqi;
+	unsigned char	rssi;
+	unsigned char	data[GW_FRAME_MAX + 1];	/* data[0] is the length */
+};
+
+struct gw_tx {
+	unsigned short	dest;
+	unsigned char	len;
+	unsigned char	enc;
+	unsigned char	data[MRF24J40_TXPKT_MAX];
+};
+
+struct gw_radio_stats {
+	unsigned long	rx_frames;
+	unsigned long	rx_drops;	/* RX queue full */
+	unsigned long	rx_errors;
+	unsigned long	rx_filtered;	/* turned away by the RX filter */
+	unsigned long	tx_frames;
+	unsigned long	tx_errors;
+	unsigned long	tx_busy;	/* channel access failures */
+};
+
+/* Worker side counters, see gw_radio_stats() for a snapshot */
+struct gw_counters {
+	atomic_ulong	rx_frames;
+	atomic_ulong	rx_drops;
+	atomic_ulong	rx_errors;
+	atomic_ulong	rx_filtered;
+	atomic_ulong	tx_frames;
+	atomic_ulong	tx_errors;
+	atomic_ulong	tx_busy;
+};
+
+struct gw_radio_cfg {
+	int		channel;	/* 11 - 26 */
+	int		pan;
+	int		short_addr;
+	int		cpu;		/* CPU to pin the worker to, or -1 */
+	const struct rxfilt *filt;	/* sniff: promiscuous, no ACKs,
+					   frames filtered by this */
+	const struct hal_host_ops *ops;
+	void		*hal;		/* backend context */
+};
+
+struct gw_radio {
+	struct gw		*gw;
+	int			id;
+	struct gw_radio_cfg	cfg;
+	struct mrf24j40_state	drv;
+	pthread_t		thr;
+	int			tx_busy;
+
+	struct gw_tx		txq[GW_TXQ_SIZE];
+	atomic_uint		txq_head;
+	atomic_uint		txq_tail;
+
+	struct gw_counters	cnt;
+};
+
+struct gw_slot {
+	atomic_ulong		seq;
+	struct gw_frame		f;
+};
+
+struct gw {
+	/* RX queue; the consumer index is only touched by gw_recv */
+	struct gw_slot		rxq[GW_RXQ_SIZE];
+	atomic_ulong		rxq_tail;
+	unsigned long		rxq_head;
+
+	struct gw_radio		radios[GW_MAX_RADIOS];
+	int			nradios;
+	atomic_int		stop;
+};
+
+void gw_init(struct gw *gw);
+int gw_add_radio(struct gw *gw, const struct gw_radio_cfg *cfg);
+int gw_start(struct gw *gw);
+void gw_stop(struct gw *gw);
+int gw_recv(struct gw *gw, struct gw_frame *f, int max);
+int gw_send(struct gw *gw, int radio, unsigned short dest,
+    const unsigned char *pkt, int len, int enc);
+void gw_radio_stats(struct gw *gw, int radio, struct gw_radio_stats *st);
+
+#endif /* _GATEWAY_H_ */
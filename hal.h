@@ -0,0 +1,62 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _HAL_H_
+#define _HAL_H_
+
+/*
+ * Compile-time HAL selection. MRF24J40_HAL_H names a HAL header of your
+ * own; otherwise the HAL is chosen from the compiler/target.
+ *
+ * Define HAL_INLINE to have the SPI primitives and the driver's register
+ * accessors compiled inline at every call site, instead of going through
+ * a function call per byte. This costs flash for speed.
+ */
+/* MPLAB C18 has no inline keyword */
+#ifndef MRF24J40_INLINE
+#if defined(__18CXX)
+#define MRF24J40_INLINE
+#else
+#define MRF24J40_INLINE	inline
+#endif
+#endif
+
+/* Constant tables go into program memory; C18 needs to be told so */
+#ifndef MRF24J40_ROM
+#if defined(__18CXX)
+#define MRF24J40_ROM	const rom
+#else
+#define MRF24J40_ROM	const
+#endif
+#endif
+
+#if defined(MRF24J40_HAL_H)
+#include MRF24J40_HAL_H
+#elif defined(MRF24J40_HAL_HOST)
+#include "hal_host.h"
+#elif defined(__PIC24F__) || defined(__C30__) || defined(__XC16__)
+#include "hal_pic24.h"
+#else
+#include "hal_pic18.h"
+#endif
+
+#endif /* _HAL_H_ */
@@ -0,0 +1,136 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "hal_host.h"
+
+static _Thread_local const struct hal_host_ops *hal_ops;
+static _Thread_local void *hal_ctx;
+
+void
+hal_host_bind(const struct hal_host_ops *ops, void *ctx)
+{
+	hal_ops = ops;
+	hal_ctx = ctx;
+}
+
+void
+hal_host_bound(const struct hal_host_ops **ops, void **ctx)
+{
+	*ops = hal_ops;
+	*ctx = hal_ctx;
+}
+
+void
+hal_host_cs(int level)
+{
+	hal_ops->cs(hal_ctx, level);
+}
+
+void
+hal_host_reset(int level)
+{
+	if (hal_ops->reset != (void *)0)
+		hal_ops->reset(hal_ctx, level);
+}
+
+void
+hal_host_wake(int level)
+{
+	if (hal_ops->wake != (void *)0)
+		hal_ops->wake(hal_ctx, level);
+}
+
+int
+hal_host_wait_irq(int timeout_ms)
+{
+	return hal_ops->wait_irq(hal_ctx, timeout_ms);
+}
+
+unsigned long
+hal_host_timestamp(void)
+{
+	if (hal_ops->timestamp == (void *)0)
+		return 0;
+
+	return hal_ops->timestamp(hal_ctx);
+}
+
+int
+hal_host_fn_enter(const char *fn)
+{
+	if (hal_ops->fn_enter != (void *)0)
+		hal_ops->fn_enter(hal_ctx, fn);
+
+	return 0;
+}
+
+void
+hal_host_fn_leave(int *unused)
+{
+	(void)unused;
+	if (hal_ops->fn_leave != (void *)0)
+		hal_ops->fn_leave(hal_ctx);
+}
+
+void
+spi_write(unsigned char v)
+{
+	hal_ops->write(hal_ctx, v);
+}
+
+unsigned char
+spi_read(void)
+{
+	return hal_ops->read(hal_ctx);
+}
+
+void
+spi_xfer(unsigned char *a, int alen, unsigned char *d, int dlen, int rd)
+{
+	if (hal_ops->xfer != (void *)0) {
+		hal_ops->xfer(hal_ctx, a, alen, d, dlen, rd);
+		return;
+	}
+
+	hal_ops->cs(hal_ctx, 0);
+	while (alen-- > 0)
+		hal_ops->write(hal_ctx, *a++);
+	while (dlen-- > 0) {
+		if (rd)
+			*d++ = hal_ops->read(hal_ctx);
+		else
+			hal_ops->write(hal_ctx, *d++);
+	}
+	hal_ops->cs(hal_ctx, 1);
+}
+
+void
+delay_1ms(void)
+{
+	hal_ops->delay_us(hal_ctx, 1000);
+}
+
+void
+delay_us(unsigned int us)
+{
+	hal_ops->delay_us(hal_ctx, us);
+}
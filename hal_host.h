@@ -0,0 +1,107 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _HAL_HOST_H_
+#define _HAL_HOST_H_
+
+/*
+ * Hosted (Linux/POSIX) HAL. The pin, SPI and delay primitives the driver
+ * expects are dispatched to a backend (simulator, spidev, ...) through an
+ * ops table. The binding is per thread, so every thread can drive its
+ * own radio; see also mrf24j40_bind().
+ */
+struct hal_host_ops {
+	void		(*cs)(void *ctx, int level);
+	void		(*reset)(void *ctx, int level);
+	void		(*wake)(void *ctx, int level);
+	void		(*write)(void *ctx, unsigned char v);
+	unsigned char	(*read)(void *ctx);
+	void		(*delay_us)(void *ctx, unsigned int us);
+
+	/*
+	 * Optional; one complete CS cycle, see HAL_SPI_XFER in MRF24J40.c.
+	 * Backends without it get the transfer clocked through write/read.
+	 */
+	void		(*xfer)(void *ctx, unsigned char *a, int alen,
+			    unsigned char *d, int dlen, int rd);
+
+	/*
+	 * Wait for the radio's INT line; returns > 0 if an interrupt is
+	 * pending, 0 on timeout and < 0 on error.
+	 */
+	int		(*wait_irq)(void *ctx, int timeout_ms);
+
+	/*
+	 * Optional; local clock in microseconds, for the frame timestamps
+	 * taken by the driver (MRF24J40_TIMESTAMP).
+	 */
+	unsigned long	(*timestamp)(void *ctx);
+
+	/*
+	 * Optional; a public driver function was entered or returned, see
+	 * MRF24J40_TRACE_FN. fn is the function's name. Only called when
+	 * the driver is built with -DHAL_TRACE.
+	 */
+	void		(*fn_enter)(void *ctx, const char *fn);
+	void		(*fn_leave)(void *ctx);
+};
+
+#define CS_HIGH()	hal_host_cs(1)
+#define CS_LOW()	hal_host_cs(0)
+
+#define RESET_HIGH()	hal_host_reset(1)
+#define RESET_LOW()	hal_host_reset(0)
+
+#define WAKE_HIGH()	hal_host_wake(1)
+#define WAKE_LOW()	hal_host_wake(0)
+
+#define DELAY_1MS	delay_1ms
+#define DELAY_US(us)	delay_us(us)
+
+#define HAL_SPI_XFER
+
+#define MRF24J40_TIMESTAMP()	hal_host_timestamp()
+#define MRF24J40_CYCLES()	hal_host_timestamp()
+
+#ifdef HAL_TRACE
+#define MRF24J40_TRACE_FN()						\
+	int mrf24j40_trace_fn_ __attribute__((cleanup(hal_host_fn_leave))) = \
+	    hal_host_fn_enter(__func__)
+#endif
+
+void hal_host_bind(const struct hal_host_ops *ops, void *ctx);
+void hal_host_bound(const struct hal_host_ops **ops, void **ctx);
+void hal_host_cs(int level);
+void hal_host_reset(int level);
+void hal_host_wake(int level);
+int hal_host_wait_irq(int timeout_ms);
+unsigned long hal_host_timestamp(void);
+int hal_host_fn_enter(const char *fn);
+void hal_host_fn_leave(int *unused);
+
+void spi_write(unsigned char v);
+unsigned char spi_read(void);
+void spi_xfer(unsigned char *a, int alen, unsigned char *d, int dlen, int rd);
+void delay_1ms(void);
+void delay_us(unsigned int us);
+
+#endif /* _HAL_HOST_H_ */
@@ -0,0 +1,351 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+#include <linux/spi/spidev.h>
+
+#include "hal_linux.h"
+
+#define SPI_SPEED_DEFAULT	5000000
+
+static int
+sys_ioctl(int fd, unsigned long req, void *arg)
+{
+	return ioctl(fd, req, arg);
+}
+
+static long
+sys_read(int fd, void *buf, size_t len)
+{
+	return read(fd, buf, len);
+}
+
+static int
+sys_open(const char *path, int flags)
+{
+	return open(path, flags);
+}
+
+static const struct hal_linux_io sys_io = {
+	.open = sys_open,
+	.close = close,
+	.ioctl = sys_ioctl,
+	.read = sys_read,
+	.poll = poll,
+};
+
+/*
+ * SPI. The HAL primitives cannot report errors to the driver, so failed
+ * transfers are counted in h->errors.
+ */
+static void
+hal_linux_message(struct hal_linux *h, struct spi_ioc_transfer *t, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		t[i].speed_hz = h->speed_hz;
+		t[i].bits_per_word = 8;
+	}
+
+	if (h->io->ioctl(h->spi_fd, SPI_IOC_MESSAGE(n), t) < 0)
+		h->errors++;
+}
+
+static void
+hal_linux_xfer(void *ctx, unsigned char *a, int alen, unsigned char *d,
+    int dlen, int rd)
+{
+	struct hal_linux *h = ctx;
+	struct spi_ioc_transfer t[2];
+
+	memset(t, 0, sizeof(t));
+
+	t[0].tx_buf = (unsigned long)a;
+	t[0].len = alen;
+
+	if (rd)
+		t[1].rx_buf = (unsigned long)d;
+	else
+		t[1].tx_buf = (unsigned long)d;
+	t[1].len = dlen;
+
+	hal_linux_message(h, t, (dlen > 0) ? 2 : 1);
+}
+
+/*
+ * Byte-wise access, for code that does not use spi_xfer. Writes are
+ * gathered until CS is released; a read sends what was gathered plus
+ * the byte to read, keeping CS asserted for the rest of the cycle.
+ */
+static void
+hal_linux_flush(struct hal_linux *h, unsigned char *rx, int keep_cs)
+{
+	struct spi_ioc_transfer t;
+
+	memset(&t, 0, sizeof(t));
+	t.tx_buf = (unsigned long)h->buf;
+	t.rx_buf = (unsigned long)rx;
+	t.len = h->nbuf;
+	t.cs_change = keep_cs;
+
+	hal_linux_message(h, &t, 1);
+	h->nbuf = 0;
+}
+
+static void
+hal_linux_cs(void *ctx, int level)
+{
+	struct hal_linux *h = ctx;
+
+	if (level && h->nbuf > 0)
+		hal_linux_flush(h, (void *)0, 0);
+
+	h->nbuf = 0;
+}
+
+static void
+hal_linux_write(void *ctx, unsigned char v)
+{
+	struct hal_linux *h = ctx;
+
+	if (h->nbuf == sizeof(h->buf))
+		hal_linux_flush(h, (void *)0, 1);
+
+	h->buf[h->nbuf++] = v;
+}
+
+static unsigned char
+hal_linux_read(void *ctx)
+{
+	struct hal_linux *h = ctx;
+	unsigned char rx[sizeof(h->buf) + 1];
+	int n;
+
+	if (h->nbuf == sizeof(h->buf))
+		hal_linux_flush(h, (void *)0, 1);
+
+	h->buf[h->nbuf++] = 0x00;
+	n = h->nbuf;
+	hal_linux_flush(h, rx, 1);
+
+	return rx[n - 1];
+}
+
+/*
+ * GPIO
+ */
+static int
+hal_linux_line(struct hal_linux *h, int chip_fd, int line, int input)
+{
+	struct gpio_v2_line_request req;
+
+	memset(&req, 0, sizeof(req));
+	req.offsets[0] = line;
+	req.num_lines = 1;
+	req.config.flags = input ?
+	    (GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING) :
+	    GPIO_V2_LINE_FLAG_OUTPUT;
+	strncpy(req.consumer, "mrf24j40", sizeof(req.consumer) - 1);
+
+	if (h->io->ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &req) < 0)
+		return -1;
+
+	return req.fd;
+}
+
+static void
+hal_linux_set(struct hal_linux *h, int fd, int level)
+{
+	struct gpio_v2_line_values v;
+
+	if (fd < 0)
+		return;
+
+	v.mask = 1;
+	v.bits = level ? 1 : 0;
+	if (h->io->ioctl(fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &v) < 0)
+		h->errors++;
+}
+
+static void
+hal_linux_reset(void *ctx, int level)
+{
+	struct hal_linux *h = ctx;
+
+	hal_linux_set(h, h->reset_fd, level);
+}
+
+static void
+hal_linux_wake(void *ctx, int level)
+{
+	struct hal_linux *h = ctx;
+
+	hal_linux_set(h, h->wake_fd, level);
+}
+
+/*
+ * The INT line is configured for rising edges (SLPCON0 INTEDGE). An edge
+ * that came before the wait started is still caught, since the line
+ * stays high until INTSTAT is read.
+ */
+static int
+hal_linux_wait_irq(void *ctx, int timeout_ms)
+{
+	struct hal_linux *h = ctx;
+	struct gpio_v2_line_values v;
+	struct gpio_v2_line_event ev[16];
+	struct pollfd pfd;
+	int n;
+
+	if (h->irq_fd < 0)
+		return -1;
+
+	v.mask = 1;
+	v.bits = 0;
+	if (h->io->ioctl(h->irq_fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &v) == 0 &&
+	    (v.bits & 1))
+		n = 1;
+	else {
+		pfd.fd = h->irq_fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		n = h->io->poll(&pfd, 1, timeout_ms);
+		if (n <= 0)
+			return n;
+	}
+
+	/* Drain queued edge events, the line state is what counts */
+	pfd.fd = h->irq_fd;
+	pfd.events = POLLIN;
+	while (h->io->poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN))
+		h->io->read(h->irq_fd, ev, sizeof(ev));
+
+	return 1;
+}
+
+static void
+hal_linux_delay_us(void *ctx, unsigned int us)
+{
+	struct timespec ts;
+
+	(void)ctx;
+	ts.tv_sec = us / 1000000;
+	ts.tv_nsec = (us % 1000000) * 1000L;
+	while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+		;
+}
+
+static unsigned long
+hal_linux_timestamp(void *ctx)
+{
+	struct timespec ts;
+
+	(void)ctx;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+const struct hal_host_ops hal_linux_ops = {
+	.cs = hal_linux_cs,
+	.reset = hal_linux_reset,
+	.wake = hal_linux_wake,
+	.write = hal_linux_write,
+	.read = hal_linux_read,
+	.delay_us = hal_linux_delay_us,
+	.wait_irq = hal_linux_wait_irq,
+	.xfer = hal_linux_xfer,
+	.timestamp = hal_linux_timestamp,
+};
+
+int
+hal_linux_open(struct hal_linux *h, const struct hal_linux_cfg *cfg)
+{
+	unsigned char mode = SPI_MODE_0;
+	unsigned char bits = 8;
+	int chip_fd = -1;
+
+	memset(h, 0, sizeof(*h));
+	h->io = (cfg->io != (void *)0) ? cfg->io : &sys_io;
+	h->speed_hz = cfg->speed_hz ? cfg->speed_hz : SPI_SPEED_DEFAULT;
+	h->reset_fd = h->wake_fd = h->irq_fd = -1;
+
+	h->spi_fd = h->io->open(cfg->spidev, O_RDWR);
+	if (h->spi_fd < 0)
+		return -1;
+
+	if (h->io->ioctl(h->spi_fd, SPI_IOC_WR_MODE, &mode) < 0 ||
+	    h->io->ioctl(h->spi_fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+	    h->io->ioctl(h->spi_fd, SPI_IOC_WR_MAX_SPEED_HZ, &h->speed_hz) < 0)
+		goto fail;
+
+	if (cfg->reset_line < 0 && cfg->wake_line < 0 && cfg->irq_line < 0)
+		return 0;
+
+	chip_fd = h->io->open(cfg->gpiochip, O_RDWR);
+	if (chip_fd < 0)
+		goto fail;
+
+	if (cfg->reset_line >= 0 &&
+	    (h->reset_fd = hal_linux_line(h, chip_fd, cfg->reset_line, 0)) < 0)
+		goto fail;
+	if (cfg->wake_line >= 0 &&
+	    (h->wake_fd = hal_linux_line(h, chip_fd, cfg->wake_line, 0)) < 0)
+		goto fail;
+	if (cfg->irq_line >= 0 &&
+	    (h->irq_fd = hal_linux_line(h, chip_fd, cfg->irq_line, 1)) < 0)
+		goto fail;
+
+	/* Line requests stay valid after the chip is closed */
+	h->io->close(chip_fd);
+
+	return 0;
+
+fail:
+	if (chip_fd >= 0)
+		h->io->close(chip_fd);
+	hal_linux_close(h);
+	return -1;
+}
+
+void
+hal_linux_close(struct hal_linux *h)
+{
+	if (h->irq_fd >= 0)
+		h->io->close(h->irq_fd);
+	if (h->wake_fd >= 0)
+		h->io->close(h->wake_fd);
+	if (h->reset_fd >= 0)
+		h->io->close(h->reset_fd);
+	if (h->spi_fd >= 0)
+		h->io->close(h->spi_fd);
+
+	h->spi_fd = h->reset_fd = h->wake_fd = h->irq_fd = -1;
+}
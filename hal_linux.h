@@ -0,0 +1,82 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _HAL_LINUX_H_
+#define _HAL_LINUX_H_
+
+#include <poll.h>
+#include <stddef.h>
+
+#include "hal_host.h"
+
+/*
+ * Linux userspace backend for hal_host: SPI through spidev, RESET and
+ * WAKE as GPIO character device outputs and INT as a GPIO line event.
+ *
+ * Every driver register access and FIFO burst becomes one
+ * SPI_IOC_MESSAGE ioctl with an address and a data segment.
+ *
+ * The system calls go through struct hal_linux_io, so a fake spidev and
+ * gpiochip can be substituted for testing; NULL selects the real ones.
+ * tools/hal_linux_check.c does that, on top of the chip model of
+ * hal_sim.c.
+ */
+
+struct hal_linux_io {
+	int	(*open)(const char *path, int flags);
+	int	(*close)(int fd);
+	int	(*ioctl)(int fd, unsigned long req, void *arg);
+	long	(*read)(int fd, void *buf, size_t len);
+	int	(*poll)(struct pollfd *fds, nfds_t nfds, int timeout);
+};
+
+struct hal_linux_cfg {
+	const char	*spidev;	/* e.g. "/dev/spidev0.0" */
+	unsigned int	speed_hz;	/* 0: 5 MHz */
+	const char	*gpiochip;	/* e.g. "/dev/gpiochip0" */
+	int		reset_line;	/* line offsets, -1 if not wired */
+	int		wake_line;
+	int		irq_line;
+	const struct hal_linux_io *io;
+};
+
+struct hal_linux {
+	const struct hal_linux_io *io;
+	int		spi_fd;
+	int		reset_fd;
+	int		wake_fd;
+	int		irq_fd;
+	unsigned int	speed_hz;
+
+	/* Byte-wise access (spi_write/spi_read) is gathered per CS cycle */
+	unsigned char	buf[2 + 128];
+	int		nbuf;
+
+	unsigned long	errors;		/* failed SPI and GPIO ioctls */
+};
+
+extern const struct hal_host_ops hal_linux_ops;
+
+int hal_linux_open(struct hal_linux *h, const struct hal_linux_cfg *cfg);
+void hal_linux_close(struct hal_linux *h);
+
+#endif /* _HAL_LINUX_H_ */
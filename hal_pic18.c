@@ -23,29 +23,19 @@
 #include <p18cxxx.h>
 #include <delays.h>
 
-void spi_write(unsigned char v)
-{
-	unsigned char i;
-
-	PIR1bits.SSPIF = 0;
-	i = SSPBUF;
-	do
-	{
-		SSPCON1bits.WCOL = 0;
-		SSPBUF = v;
-	} while( SSPCON1bits.WCOL );
-    
-	while( PIR1bits.SSPIF == 0 );
-}
-
-unsigned char spi_read(void)
-{
-	spi_write(0x00);
-	return SSPBUF;
-}
+#define HAL_PIC18_IMPL
+#include "hal_pic18.h"
 
 void delay_1ms(void)
 {
 	/* Not really a ms, but doesn't matter. */
 	Delay1KTCYx(1);
 }
+
+/* TMR1L has to be read first; that latches TMR1H */
+unsigned short hal_pic18_cycles(void)
+{
+	unsigned char l = TMR1L;
+
+	return ((unsigned short)TMR1H << 8) | l;
+}
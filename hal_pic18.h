@@ -33,6 +33,53 @@
 
 #define DELAY_1MS	delay_1ms
 
+void delay_1ms(void);
+
+/*
+ * Time base of the driver's probes (MRF24J40_PROBES): Timer1, which has
+ * to be left free-running in 16-bit read/write mode, ideally at Fosc/4.
+ * Define MRF24J40_CYCLES() yourself if Timer1 is taken.
+ */
+#ifndef MRF24J40_CYCLES
+#define MRF24J40_CYCLES()	hal_pic18_cycles()
+unsigned short hal_pic18_cycles(void);
+#endif
+
+/*
+ * The SPI primitives live here so that they can be compiled inline into
+ * the driver (HAL_INLINE, see hal.h); hal_pic18.c instantiates them
+ * otherwise.
+ */
+#if defined(HAL_PIC18_IMPL)
+#define HAL_SPI_FN
+#elif defined(HAL_INLINE)
+#define HAL_SPI_FN	static MRF24J40_INLINE
+#endif
+
+#ifdef HAL_SPI_FN
+HAL_SPI_FN void
+spi_write(unsigned char v)
+{
+	unsigned char i;
+
+	PIR1bits.SSPIF = 0;
+	i = SSPBUF;
+	do
+	{
+		SSPCON1bits.WCOL = 0;
+		SSPBUF = v;
+	} while( SSPCON1bits.WCOL );
+    
+	while( PIR1bits.SSPIF == 0 );
+}
+
+HAL_SPI_FN unsigned char
+spi_read(void)
+{
+	spi_write(0x00);
+	return SSPBUF;
+}
+#else
 void spi_write(unsigned char v);
 unsigned char spi_read(void);
-void delay_1ms(void);
+#endif
@@ -23,21 +23,8 @@
 #include <p24fxxxx.h>
 #include <delays.h>
 
-void spi_write(unsigned char v)
-{
-	unsigned char i;
-
-	SPI1BUF = v;
-
-	while(SPI1STATbits.SPITBF);
-	i = SPI1BUF;
-}
-
-unsigned char spi_read(void)
-{
-	spi_write(0x00);
-	return (SPI1BUF & 0xff);
-}
+#define HAL_PIC24_IMPL
+#include "hal_pic24.h"
 
 void delay_1ms(void)
 {
@@ -33,6 +33,47 @@
 
 #define DELAY_1MS	delay_1ms
 
+void delay_1ms(void);
+
+/*
+ * Time base of the driver's probes (MRF24J40_PROBES): Timer1, which has
+ * to be left free-running (PR1 = 0xFFFF), ideally at Fcy. Define
+ * MRF24J40_CYCLES() yourself if Timer1 is taken.
+ */
+#ifndef MRF24J40_CYCLES
+#define MRF24J40_CYCLES()	TMR1
+#endif
+
+/*
+ * The SPI primitives live here so that they can be compiled inline into
+ * the driver (HAL_INLINE, see hal.h); hal_pic24.c instantiates them
+ * otherwise.
+ */
+#if defined(HAL_PIC24_IMPL)
+#define HAL_SPI_FN
+#elif defined(HAL_INLINE)
+#define HAL_SPI_FN	static MRF24J40_INLINE
+#endif
+
+#ifdef HAL_SPI_FN
+HAL_SPI_FN void
+spi_write(unsigned char v)
+{
+	unsigned char i;
+
+	SPI1BUF = v;
+
+	while(SPI1STATbits.SPITBF);
+	i = SPI1BUF;
+}
+
+HAL_SPI_FN unsigned char
+spi_read(void)
+{
+	spi_write(0x00);
+	return (SPI1BUF & 0xff);
+}
+#else
 void spi_write(unsigned char v);
 unsigned char spi_read(void);
-void delay_1ms(void);
+#endif
@@ -0,0 +1,1152 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hal_sim.h"
+#include "ieee802154.h"
+
+#ifndef MRF24J40_MULTI
+#error "the simulator requires a driver built with MRF24J40_MULTI"
+#endif
+
+#define TXNRETRY_SHIFT		6
+#define MAC_MAX_BE		5
+#define MAC_MAX_RETRIES		3
+#define BACKOFF_PERIOD		20	/* symbols */
+#define CCA_TIME		8	/* symbols */
+#define TURNAROUND		12	/* symbols */
+#define PHY_OVERHEAD		6	/* preamble, SFD and PHR */
+#define FCS_LEN			2
+#define ACK_LEN			3	/* without FCS */
+
+enum {
+	EV_CCA,
+	EV_TX_START,
+	EV_TX_END,
+	EV_ACK_TIMEOUT,
+	EV_IRQ,
+	EV_TIMER,
+	EV_HSYM
+};
+
+enum {
+	TX_IDLE,
+	TX_CSMA,
+	TX_BUSY,
+	TX_WAIT_ACK
+};
+
+struct sim_ev {
+	sim_time_t	t;
+	unsigned long	seq;		/* FIFO order for equal times */
+	int		type;
+	unsigned int	gen;
+	struct sim_node	*n;
+	sim_cb		fn;
+	void		*arg;
+};
+
+struct sim_link {
+	signed char	gain;		/* dB, RSSI at 0 dBm TX power */
+	unsigned char	loss;		/* percent */
+};
+
+struct sim_node {
+	struct sim	*sim;
+	int		id;
+	double		x, y;
+
+	/* Chip state */
+	unsigned char	reg[0x40];
+	unsigned char	mem[0x400];
+	int		sleeping;
+	int		rx_full;
+	struct mrf24j40_state drv;
+
+	/* SPI decoder */
+	int		spi_n;
+	int		spi_addr;
+	int		spi_long;
+	int		spi_write;
+
+	/* Transmitter */
+	int		tx_state;
+	unsigned int	tx_gen;
+	int		tx_nb;
+	int		tx_be;
+	int		tx_retries;
+	int		tx_ackreq;
+	int		tx_is_ack;
+	int		tx_held;	/* frame set aside for an ACK */
+	int		tx_held_len;
+	int		tx_held_ackreq;
+	unsigned char	tx_held_frame[128];
+	int		tx_pending;	/* triggered while sending an ACK */
+	int		tx_len;
+	unsigned char	tx_frame[128];
+	int		tx_active;
+	sim_time_t	tx_end;
+	double		tx_dbm;
+
+	/* Receiver */
+	struct sim_node	*rx_from;
+	int		rx_bad;
+	double		noise_mw;	/* background noise */
+
+	/* Half symbol timer */
+	int		hsym_armed;
+	sim_time_t	hsym_at;
+
+	/* MCU clock, for timestamps */
+	double		clk_ppm;
+	double		clk_offset;	/* us */
+
+	int		irq_sched;
+	sim_cb		irq_fn;
+	void		*irq_arg;
+};
+
+struct sim {
+	sim_time_t	now;
+	unsigned long	ev_seq;
+	unsigned long long rnd;
+
+	struct sim_ev	*evq;
+	int		nev;
+	int		evq_size;
+
+	int		nnodes;
+	struct sim_node	*nodes;
+	struct sim_link	*links;		/* nnodes x nnodes, [from][to] */
+	int		links_dirty;
+
+	struct sim_node	**active;	/* nodes currently transmitting */
+	int		nactive;
+
+	struct sim_stats stats;
+};
+
+static const struct hal_host_ops sim_ops;
+
+/* Default register values after a reset; only the ones that matter */
+static void
+sim_chip_reset(struct sim_node *n)
+{
+	memset(n->reg, 0, sizeof(n->reg));
+	memset(n->mem, 0, sizeof(n->mem));
+
+	n->reg[TXMCR] = MACMINBE(3) | CSMABF(4);
+	n->reg[ACKTMOUT] = 0x39;
+	n->reg[BBREG2] = CCAMODE(0x01) | CCASTH(0x02);
+	n->reg[INTCON] = 0xFF;
+	n->sleeping = 0;
+	n->rx_full = 0;
+	n->rx_from = (void *)0;
+	n->tx_state = TX_IDLE;
+	n->tx_pending = 0;
+	n->tx_held = 0;
+	n->hsym_armed = 0;
+	n->tx_gen++;
+}
+
+/*
+ * Event queue; a binary min-heap ordered by time, then insertion order.
+ */
+static int
+ev_before(const struct sim_ev *a, const struct sim_ev *b)
+{
+	return (a->t < b->t || (a->t == b->t && a->seq < b->seq));
+}
+
+static void
+ev_push(struct sim *sim, sim_time_t t, int type, struct sim_node *n,
+    sim_cb fn, void *arg)
+{
+	struct sim_ev ev, tmp;
+	int i, p;
+
+	if (sim->nev == sim->evq_size) {
+		sim->evq_size = sim->evq_size ? 2 * sim->evq_size : 256;
+		sim->evq = realloc(sim->evq, sim->evq_size * sizeof(ev));
+	}
+
+	ev.t = t;
+	ev.seq = sim->ev_seq++;
+	ev.type = type;
+	ev.gen = (n != (void *)0) ? n->tx_gen : 0;
+	ev.n = n;
+	ev.fn = fn;
+	ev.arg = arg;
+
+	i = sim->nev++;
+	sim->evq[i] = ev;
+	while (i > 0) {
+		p = (i - 1) / 2;
+		if (!ev_before(&sim->evq[i], &sim->evq[p]))
+			break;
+		tmp = sim->evq[p];
+		sim->evq[p] = sim->evq[i];
+		sim->evq[i] = tmp;
+		i = p;
+	}
+}
+
+static void
+ev_pop(struct sim *sim, struct sim_ev *ev)
+{
+	struct sim_ev tmp;
+	int i, c;
+
+	*ev = sim->evq[0];
+	sim->evq[0] = sim->evq[--sim->nev];
+
+	i = 0;
+	for (;;) {
+		c = 2 * i + 1;
+		if (c >= sim->nev)
+			break;
+		if (c + 1 < sim->nev && ev_before(&sim->evq[c + 1], &sim->evq[c]))
+			c++;
+		if (!ev_before(&sim->evq[c], &sim->evq[i]))
+			break;
+		tmp = sim->evq[c];
+		sim->evq[c] = sim->evq[i];
+		sim->evq[i] = tmp;
+		i = c;
+	}
+}
+
+unsigned long
+sim_random(struct sim *sim)
+{
+	/* xorshift64* */
+	sim->rnd ^= sim->rnd >> 12;
+	sim->rnd ^= sim->rnd << 25;
+	sim->rnd ^= sim->rnd >> 27;
+	return (unsigned long)((sim->rnd * 2685821657736338717ULL) >> 32);
+}
+
+/*
+ * PHY helpers
+ */
+static sim_time_t
+sim_symbol(struct sim_node *n)
+{
+	/* 16 us at 250 kbps, 6.4 us at 625 kbps (turbo) */
+	return (n->reg[BBREG0] & TURBO) ? 6400 : 16000;
+}
+
+static sim_time_t
+sim_airtime(struct sim_node *n, int len)
+{
+	return (sim_time_t)(PHY_OVERHEAD + len + FCS_LEN) * 2 * sim_symbol(n);
+}
+
+static int
+sim_channel(struct sim_node *n)
+{
+	return n->mem[RFCON0] >> 4;
+}
+
+static double
+sim_txpower(struct sim_node *n)
+{
+	static const double small[8] = {
+		0, -0.5, -1.2, -1.9, -2.8, -3.7, -4.9, -6.3
+	};
+	unsigned char w = n->mem[RFCON3];
+
+	return -10.0 * (w >> 6) + small[(w >> 3) & 0x07];
+}
+
+static double
+dbm_to_mw(double dbm)
+{
+	return pow(10.0, dbm / 10.0);
+}
+
+static double
+mw_to_dbm(double mw)
+{
+	return 10.0 * log10(mw);
+}
+
+/* Map dBm to the RSSI register scale, -100 dBm .. -20 dBm -> 0 .. 255 */
+static unsigned char
+dbm_to_rssi(double dbm)
+{
+	double v = (dbm + 100.0) * 255.0 / 80.0;
+
+	if (v < 0)
+		return 0;
+	if (v > 255)
+		return 255;
+	return (unsigned char)v;
+}
+
+static void
+sim_update_links(struct sim *sim)
+{
+	struct sim_node *a, *b;
+	struct sim_link *l;
+	double d, gain;
+	int i, j;
+
+	for (i = 0; i < sim->nnodes; i++) {
+		a = &sim->nodes[i];
+		for (j = 0; j < sim->nnodes; j++) {
+			b = &sim->nodes[j];
+			l = &sim->links[i * sim->nnodes + j];
+
+			/* Log-distance path loss, 40 dB at 1 m, exponent 3 */
+			d = hypot(a->x - b->x, a->y - b->y);
+			if (d < 1.0)
+				d = 1.0;
+			gain = -40.0 - 30.0 * log10(d);
+			l->gain = (gain < -128) ? -128 : (signed char)gain;
+			l->loss = 0;
+		}
+	}
+
+	sim->links_dirty = 0;
+}
+
+static struct sim_link *
+sim_getlink(struct sim_node *from, struct sim_node *to)
+{
+	struct sim *sim = from->sim;
+
+	return &sim->links[from->id * sim->nnodes + to->id];
+}
+
+/* Received power at 'to' of the transmission currently sent by 'from' */
+static double
+sim_rxpower(struct sim_node *from, struct sim_node *to)
+{
+	return from->tx_dbm + sim_getlink(from, to)->gain;
+}
+
+/* Total energy on n's channel in mW, optionally leaving one sender out */
+static double
+sim_energy(struct sim_node *n, struct sim_node *except)
+{
+	struct sim *sim = n->sim;
+	struct sim_node *t;
+	double mw = n->noise_mw;
+	int i;
+
+	for (i = 0; i < sim->nactive; i++) {
+		t = sim->active[i];
+		if (t == n || t == except || sim_channel(t) != sim_channel(n))
+			continue;
+		mw += dbm_to_mw(sim_rxpower(t, n));
+	}
+
+	return mw;
+}
+
+static double
+sim_sinr(struct sim_node *n)
+{
+	return sim_rxpower(n->rx_from, n) -
+	    mw_to_dbm(sim_energy(n, n->rx_from));
+}
+
+/*
+ * Interrupts
+ */
+static void
+sim_raise(struct sim_node *n, unsigned char flags)
+{
+	n->reg[INTSTAT] |= flags;
+
+	/* A set INTCON bit masks the interrupt */
+	if ((n->reg[INTSTAT] & ~n->reg[INTCON]) && !n->irq_sched &&
+	    n->irq_fn != (void *)0) {
+		n->irq_sched = 1;
+		ev_push(n->sim, n->sim->now, EV_IRQ, n, (void *)0, (void *)0);
+	}
+}
+
+/*
+ * Transmitter
+ */
+static void
+sim_tx_done(struct sim_node *n, int fail, int ccafail)
+{
+	unsigned char stat;
+
+	n->tx_state = TX_IDLE;
+
+	stat = (n->tx_retries > MAC_MAX_RETRIES ? MAC_MAX_RETRIES :
+	    n->tx_retries) << TXNRETRY_SHIFT;
+	if (fail)
+		stat |= TXNSTAT;
+	if (ccafail)
+		stat |= CCAFAIL;
+	n->reg[TXSTAT] = stat;
+
+	sim_raise(n, TXNIF);
+}
+
+static void
+sim_csma(struct sim_node *n)
+{
+	sim_time_t delay;
+
+	n->tx_state = TX_CSMA;
+
+	if (n->reg[TXMCR] & NOCSMA) {
+		ev_push(n->sim, n->sim->now + TURNAROUND * sim_symbol(n),
+		    EV_TX_START, n, (void *)0, (void *)0);
+		return;
+	}
+
+	delay = (sim_random(n->sim) % (1UL << n->tx_be)) * BACKOFF_PERIOD;
+	delay = (delay + CCA_TIME) * sim_symbol(n);
+	ev_push(n->sim, n->sim->now + delay, EV_CCA, n, (void *)0, (void *)0);
+}
+
+static void
+sim_tx_trigger(struct sim_node *n)
+{
+	int hlen, flen;
+
+	if (n->sleeping)
+		return;
+
+	if (n->tx_state != TX_IDLE) {
+		if (n->tx_is_ack)
+			n->tx_pending = 1;
+		return;
+	}
+
+	hlen = n->mem[TXNFIFO];
+	flen = n->mem[TXNFIFO + 1];
+	if (flen > 125 || hlen > flen) {
+		sim_tx_done(n, 1, 0);
+		return;
+	}
+
+	n->tx_is_ack = 0;
+	n->tx_len = flen;
+	memcpy(n->tx_frame, &n->mem[TXNFIFO + 2], flen);
+	n->tx_ackreq = (n->reg[TXNCON] & TXNACKREQ) && flen >= 7 &&
+	    (n->tx_frame[0] & FCREQACK) &&
+	    ((n->tx_frame[1] >> 2) & 0x03) != FCADDR_NONE &&
+	    !(n->tx_frame[5] == 0xFF && n->tx_frame[6] == 0xFF);
+
+	n->tx_retries = 0;
+	n->tx_nb = 0;
+	n->tx_be = (n->reg[TXMCR] >> 3) & 0x03;
+	sim_csma(n);
+}
+
+static int
+sim_cca_busy(struct sim_node *n)
+{
+	struct sim *sim = n->sim;
+	int mode = (n->reg[BBREG2] >> 6) & 0x03;
+	int ed, cs = 0;
+	int i;
+
+	ed = dbm_to_rssi(mw_to_dbm(sim_energy(n, (void *)0))) >=
+	    n->reg[CCAEDTH];
+
+	for (i = 0; i < sim->nactive; i++) {
+		if (sim->active[i] != n &&
+		    sim_channel(sim->active[i]) == sim_channel(n) &&
+		    sim_rxpower(sim->active[i], n) >= SIM_SENSITIVITY)
+			cs = 1;
+	}
+
+	switch (mode) {
+	case 0x01:
+		return cs;
+	case 0x02:
+		return ed;
+	default:
+		return cs && ed;
+	}
+}
+
+static void
+sim_ev_cca(struct sim_node *n)
+{
+	if (!sim_cca_busy(n)) {
+		ev_push(n->sim, n->sim->now + TURNAROUND * sim_symbol(n),
+		    EV_TX_START, n, (void *)0, (void *)0);
+		return;
+	}
+
+	n->sim->stats.cca_busy++;
+	if (++n->tx_nb > CSMABF(n->reg[TXMCR])) {
+		sim_tx_done(n, 1, 1);
+		return;
+	}
+	if (++n->tx_be > MAC_MAX_BE)
+		n->tx_be = MAC_MAX_BE;
+	sim_csma(n);
+}
+
+static void
+sim_tx_start(struct sim_node *n)
+{
+	struct sim *sim = n->sim;
+	struct sim_node *r;
+	double p;
+	int i;
+
+	n->tx_state = TX_BUSY;
+	n->tx_active = 1;
+	n->tx_dbm = sim_txpower(n);
+	n->tx_end = sim->now + sim_airtime(n, n->tx_len);
+	n->rx_from = (void *)0;		/* half duplex */
+	sim->active[sim->nactive++] = n;
+
+	if (n->tx_is_ack)
+		sim->stats.tx_acks++;
+	else
+		sim->stats.tx_frames++;
+
+	for (i = 0; i < sim->nnodes; i++) {
+		r = &sim->nodes[i];
+		if (r == n || r->tx_active || r->sleeping ||
+		    sim_channel(r) != sim_channel(n))
+			continue;
+
+		if (r->rx_from != (void *)0) {
+			/* Interferes with an ongoing reception */
+			if (!r->rx_bad && sim_sinr(r) < SIM_CAPTURE_DB)
+				r->rx_bad = 1;
+			continue;
+		}
+
+		p = sim_rxpower(n, r);
+		if (p < SIM_SENSITIVITY || (r->reg[BBREG1] & RXDECINV))
+			continue;
+
+		r->rx_from = n;
+		r->rx_bad = (sim_sinr(r) < SIM_CAPTURE_DB);
+	}
+
+	ev_push(sim, n->tx_end, EV_TX_END, n, (void *)0, (void *)0);
+}
+
+/*
+ * Receiver
+ */
+static int
+sim_addr_match(struct sim_node *n, const unsigned char *f, int len)
+{
+	int fctype = f[0] & 0x07;
+	int dmode = (f[1] >> 2) & 0x03;
+	int pan, addr, i;
+
+	if (n->reg[RXMCR] & (PROMI | ERRPKT))
+		return 1;
+
+	if ((n->reg[RXFLUSH] & BCNONLY) && fctype != FCFRTYP_BEACON)
+		return 0;
+	if ((n->reg[RXFLUSH] & DATAONLY) && fctype != FCFRTYP_DATA)
+		return 0;
+	if ((n->reg[RXFLUSH] & CMDONLY) && fctype != FCFRTYP_MCMD)
+		return 0;
+
+	if (dmode == FCADDR_NONE)
+		return (fctype == FCFRTYP_BEACON ||
+		    (n->reg[RXMCR] & PANCOORD));
+
+	if (len < 7)
+		return 0;
+
+	pan = f[3] | (f[4] << 8);
+	if (pan != 0xFFFF &&
+	    pan != (n->reg[PANIDL] | (n->reg[PANIDH] << 8)))
+		return 0;
+
+	if (dmode == FCADDR_SHORT) {
+		addr = f[5] | (f[6] << 8);
+		return (addr == 0xFFFF ||
+		    addr == (n->reg[SADRL] | (n->reg[SADRH] << 8)));
+	}
+
+	if (len < 13)
+		return 0;
+	for (i = 0; i < 8; i++) {
+		if (f[5 + i] != n->reg[EADR0 + i])
+			return 0;
+	}
+	return 1;
+}
+
+static void
+sim_send_ack(struct sim_node *n, const unsigned char *f)
+{
+	if (n->reg[RXMCR] & NOACKRSP)
+		return;
+
+	/*
+	 * The receiver stays on during CSMA-CA backoff. The ACK goes out
+	 * first; the frame is set aside and its backoff restarted after.
+	 */
+	if (n->tx_state == TX_CSMA) {
+		n->tx_held = 1;
+		n->tx_held_len = n->tx_len;
+		n->tx_held_ackreq = n->tx_ackreq;
+		memcpy(n->tx_held_frame, n->tx_frame, n->tx_len);
+		n->tx_gen++;
+	} else if (n->tx_state != TX_IDLE) {
+		return;
+	}
+
+	n->tx_is_ack = 1;
+	n->tx_ackreq = 0;
+	n->tx_len = ACK_LEN;
+	n->tx_frame[0] = FCFRTYP(FCFRTYP_ACK);
+	if (n->reg[TXPEND] & FPACK)
+		n->tx_frame[0] |= FCFRPEN;
+	n->tx_frame[1] = 0;
+	n->tx_frame[2] = f[2];
+	n->tx_state = TX_BUSY;
+
+	ev_push(n->sim, n->sim->now + TURNAROUND * sim_symbol(n),
+	    EV_TX_START, n, (void *)0, (void *)0);
+}
+
+static void
+sim_rx_ack(struct sim_node *n, struct sim_node *from)
+{
+	if (n->tx_state != TX_WAIT_ACK || from->tx_frame[2] != n->tx_frame[2])
+		return;
+
+	/* Cancels the ACK timeout */
+	n->tx_gen++;
+	if (from->tx_frame[0] & FCFRPEN)
+		n->reg[TXNCON] |= FPSTAT;
+	else
+		n->reg[TXNCON] &= ~FPSTAT;
+
+	sim_tx_done(n, 0, 0);
+}
+
+static void
+sim_rx_frame(struct sim_node *n, struct sim_node *from, double sinr)
+{
+	struct sim *sim = n->sim;
+	const unsigned char *f = from->tx_frame;
+	int len = from->tx_len;
+	int lqi;
+
+	if (!sim_addr_match(n, f, len))
+		return;
+
+	if (n->rx_full) {
+		sim->stats.rx_overflows++;
+		return;
+	}
+
+	lqi = (int)(sinr * 8.0);
+	if (lqi > 255)
+		lqi = 255;
+
+	n->mem[RXFIFO] = len + FCS_LEN;
+	memcpy(&n->mem[RXFIFO + 1], f, len);
+	n->mem[RXFIFO + 1 + len] = 0;		/* FCS, not modelled */
+	n->mem[RXFIFO + 2 + len] = 0;
+	n->mem[RXFIFO + 3 + len] = lqi;
+	n->mem[RXFIFO + 4 + len] = dbm_to_rssi(sim_rxpower(from, n));
+	n->rx_full = 1;
+	sim->stats.rx_frames++;
+
+	if ((f[0] & FCREQACK) && ((f[1] >> 2) & 0x03) != FCADDR_NONE &&
+	    !(n->reg[RXMCR] & (PROMI | ERRPKT)) &&
+	    !(len >= 7 && f[5] == 0xFF && f[6] == 0xFF))
+		sim_send_ack(n, f);
+
+	sim_raise(n, RXIF);
+}
+
+static void
+sim_tx_end(struct sim_node *n)
+{
+	struct sim *sim = n->sim;
+	struct sim_node *r;
+	double sinr;
+	int i;
+
+	for (i = 0; i < sim->nactive; i++) {
+		if (sim->active[i] == n) {
+			sim->active[i] = sim->active[--sim->nactive];
+			break;
+		}
+	}
+	n->tx_active = 0;
+
+	for (i = 0; i < sim->nnodes; i++) {
+		r = &sim->nodes[i];
+		if (r->rx_from != n)
+			continue;
+
+		sinr = sim_sinr(r);
+		r->rx_from = (void *)0;
+		if (r->rx_bad) {
+			sim->stats.collisions++;
+			continue;
+		}
+		if (sim_random(sim) % 100 < sim_getlink(n, r)->loss) {
+			sim->stats.link_losses++;
+			continue;
+		}
+
+		if (n->tx_is_ack)
+			sim_rx_ack(r, n);
+		else
+			sim_rx_frame(r, n, sinr);
+	}
+
+	if (n->tx_is_ack) {
+		n->tx_is_ack = 0;
+		n->tx_state = TX_IDLE;
+		if (n->tx_held) {
+			n->tx_held = 0;
+			n->tx_len = n->tx_held_len;
+			n->tx_ackreq = n->tx_held_ackreq;
+			memcpy(n->tx_frame, n->tx_held_frame, n->tx_len);
+			sim_csma(n);
+		} else if (n->tx_pending) {
+			n->tx_pending = 0;
+			sim_tx_trigger(n);
+		}
+	} else if (n->tx_ackreq) {
+		n->tx_state = TX_WAIT_ACK;
+		ev_push(sim, sim->now + (n->reg[ACKTMOUT] & 0x7F) *
+		    sim_symbol(n), EV_ACK_TIMEOUT, n, (void *)0, (void *)0);
+	} else {
+		sim_tx_done(n, 0, 0);
+	}
+}
+
+static void
+sim_ack_timeout(struct sim_node *n)
+{
+	if (++n->tx_retries > MAC_MAX_RETRIES) {
+		sim_tx_done(n, 1, 0);
+		return;
+	}
+
+	n->tx_nb = 0;
+	n->tx_be = (n->reg[TXMCR] >> 3) & 0x03;
+	sim_csma(n);
+}
+
+/*
+ * Register side effects
+ */
+static unsigned char
+sim_reg_read(struct sim_node *n, int addr)
+{
+	unsigned char v = n->reg[addr];
+
+	switch (addr) {
+	case INTSTAT:
+		n->reg[INTSTAT] = 0;
+		break;
+	case BBREG6:
+		n->reg[BBREG6] &= ~RSSIRDY;
+		break;
+	}
+
+	return v;
+}
+
+static void
+sim_reg_write(struct sim_node *n, int addr, unsigned char v)
+{
+	switch (addr) {
+	case SOFTRST:
+		if (v & RSTMAC)
+			sim_chip_reset(n);
+		/* Reset bits clear themselves */
+		return;
+	case RXFLUSH:
+		if (v & _RXFLUSH)
+			n->rx_full = 0;
+		v &= ~_RXFLUSH;
+		break;
+	case TXNCON:
+		n->reg[TXNCON] = (v & ~TXNTRIG) | (n->reg[TXNCON] & FPSTAT);
+		if (v & TXNTRIG)
+			sim_tx_trigger(n);
+		return;
+	case WAKECON:
+		if ((v & REGWAKE) && n->sleeping) {
+			n->sleeping = 0;
+			sim_raise(n, WAKEIF);
+		}
+		break;
+	case SLPACK:
+		if (v & _SLPACK) {
+			n->sleeping = 1;
+			n->rx_from = (void *)0;
+		}
+		v &= ~_SLPACK;
+		break;
+	case BBREG6:
+		if (v & RSSIMODE1) {
+			n->mem[RSSI] = dbm_to_rssi(
+			    mw_to_dbm(sim_energy(n, (void *)0)));
+			v = (v & ~RSSIMODE1) | RSSIRDY;
+		}
+		break;
+	case INTCON:
+		n->reg[INTCON] = v;
+		sim_raise(n, 0);
+		return;
+	case RFCTL:
+		/* A frame being received is lost, e.g. on a channel change */
+		if (v & RFRST)
+			n->rx_from = (void *)0;
+		break;
+	case HSYMTMRH:
+		/* Counts down from the value written, HSYMTMRL first */
+		n->hsym_armed = 1;
+		n->hsym_at = n->sim->now +
+		    SIM_US(8) * (n->reg[HSYMTMRL] | (v << 8));
+		ev_push(n->sim, n->hsym_at, EV_HSYM, n, (void *)0, (void *)0);
+		break;
+	}
+
+	n->reg[addr] = v;
+}
+
+/*
+ * HAL backend
+ */
+static void
+sim_cs(void *ctx, int level)
+{
+	struct sim_node *n = ctx;
+
+	if (level == 0)
+		n->spi_n = 0;
+}
+
+static void
+sim_reset(void *ctx, int level)
+{
+	if (level == 0)
+		sim_chip_reset(ctx);
+}
+
+static void
+sim_wake(void *ctx, int level)
+{
+	struct sim_node *n = ctx;
+
+	if (level && n->sleeping && (n->reg[RXFLUSH] & WAKEPAD)) {
+		n->sleeping = 0;
+		sim_raise(n, WAKEIF);
+	}
+}
+
+static void
+sim_write(void *ctx, unsigned char v)
+{
+	struct sim_node *n = ctx;
+
+	switch (n->spi_n++) {
+	case 0:
+		n->spi_long = v & 0x80;
+		if (n->spi_long) {
+			n->spi_addr = (v & 0x7F) << 3;
+		} else {
+			n->spi_addr = (v >> 1) & 0x3F;
+			n->spi_write = v & 0x01;
+		}
+		return;
+	case 1:
+		if (n->spi_long) {
+			n->spi_addr |= v >> 5;
+			n->spi_write = v & 0x10;
+			return;
+		}
+		break;
+	}
+
+	if (!n->spi_write)
+		return;
+
+	/* Long addresses auto-increment on sequential access */
+	if (n->spi_long)
+		n->mem[n->spi_addr++ & 0x3FF] = v;
+	else
+		sim_reg_write(n, n->spi_addr, v);
+}
+
+static unsigned char
+sim_read(void *ctx)
+{
+	struct sim_node *n = ctx;
+
+	n->spi_n++;
+
+	if (n->spi_long)
+		return n->mem[n->spi_addr++ & 0x3FF];
+
+	return sim_reg_read(n, n->spi_addr);
+}
+
+static void
+sim_delay_us(void *ctx, unsigned int us)
+{
+}
+
+static int
+sim_wait_irq(void *ctx, int timeout_ms)
+{
+	struct sim_node *n = ctx;
+
+	return (n->reg[INTSTAT] & ~n->reg[INTCON]) != 0;
+}
+
+static unsigned long
+sim_timestamp(void *ctx)
+{
+	return sim_local_us(ctx);
+}
+
+static const struct hal_host_ops sim_ops = {
+	.cs = sim_cs,
+	.reset = sim_reset,
+	.wake = sim_wake,
+	.write = sim_write,
+	.read = sim_read,
+	.delay_us = sim_delay_us,
+	.wait_irq = sim_wait_irq,
+	.timestamp = sim_timestamp,
+};
+
+/*
+ * Public interface
+ */
+struct sim *
+sim_create(int nnodes, unsigned long seed)
+{
+	struct sim *sim;
+	int i;
+
+	sim = calloc(1, sizeof(*sim));
+	sim->nnodes = nnodes;
+	sim->nodes = calloc(nnodes, sizeof(*sim->nodes));
+	sim->links = calloc((size_t)nnodes * nnodes, sizeof(*sim->links));
+	sim->active = calloc(nnodes, sizeof(*sim->active));
+	sim->links_dirty = 1;
+	sim->rnd = seed ? seed : 1;
+
+	for (i = 0; i < nnodes; i++) {
+		sim->nodes[i].sim = sim;
+		sim->nodes[i].id = i;
+		sim->nodes[i].noise_mw = dbm_to_mw(SIM_NOISE_FLOOR);
+		sim_chip_reset(&sim->nodes[i]);
+	}
+
+	return sim;
+}
+
+void
+sim_destroy(struct sim *sim)
+{
+	free(sim->evq);
+	free(sim->active);
+	free(sim->links);
+	free(sim->nodes);
+	free(sim);
+}
+
+struct sim_node *
+sim_node(struct sim *sim, int id)
+{
+	return &sim->nodes[id];
+}
+
+int
+sim_node_id(struct sim_node *n)
+{
+	return n->id;
+}
+
+struct sim *
+sim_node_sim(struct sim_node *n)
+{
+	return n->sim;
+}
+
+/* Point the HAL and the driver at node n */
+void
+sim_select(struct sim_node *n)
+{
+	hal_host_bind(&sim_ops, n);
+	mrf24j40_bind(&n->drv);
+}
+
+/*
+ * Positions determine link gains through a log-distance path loss model;
+ * sim_link() overrides single links and must be called after the last
+ * position change.
+ */
+void
+sim_set_pos(struct sim_node *n, double x, double y)
+{
+	n->x = x;
+	n->y = y;
+	n->sim->links_dirty = 1;
+}
+
+/*
+ * Skew (parts per million, positive runs fast) and offset of n's local
+ * clock, which the HAL reports for frame timestamps.
+ */
+void
+sim_set_clock(struct sim_node *n, double ppm, double offset_us)
+{
+	n->clk_ppm = ppm;
+	n->clk_offset = offset_us;
+}
+
+unsigned long
+sim_local_us(struct sim_node *n)
+{
+	double us = n->sim->now / 1000.0;
+
+	return (unsigned long)(us * (1.0 + n->clk_ppm * 1e-6) +
+	    n->clk_offset);
+}
+
+/* Background noise (e.g. from machinery) at n, not below the floor */
+void
+sim_set_noise(struct sim_node *n, int dbm)
+{
+	n->noise_mw = dbm_to_mw((dbm < SIM_NOISE_FLOOR) ?
+	    SIM_NOISE_FLOOR : dbm);
+}
+
+void
+sim_link(struct sim *sim, int from, int to, int rssi_dbm, int loss_pct)
+{
+	struct sim_link *l;
+
+	if (sim->links_dirty)
+		sim_update_links(sim);
+
+	l = &sim->links[from * sim->nnodes + to];
+	l->gain = rssi_dbm;
+	l->loss = loss_pct;
+}
+
+void
+sim_set_irq(struct sim_node *n, sim_cb fn, void *arg)
+{
+	n->irq_fn = fn;
+	n->irq_arg = arg;
+}
+
+void
+sim_timer(struct sim_node *n, sim_time_t delay, sim_cb fn, void *arg)
+{
+	ev_push(n->sim, n->sim->now + delay, EV_TIMER, n, fn, arg);
+}
+
+sim_time_t
+sim_now(struct sim *sim)
+{
+	return sim->now;
+}
+
+void
+sim_run(struct sim *sim, sim_time_t until)
+{
+	struct sim_node *n;
+	struct sim_ev ev;
+
+	if (sim->links_dirty)
+		sim_update_links(sim);
+
+	while (sim->nev > 0 && sim->evq[0].t <= until) {
+		ev_pop(sim, &ev);
+		sim->now = ev.t;
+		n = ev.n;
+
+		switch (ev.type) {
+		case EV_CCA:
+			if (ev.gen == n->tx_gen)
+				sim_ev_cca(n);
+			break;
+		case EV_TX_START:
+			if (ev.gen == n->tx_gen)
+				sim_tx_start(n);
+			break;
+		case EV_TX_END:
+			sim_tx_end(n);
+			break;
+		case EV_ACK_TIMEOUT:
+			if (ev.gen == n->tx_gen)
+				sim_ack_timeout(n);
+			break;
+		case EV_IRQ:
+			n->irq_sched = 0;
+			if (n->reg[INTSTAT] & ~n->reg[INTCON]) {
+				sim_select(n);
+				n->irq_fn(n, n->irq_arg);
+			}
+			break;
+		case EV_TIMER:
+			sim_select(n);
+			ev.fn(n, ev.arg);
+			break;
+		case EV_HSYM:
+			if (n->hsym_armed && n->hsym_at == ev.t) {
+				n->hsym_armed = 0;
+				sim_raise(n, HSYMTMRIF);
+			}
+			break;
+		}
+	}
+
+	sim->now = until;
+}
+
+/* Inspect a register or memory location without going through SPI */
+unsigned char
+sim_peek(struct sim_node *n, int addr, int is_long)
+{
+	return is_long ? n->mem[addr & 0x3FF] : n->reg[addr & 0x3F];
+}
+
+void
+sim_get_stats(struct sim *sim, struct sim_stats *st)
+{
+	*st = sim->stats;
+}
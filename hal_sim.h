@@ -0,0 +1,96 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _HAL_SIM_H_
+#define _HAL_SIM_H_
+
+#include "hal_host.h"
+#include "MRF24J40.h"
+
+/*
+ * Simulated MRF24J40 radios on a shared RF medium.
+ *
+ * Every node models the chip's SPI interface, register file and FIFOs,
+ * so the unmodified driver (built with MRF24J40_HAL_HOST and
+ * MRF24J40_MULTI) runs on each of them. The medium is a discrete event
+ * simulation that models airtime at 250 kbps or turbo rate, unslotted
+ * CSMA-CA with the TXMCR parameters, CCA against BBREG2/CCAEDTH,
+ * interference and collisions (SINR based), hardware ACKs with the
+ * ACKTMOUT wait duration, retries, per-link loss and RSSI,
+ * background noise per node, the half symbol timer (HSYMTMRIF) and a
+ * skewed local clock per node for timestamps.
+ *
+ * The simulation is single threaded: application code runs in interrupt
+ * and timer callbacks, with the node's HAL and driver state bound
+ * already. Delays requested through the HAL do not advance time.
+ */
+
+typedef unsigned long long sim_time_t;		/* nanoseconds */
+
+#define SIM_US(x)		((sim_time_t)(x) * 1000)
+#define SIM_MS(x)		((sim_time_t)(x) * 1000000)
+#define SIM_SEC(x)		((sim_time_t)(x) * 1000000000)
+
+#define SIM_SENSITIVITY		-95	/* dBm */
+#define SIM_NOISE_FLOOR		-100	/* dBm */
+#define SIM_CAPTURE_DB		3	/* SINR needed to decode a frame */
+
+struct sim;
+struct sim_node;
+
+typedef void (*sim_cb)(struct sim_node *n, void *arg);
+
+struct sim_stats {
+	unsigned long	tx_frames;	/* data/command transmissions */
+	unsigned long	tx_acks;
+	unsigned long	rx_frames;	/* frames put into an RXFIFO */
+	unsigned long	rx_overflows;	/* RXFIFO still held a frame */
+	unsigned long	collisions;	/* receptions lost to interference,
+					   at any node in range */
+	unsigned long	link_losses;	/* receptions lost to link loss */
+	unsigned long	cca_busy;	/* CCA found the channel busy */
+};
+
+struct sim *sim_create(int nnodes, unsigned long seed);
+void sim_destroy(struct sim *sim);
+struct sim_node *sim_node(struct sim *sim, int id);
+int sim_node_id(struct sim_node *n);
+struct sim *sim_node_sim(struct sim_node *n);
+void sim_select(struct sim_node *n);
+
+void sim_set_pos(struct sim_node *n, double x, double y);
+void sim_link(struct sim *sim, int from, int to, int rssi_dbm, int loss_pct);
+void sim_set_noise(struct sim_node *n, int dbm);
+void sim_set_clock(struct sim_node *n, double ppm, double offset_us);
+unsigned long sim_local_us(struct sim_node *n);
+
+void sim_set_irq(struct sim_node *n, sim_cb fn, void *arg);
+void sim_timer(struct sim_node *n, sim_time_t delay, sim_cb fn, void *arg);
+
+sim_time_t sim_now(struct sim *sim);
+unsigned long sim_random(struct sim *sim);
+void sim_run(struct sim *sim, sim_time_t until);
+
+unsigned char sim_peek(struct sim_node *n, int addr, int is_long);
+void sim_get_stats(struct sim *sim, struct sim_stats *st);
+
+#endif /* _HAL_SIM_H_ */
@@ -0,0 +1,322 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "hal_trace.h"
+
+static unsigned long
+hal_trace_now(struct hal_trace *t)
+{
+	if (t->ops->timestamp == (void *)0)
+		return 0;
+
+	return t->ops->timestamp(t->ctx);
+}
+
+static void
+hal_trace_put(struct hal_trace *t, unsigned char v)
+{
+	t->buf[t->head] = v;
+	if (++t->head == t->size)
+		t->head = 0;
+}
+
+/*
+ * Starts a record with len bytes of payload, dropping the oldest records
+ * to make room. Returns -1 if the record cannot be stored at all.
+ */
+static int
+hal_trace_rec(struct hal_trace *t, int type, int len, unsigned long when)
+{
+	unsigned long dt;
+	unsigned int n = HAL_TRACE_HDR + len;
+
+	if (n > t->size) {
+		t->dropped++;
+		return -1;
+	}
+
+	while (t->size - t->used < n) {
+		n = HAL_TRACE_HDR + t->buf[(t->tail + 1) % t->size];
+		t->tail = (t->tail + n) % t->size;
+		t->used -= n;
+		t->dropped++;
+		n = HAL_TRACE_HDR + len;
+	}
+
+	dt = when - t->last;
+	if (dt > 0xFFFF)
+		dt = 0xFFFF;
+	t->last = when;
+
+	hal_trace_put(t, type);
+	hal_trace_put(t, len);
+	hal_trace_put(t, dt & 0xFF);
+	hal_trace_put(t, dt >> 8);
+	t->used += n;
+	t->records++;
+
+	return 0;
+}
+
+static void
+hal_trace_cs(void *ctx, int level)
+{
+	struct hal_trace *t = ctx;
+
+	t->ops->cs(t->ctx, level);
+	if (hal_trace_rec(t, HAL_TRACE_CS, 1, hal_trace_now(t)) == 0)
+		hal_trace_put(t, level);
+}
+
+static void
+hal_trace_reset(void *ctx, int level)
+{
+	struct hal_trace *t = ctx;
+
+	if (t->ops->reset != (void *)0)
+		t->ops->reset(t->ctx, level);
+}
+
+static void
+hal_trace_wake(void *ctx, int level)
+{
+	struct hal_trace *t = ctx;
+
+	if (t->ops->wake != (void *)0)
+		t->ops->wake(t->ctx, level);
+}
+
+static void
+hal_trace_write(void *ctx, unsigned char v)
+{
+	struct hal_trace *t = ctx;
+
+	t->ops->write(t->ctx, v);
+	if (hal_trace_rec(t, HAL_TRACE_WRITE, 1, hal_trace_now(t)) == 0)
+		hal_trace_put(t, v);
+}
+
+static unsigned char
+hal_trace_read(void *ctx)
+{
+	struct hal_trace *t = ctx;
+	unsigned char v;
+
+	v = t->ops->read(t->ctx);
+	if (hal_trace_rec(t, HAL_TRACE_READ, 1, hal_trace_now(t)) == 0)
+		hal_trace_put(t, v);
+
+	return v;
+}
+
+static void
+hal_trace_delay_us(void *ctx, unsigned int us)
+{
+	struct hal_trace *t = ctx;
+
+	t->ops->delay_us(t->ctx, us);
+}
+
+static void
+hal_trace_xfer(void *ctx, unsigned char *a, int alen, unsigned char *d,
+    int dlen, int rd)
+{
+	struct hal_trace *t = ctx;
+	unsigned long start, dur;
+	int i;
+
+	start = hal_trace_now(t);
+	if (t->ops->xfer != (void *)0) {
+		t->ops->xfer(t->ctx, a, alen, d, dlen, rd);
+	} else {
+		t->ops->cs(t->ctx, 0);
+		for (i = 0; i < alen; i++)
+			t->ops->write(t->ctx, a[i]);
+		for (i = 0; i < dlen; i++) {
+			if (rd)
+				d[i] = t->ops->read(t->ctx);
+			else
+				t->ops->write(t->ctx, d[i]);
+		}
+		t->ops->cs(t->ctx, 1);
+	}
+	dur = hal_trace_now(t) - start;
+	if (dur > 0xFFFF)
+		dur = 0xFFFF;
+
+	if (hal_trace_rec(t, HAL_TRACE_XFER, 3 + alen + dlen, start) != 0)
+		return;
+
+	hal_trace_put(t, dur & 0xFF);
+	hal_trace_put(t, dur >> 8);
+	hal_trace_put(t, alen | (rd ? HAL_TRACE_XFER_RD : 0));
+	for (i = 0; i < alen; i++)
+		hal_trace_put(t, a[i]);
+	for (i = 0; i < dlen; i++)
+		hal_trace_put(t, d[i]);
+}
+
+static int
+hal_trace_wait_irq(void *ctx, int timeout_ms)
+{
+	struct hal_trace *t = ctx;
+
+	return t->ops->wait_irq(t->ctx, timeout_ms);
+}
+
+static unsigned long
+hal_trace_timestamp(void *ctx)
+{
+	return hal_trace_now(ctx);
+}
+
+static void
+hal_trace_fn_enter(void *ctx, const char *fn)
+{
+	struct hal_trace *t = ctx;
+	int i;
+
+	if (t->ops->fn_enter != (void *)0)
+		t->ops->fn_enter(t->ctx, fn);
+
+	if (t->depth++ > 0)
+		return;
+
+	/* Names are string constants, the pointer identifies them */
+	for (i = 0; i < t->nnames && t->names[i] != fn; i++)
+		;
+	if (i == t->nnames && i < HAL_TRACE_NAMES)
+		t->names[t->nnames++] = fn;
+	if (i == HAL_TRACE_NAMES)
+		i = 0xFF;
+
+	if (hal_trace_rec(t, HAL_TRACE_ENTER, 1, hal_trace_now(t)) == 0)
+		hal_trace_put(t, i);
+}
+
+static void
+hal_trace_fn_leave(void *ctx)
+{
+	struct hal_trace *t = ctx;
+
+	if (t->ops->fn_leave != (void *)0)
+		t->ops->fn_leave(t->ctx);
+
+	if (t->depth > 0 && --t->depth == 0)
+		hal_trace_rec(t, HAL_TRACE_LEAVE, 0, hal_trace_now(t));
+}
+
+const struct hal_host_ops hal_trace_ops = {
+	.cs = hal_trace_cs,
+	.reset = hal_trace_reset,
+	.wake = hal_trace_wake,
+	.write = hal_trace_write,
+	.read = hal_trace_read,
+	.delay_us = hal_trace_delay_us,
+	.xfer = hal_trace_xfer,
+	.wait_irq = hal_trace_wait_irq,
+	.timestamp = hal_trace_timestamp,
+	.fn_enter = hal_trace_fn_enter,
+	.fn_leave = hal_trace_fn_leave,
+};
+
+void
+hal_trace_init(struct hal_trace *t, unsigned char *buf, unsigned int size)
+{
+	memset(t, 0, sizeof(*t));
+	t->buf = buf;
+	t->size = size;
+}
+
+/*
+ * Interpose on the backend bound to the calling thread. Tracing can be
+ * started and stopped repeatedly; the records accumulate.
+ */
+void
+hal_trace_start(struct hal_trace *t)
+{
+	hal_host_bound(&t->ops, &t->ctx);
+	hal_host_bind(&hal_trace_ops, t);
+	if (t->records == 0)
+		t->last = hal_trace_now(t);
+}
+
+void
+hal_trace_stop(struct hal_trace *t)
+{
+	hal_host_bind(t->ops, t->ctx);
+}
+
+void
+hal_trace_clear(struct hal_trace *t)
+{
+	t->head = t->tail = t->used = 0;
+	t->records = t->dropped = 0;
+}
+
+static void
+hal_trace_put32(FILE *f, unsigned long v)
+{
+	fputc(v & 0xFF, f);
+	fputc((v >> 8) & 0xFF, f);
+	fputc((v >> 16) & 0xFF, f);
+	fputc((v >> 24) & 0xFF, f);
+}
+
+/*
+ * File layout: magic, version, number of names, the names (length byte
+ * and characters), dropped records (32 bits), ring length (32 bits) and
+ * the records, oldest first.
+ */
+int
+hal_trace_save(struct hal_trace *t, const char *path)
+{
+	FILE *f;
+	unsigned int i;
+	int n, err;
+
+	if ((f = fopen(path, "wb")) == (void *)0)
+		return -1;
+
+	fwrite(HAL_TRACE_MAGIC, 1, 4, f);
+	fputc(HAL_TRACE_VERSION, f);
+	fputc(t->nnames, f);
+	for (n = 0; n < t->nnames; n++) {
+		fputc(strlen(t->names[n]), f);
+		fputs(t->names[n], f);
+	}
+
+	hal_trace_put32(f, t->dropped);
+	hal_trace_put32(f, t->used);
+	for (i = 0; i < t->used; i++)
+		fputc(t->buf[(t->tail + i) % t->size], f);
+
+	err = ferror(f);
+	if (fclose(f) != 0 || err)
+		return -1;
+
+	return 0;
+}
@@ -0,0 +1,86 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef _HAL_TRACE_H_
+#define _HAL_TRACE_H_
+
+#include "hal_host.h"
+
+/*
+ * SPI trace recorder for hal_host. hal_trace_start() wraps the backend
+ * currently bound: every CS edge, byte and transfer is passed through
+ * to it and recorded, with timestamps from the backend, into a ring of
+ * variable size records. The driver calls the accesses were made from
+ * (MRF24J40_TRACE_FN) are recorded as well when it is built with
+ * -DHAL_TRACE; only the outermost one, so e.g. the resets done by
+ * mrf24j40_init() count towards it.
+ *
+ * When the ring is full the oldest records are dropped. hal_trace_save()
+ * writes the ring to a file for tools/trace_replay.c.
+ *
+ * Record layout: type, payload length, time since the previous record
+ * in microseconds (16 bits, saturated), payload. Multi-byte fields are
+ * little endian.
+ */
+
+#define HAL_TRACE_HDR		4
+#define HAL_TRACE_NAMES		64
+#define HAL_TRACE_MAGIC		"MRFT"
+#define HAL_TRACE_VERSION	1
+
+/* Record types and their payload */
+#define HAL_TRACE_CS		1	/* level */
+#define HAL_TRACE_WRITE		2	/* byte */
+#define HAL_TRACE_READ		3	/* byte */
+#define HAL_TRACE_XFER		4	/* duration us (16), alen | rd << 7,
+					   address, data */
+#define HAL_TRACE_ENTER		5	/* name index */
+#define HAL_TRACE_LEAVE		6	/* - */
+
+#define HAL_TRACE_XFER_RD	0x80
+
+struct hal_trace {
+	const struct hal_host_ops *ops;	/* wrapped backend */
+	void		*ctx;
+	unsigned char	*buf;
+	unsigned int	size;
+	unsigned int	head;		/* next byte to write */
+	unsigned int	tail;		/* oldest record */
+	unsigned int	used;
+	unsigned long	last;		/* time of the last record */
+	unsigned long	records;
+	unsigned long	dropped;	/* overwritten or too large */
+	int		depth;		/* driver call nesting */
+	int		nnames;
+	const char	*names[HAL_TRACE_NAMES];
+};
+
+extern const struct hal_host_ops hal_trace_ops;
+
+void hal_trace_init(struct hal_trace *t, unsigned char *buf, unsigned int size);
+void hal_trace_start(struct hal_trace *t);
+void hal_trace_stop(struct hal_trace *t);
+void hal_trace_clear(struct hal_trace *t);
+int hal_trace_save(struct hal_trace *t, const char *path);
+
+#endif /* _HAL_TRACE_H_ */
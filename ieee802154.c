@@ -0,0 +1,114 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "MRF24J40.h"
+#include "ieee802154.h"
+
+static int
+addr_len(unsigned char mode)
+{
+	if (mode == FCADDR_SHORT)
+		return 2;
+	if (mode == FCADDR_EXT)
+		return 8;
+	return 0;
+}
+
+static unsigned char *
+parse_addr(unsigned char *p, struct ieee802154_addr *a)
+{
+	unsigned char i;
+
+	a->short_addr = IEEE802154_BCAST;
+
+	if (a->mode == FCADDR_SHORT) {
+		a->short_addr = p[0] | (p[1] << 8);
+		p += 2;
+	} else if (a->mode == FCADDR_EXT) {
+		for (i = 0; i < 8; i++)
+			a->ext[i] = *p++;
+	}
+
+	return p;
+}
+
+/*
+ * Parse the MAC header of the frame f of len bytes, not counting the FCS.
+ * For a buffer filled by mrf24j40_rxpkt_intcb() that is
+ *
+ *   ieee802154_parse(buf + 1, buf[0] - 2, &fr);
+ *
+ * Returns 0, or EIO if the frame is truncated or uses a reserved
+ * addressing mode.
+ */
+int
+ieee802154_parse(unsigned char *f, int len, struct ieee802154_frame *fr)
+{
+	unsigned char *p;
+	int hlen;
+
+	if (len < 3)
+		return EIO;
+
+	fr->fc_low = f[0];
+	fr->fc_high = f[1];
+	fr->seq = f[2];
+	fr->dst.mode = (f[1] >> 2) & 0x03;
+	fr->src.mode = (f[1] >> 6) & 0x03;
+
+	if (fr->dst.mode == 0x01 || fr->src.mode == 0x01)
+		return EIO;
+
+	hlen = 3;
+	if (fr->dst.mode != FCADDR_NONE)
+		hlen += 2 + addr_len(fr->dst.mode);
+	if (fr->src.mode != FCADDR_NONE) {
+		hlen += addr_len(fr->src.mode);
+		if (!(fr->fc_low & FCPANCOMP) || fr->dst.mode == FCADDR_NONE)
+			hlen += 2;
+	}
+
+	if (hlen > len)
+		return EIO;
+
+	p = f + 3;
+	fr->dst.pan = IEEE802154_BCAST;
+	if (fr->dst.mode != FCADDR_NONE) {
+		fr->dst.pan = p[0] | (p[1] << 8);
+		p = parse_addr(p + 2, &fr->dst);
+	}
+
+	fr->src.pan = fr->dst.pan;
+	if (fr->src.mode != FCADDR_NONE) {
+		if (!(fr->fc_low & FCPANCOMP) || fr->dst.mode == FCADDR_NONE) {
+			fr->src.pan = p[0] | (p[1] << 8);
+			p += 2;
+		}
+		p = parse_addr(p, &fr->src);
+	}
+
+	fr->payload = p;
+	fr->payload_len = len - hlen;
+
+	return 0;
+}
@@ -20,6 +20,9 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#ifndef _IEEE802154_H_
+#define _IEEE802154_H_
+
 struct ieee802_15_4_MAChdr {
 	unsigned char fc_low;
 	unsigned char fc_high;
@@ -53,3 +56,32 @@ struct ieee802_15_4_MAChdr {
 #define FCSADDRM(x) ((x & 0x03) << 6)	/* Bit 14-15 */
 
 /* http://www.libelium.com/development/articles/091811814228 */
+
+/* Broadcast short address and PAN */
+#define IEEE802154_BCAST	0xFFFF
+
+struct ieee802154_addr {
+	unsigned char	mode;		/* FCADDR_* */
+	unsigned short	pan;
+	unsigned short	short_addr;
+	unsigned char	ext[8];		/* as on air, least significant first */
+};
+
+/*
+ * A received frame, split up by ieee802154_parse(). payload points into
+ * the frame that was parsed. A security auxiliary header, if any, is
+ * left at the start of the payload.
+ */
+struct ieee802154_frame {
+	unsigned char	fc_low;
+	unsigned char	fc_high;
+	unsigned char	seq;
+	struct ieee802154_addr dst;
+	struct ieee802154_addr src;
+	unsigned char	*payload;
+	int		payload_len;
+};
+
+int ieee802154_parse(unsigned char *f, int len, struct ieee802154_frame *fr);
+
+#endif /* _IEEE802154_H_ */
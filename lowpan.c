@@ -0,0 +1,513 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include "MRF24J40.h"
+#include "lowpan.h"
+
+/* IPHC, first byte */
+#define IPHC_TF(x)	(((x) & 0x03) << 3)
+#define IPHC_NH		(1 << 2)
+#define IPHC_HLIM(x)	((x) & 0x03)
+
+/* IPHC, second byte */
+#define IPHC_CID	(1 << 7)
+#define IPHC_SAC	(1 << 6)
+#define IPHC_SAM(x)	(((x) & 0x03) << 4)
+#define IPHC_M		(1 << 3)
+#define IPHC_DAC	(1 << 2)
+#define IPHC_DAM(x)	((x) & 0x03)
+
+/* UDP NHC */
+#define NHC_UDP		0xF0
+#define NHC_UDP_MASK	0xF8
+#define NHC_UDP_C	(1 << 2)
+#define NHC_UDP_P(x)	((x) & 0x03)
+
+/* Address forms, for SAM and DAM */
+#define AM_FULL		0
+#define AM_64		1
+#define AM_16		2
+#define AM_ELIDED	3
+
+/* Source address of our own frames, as sent by mrf24j40_txpkt */
+void
+lowpan_local_addr(struct ieee802154_addr *a)
+{
+	struct mrf24j40_config cfg;
+
+	mrf24j40_get_config(&cfg);
+	lowpan_short_addr(a, cfg.pan, cfg.short_addr);
+}
+
+void
+lowpan_short_addr(struct ieee802154_addr *a, unsigned short pan,
+    unsigned short addr)
+{
+	a->mode = FCADDR_SHORT;
+	a->pan = pan;
+	a->short_addr = addr;
+}
+
+static int
+is_zero(unsigned char *p, int n)
+{
+	while (n-- > 0) {
+		if (*p++ != 0)
+			return 0;
+	}
+
+	return 1;
+}
+
+/* Interface identifier of a MAC address; 0 if there is none */
+static int
+mac_iid(struct ieee802154_addr *mac, unsigned char *iid)
+{
+	unsigned char i;
+
+	if (mac->mode == FCADDR_SHORT) {
+		/* 0000:00ff:fe00:XXXX */
+		memset(iid, 0, 8);
+		iid[3] = 0xFF;
+		iid[4] = 0xFE;
+		iid[6] = mac->short_addr >> 8;
+		iid[7] = mac->short_addr & 0xFF;
+		return 1;
+	}
+
+	if (mac->mode == FCADDR_EXT) {
+		/* EUI-64, with the universal/local bit inverted */
+		for (i = 0; i < 8; i++)
+			iid[i] = mac->ext[7 - i];
+		iid[0] ^= 0x02;
+		return 1;
+	}
+
+	return 0;
+}
+
+static int
+is_link_local(unsigned char *a)
+{
+	return (a[0] == 0xFE && a[1] == 0x80 && is_zero(a + 2, 6));
+}
+
+static int
+is_short_iid(unsigned char *iid)
+{
+	return (is_zero(iid, 3) && iid[3] == 0xFF && iid[4] == 0xFE &&
+	    iid[5] == 0);
+}
+
+/* Address form for a unicast address; inline bytes are its tail */
+static unsigned char
+ucast_mode(unsigned char *a, struct ieee802154_addr *mac, int *n)
+{
+	unsigned char iid[8];
+
+	if (!is_link_local(a)) {
+		*n = 16;
+		return AM_FULL;
+	}
+
+	if (mac_iid(mac, iid) && memcmp(a + 8, iid, 8) == 0) {
+		*n = 0;
+		return AM_ELIDED;
+	}
+
+	if (is_short_iid(a + 8)) {
+		*n = 2;
+		return AM_16;
+	}
+
+	*n = 8;
+	return AM_64;
+}
+
+/* Address form for a multicast address */
+static unsigned char
+mcast_mode(unsigned char *a)
+{
+	if (a[1] == 0x02 && is_zero(a + 2, 13))
+		return 3;	/* ff02::00XX */
+	if (is_zero(a + 2, 11))
+		return 2;	/* ffXX::00XX:XXXX */
+	if (is_zero(a + 2, 9))
+		return 1;	/* ffXX::00XX:XXXX:XXXX */
+	return 0;
+}
+
+/*
+ * Compress the IPv6 packet of len bytes at p in place. Returns the new
+ * length, or 0 if p does not hold a well-formed IPv6 packet.
+ */
+int
+lowpan_compress(unsigned char *p, int len, struct ieee802154_addr *src,
+    struct ieee802154_addr *dst)
+{
+	unsigned char iphc0, iphc1, tc, ecn, dscp, fl[3], nh, hlim, m;
+	unsigned char udp[8];
+	int w, r, n, is_udp;
+
+	if (len < LOWPAN_IPV6_HDR_LEN || (p[0] >> 4) != 6 ||
+	    ((p[4] << 8) | p[5]) != len - LOWPAN_IPV6_HDR_LEN)
+		return 0;
+
+	/*
+	 * Fields are read up front; the compressed header is written over
+	 * the start of the original one. The addresses are moved down only
+	 * after everything in front of them has been written, which never
+	 * reaches past their original position.
+	 */
+	tc = (p[0] << 4) | (p[1] >> 4);
+	dscp = tc >> 2;
+	ecn = tc & 0x03;
+	fl[0] = p[1] & 0x0F;
+	fl[1] = p[2];
+	fl[2] = p[3];
+	nh = p[6];
+	hlim = p[7];
+
+	is_udp = (nh == LOWPAN_PROTO_UDP &&
+	    len >= LOWPAN_IPV6_HDR_LEN + LOWPAN_UDP_HDR_LEN);
+	if (is_udp)
+		memcpy(udp, p + LOWPAN_IPV6_HDR_LEN, sizeof(udp));
+
+	iphc0 = LOWPAN_IPHC_DISPATCH;
+	iphc1 = 0;
+	w = 2;
+
+	/* Traffic class and flow label; ECN goes first */
+	if (fl[0] == 0 && fl[1] == 0 && fl[2] == 0) {
+		if (tc == 0) {
+			iphc0 |= IPHC_TF(3);
+		} else {
+			iphc0 |= IPHC_TF(2);
+			p[w++] = (ecn << 6) | dscp;
+		}
+	} else if (dscp == 0) {
+		iphc0 |= IPHC_TF(1);
+		p[w++] = (ecn << 6) | fl[0];
+		p[w++] = fl[1];
+		p[w++] = fl[2];
+	} else {
+		p[w++] = (ecn << 6) | dscp;
+		p[w++] = fl[0];
+		p[w++] = fl[1];
+		p[w++] = fl[2];
+	}
+
+	if (is_udp)
+		iphc0 |= IPHC_NH;
+	else
+		p[w++] = nh;
+
+	if (hlim == 1)
+		iphc0 |= IPHC_HLIM(1);
+	else if (hlim == 64)
+		iphc0 |= IPHC_HLIM(2);
+	else if (hlim == 255)
+		iphc0 |= IPHC_HLIM(3);
+	else
+		p[w++] = hlim;
+
+	/* Source address; :: is sent as SAC=1, SAM=0 */
+	if (is_zero(p + 8, 16)) {
+		iphc1 |= IPHC_SAC;
+	} else {
+		iphc1 |= IPHC_SAM(ucast_mode(p + 8, src, &n));
+		memmove(p + w, p + 8 + 16 - n, n);
+		w += n;
+	}
+
+	/* Destination address */
+	if (p[24] == 0xFF) {
+		iphc1 |= IPHC_M;
+		m = mcast_mode(p + 24);
+		iphc1 |= IPHC_DAM(m);
+		switch (m) {
+		case 3:
+			p[w++] = p[24 + 15];
+			break;
+		case 2:
+			p[w++] = p[24 + 1];
+			memmove(p + w, p + 24 + 13, 3);
+			w += 3;
+			break;
+		case 1:
+			p[w++] = p[24 + 1];
+			memmove(p + w, p + 24 + 11, 5);
+			w += 5;
+			break;
+		default:
+			memmove(p + w, p + 24, 16);
+			w += 16;
+		}
+	} else {
+		iphc1 |= IPHC_DAM(ucast_mode(p + 24, dst, &n));
+		memmove(p + w, p + 24 + 16 - n, n);
+		w += n;
+	}
+
+	r = LOWPAN_IPV6_HDR_LEN;
+
+	/* UDP; the length is elided, the checksum kept */
+	if (is_udp) {
+		if ((udp[0] == 0xF0 && (udp[1] & 0xF0) == 0xB0) &&
+		    (udp[2] == 0xF0 && (udp[3] & 0xF0) == 0xB0)) {
+			p[w++] = NHC_UDP | NHC_UDP_P(3);
+			p[w++] = (udp[1] << 4) | (udp[3] & 0x0F);
+		} else if (udp[2] == 0xF0) {
+			p[w++] = NHC_UDP | NHC_UDP_P(1);
+			p[w++] = udp[0];
+			p[w++] = udp[1];
+			p[w++] = udp[3];
+		} else if (udp[0] == 0xF0) {
+			p[w++] = NHC_UDP | NHC_UDP_P(2);
+			p[w++] = udp[1];
+			p[w++] = udp[2];
+			p[w++] = udp[3];
+		} else {
+			p[w++] = NHC_UDP;
+			memcpy(p + w, udp, 4);
+			w += 4;
+		}
+		p[w++] = udp[6];
+		p[w++] = udp[7];
+		r += LOWPAN_UDP_HDR_LEN;
+	}
+
+	p[0] = iphc0;
+	p[1] = iphc1;
+
+	memmove(p + w, p + r, len - r);
+	return w + len - r;
+}
+
+/* Inline address bytes; r is the read position, -1 on a short packet */
+static int
+take(unsigned char *d, unsigned char *p, int len, int r, int n)
+{
+	if (r < 0 || r + n > len)
+		return -1;
+
+	memcpy(d, p + r, n);
+	return r + n;
+}
+
+static int
+ucast_expand(unsigned char *a, unsigned char mode,
+    struct ieee802154_addr *mac, unsigned char *p, int len, int r)
+{
+	if (mode == AM_FULL)
+		return take(a, p, len, r, 16);
+
+	memset(a, 0, 16);
+	a[0] = 0xFE;
+	a[1] = 0x80;
+
+	switch (mode) {
+	case AM_64:
+		return take(a + 8, p, len, r, 8);
+	case AM_16:
+		a[11] = 0xFF;
+		a[12] = 0xFE;
+		return take(a + 14, p, len, r, 2);
+	default:
+		return mac_iid(mac, a + 8) ? r : -1;
+	}
+}
+
+static int
+mcast_expand(unsigned char *a, unsigned char mode, unsigned char *p,
+    int len, int r)
+{
+	if (mode == 0)
+		return take(a, p, len, r, 16);
+
+	memset(a, 0, 16);
+	a[0] = 0xFF;
+
+	switch (mode) {
+	case 3:
+		a[1] = 0x02;
+		return take(a + 15, p, len, r, 1);
+	case 2:
+		r = take(a + 1, p, len, r, 1);
+		return take(a + 13, p, len, r, 3);
+	default:
+		r = take(a + 1, p, len, r, 1);
+		return take(a + 11, p, len, r, 5);
+	}
+}
+
+/*
+ * Decompress the 6LoWPAN packet of len bytes at p, in a buffer of size
+ * bytes, in place. src and dst are the MAC addresses of the frame(s) it
+ * came in. dgram_size is 0 if p holds the whole packet; for the payload
+ * of a FRAG1 it is the fragment header's datagram size, which the IPv6
+ * and UDP lengths follow from. Returns the length of the decompressed
+ * bytes, or 0 if the packet is not IPHC or uncompressed IPv6, is
+ * malformed, uses compression contexts or does not fit.
+ */
+int
+lowpan_decompress(unsigned char *p, int len, int size, int dgram_size,
+    struct ieee802154_addr *src, struct ieee802154_addr *dst)
+{
+	unsigned char hdr[LOWPAN_IPV6_HDR_LEN + LOWPAN_UDP_HDR_LEN];
+	unsigned char iphc0, iphc1, b[4], nhc, tc;
+	int r, hlen, plen, total;
+
+	if (len < 2)
+		return 0;
+
+	if (p[0] == LOWPAN_IPV6_DISPATCH) {
+		memmove(p, p + 1, len - 1);
+		return len - 1;
+	}
+
+	if ((p[0] & LOWPAN_IPHC_MASK) != LOWPAN_IPHC_DISPATCH)
+		return 0;
+
+	iphc0 = p[0];
+	iphc1 = p[1];
+	if (iphc1 & (IPHC_CID | IPHC_DAC))
+		return 0;
+
+	memset(hdr, 0, sizeof(hdr));
+	memset(b, 0, sizeof(b));
+	r = 2;
+
+	/* Traffic class (ECN first on air) and flow label */
+	switch ((iphc0 >> 3) & 0x03) {
+	case 0:
+		r = take(b, p, len, r, 4);
+		break;
+	case 1:
+		r = take(b + 1, p, len, r, 3);
+		b[0] = b[1] & 0xC0;
+		b[1] &= 0x0F;
+		break;
+	case 2:
+		r = take(b, p, len, r, 1);
+		break;
+	}
+	if (r < 0)
+		return 0;
+
+	tc = (b[0] << 2) | (b[0] >> 6);
+	hdr[0] = 0x60 | (tc >> 4);
+	hdr[1] = (tc << 4) | (b[1] & 0x0F);
+	hdr[2] = b[2];
+	hdr[3] = b[3];
+
+	if (iphc0 & IPHC_NH)
+		hdr[6] = LOWPAN_PROTO_UDP;
+	else
+		r = take(&hdr[6], p, len, r, 1);
+
+	switch (iphc0 & 0x03) {
+	case 0:
+		r = take(&hdr[7], p, len, r, 1);
+		break;
+	case 1:
+		hdr[7] = 1;
+		break;
+	case 2:
+		hdr[7] = 64;
+		break;
+	default:
+		hdr[7] = 255;
+	}
+
+	/* Source address */
+	if (iphc1 & IPHC_SAC) {
+		if (iphc1 & IPHC_SAM(3))
+			return 0;
+	} else {
+		r = ucast_expand(hdr + 8, (iphc1 >> 4) & 0x03, src, p, len, r);
+	}
+
+	/* Destination address */
+	if (iphc1 & IPHC_M)
+		r = mcast_expand(hdr + 24, iphc1 & 0x03, p, len, r);
+	else
+		r = ucast_expand(hdr + 24, iphc1 & 0x03, dst, p, len, r);
+
+	hlen = LOWPAN_IPV6_HDR_LEN;
+
+	if (iphc0 & IPHC_NH) {
+		r = take(&nhc, p, len, r, 1);
+		if (r < 0 || (nhc & NHC_UDP_MASK) != NHC_UDP ||
+		    (nhc & NHC_UDP_C))
+			return 0;
+
+		switch (NHC_UDP_P(nhc)) {
+		case 0:
+			r = take(hdr + 40, p, len, r, 4);
+			break;
+		case 1:
+			r = take(hdr + 40, p, len, r, 2);
+			hdr[42] = 0xF0;
+			r = take(hdr + 43, p, len, r, 1);
+			break;
+		case 2:
+			hdr[40] = 0xF0;
+			r = take(hdr + 41, p, len, r, 2);
+			r = take(hdr + 43, p, len, r, 1);
+			break;
+		default:
+			r = take(b, p, len, r, 1);
+			hdr[40] = hdr[42] = 0xF0;
+			hdr[41] = 0xB0 | (b[0] >> 4);
+			hdr[43] = 0xB0 | (b[0] & 0x0F);
+		}
+		r = take(hdr + 46, p, len, r, 2);
+		hlen += LOWPAN_UDP_HDR_LEN;
+	}
+
+	if (r < 0)
+		return 0;
+
+	plen = len - r;
+	total = hlen + plen;
+	if (total > size || (dgram_size != 0 && total > dgram_size))
+		return 0;
+	if (dgram_size == 0)
+		dgram_size = total;
+
+	/* Payload length, and the UDP length which is the same */
+	hdr[4] = (dgram_size - LOWPAN_IPV6_HDR_LEN) >> 8;
+	hdr[5] = (dgram_size - LOWPAN_IPV6_HDR_LEN) & 0xFF;
+	if (hlen > LOWPAN_IPV6_HDR_LEN) {
+		hdr[44] = hdr[4];
+		hdr[45] = hdr[5];
+	}
+
+	memmove(p + hlen, p + r, plen);
+	memcpy(p, hdr, hlen);
+
+	return total;
+}
@@ -0,0 +1,65 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef _LOWPAN_H_
+#define _LOWPAN_H_
+
+#include "ieee802154.h"
+
+/*
+ * 6LoWPAN IPv6 header compression (RFC 6282): IPHC for the IPv6 header
+ * and NHC for UDP. Both directions work in place on the frame payload.
+ *
+ * Addresses are compressed statelessly (no contexts): link-local unicast
+ * addresses whose interface identifier follows from the MAC address of
+ * the frame are elided entirely, the others are shortened as far as
+ * their form allows, and multicast addresses use the 8/32/48 bit forms.
+ * The UDP checksum is always carried. IPv6 extension headers are not
+ * compressed; they follow the IPHC header inline.
+ *
+ * Fragmented packets follow RFC 4944/6282: the fragment headers give
+ * the size and offsets of the uncompressed IPv6 packet, and only the
+ * first fragment carries the IPHC header. The sender compresses the
+ * whole packet and passes its uncompressed length to frag_tx_start();
+ * the receiver passes lowpan_decompress() to frag_rx_init(), which then
+ * expands each FRAG1 on arrival (the elided lengths follow from the
+ * datagram size) and hands out the reassembled IPv6 packet. Packets
+ * that fit into one frame are decompressed by the application.
+ */
+#define LOWPAN_IPHC_DISPATCH	0x60	/* 011x xxxx */
+#define LOWPAN_IPHC_MASK	0xE0
+#define LOWPAN_IPV6_DISPATCH	0x41	/* uncompressed IPv6 */
+
+#define LOWPAN_IPV6_HDR_LEN	40
+#define LOWPAN_UDP_HDR_LEN	8
+#define LOWPAN_PROTO_UDP	17
+
+void lowpan_local_addr(struct ieee802154_addr *a);
+void lowpan_short_addr(struct ieee802154_addr *a, unsigned short pan,
+    unsigned short addr);
+int lowpan_compress(unsigned char *p, int len, struct ieee802154_addr *src,
+    struct ieee802154_addr *dst);
+int lowpan_decompress(unsigned char *p, int len, int size, int dgram_size,
+    struct ieee802154_addr *src, struct ieee802154_addr *dst);
+
+#endif /* _LOWPAN_H_ */
@@ -0,0 +1,195 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include "nbr.h"
+
+#define NBR_NONE	0xFF
+
+#define NBR_BUCKET(a)	(((a) ^ ((a) >> 7)) & (NBR_HASH - 1))
+
+/* Move avg towards sample, both scaled by NBR_ONE */
+static unsigned short
+nbr_ewma(unsigned short avg, unsigned short sample, int shift)
+{
+	return avg + (((int)sample - (int)avg) >> shift);
+}
+
+void
+nbr_init(struct nbr_table *t)
+{
+	int i;
+
+	memset(t, 0, sizeof(*t));
+	memset(t->hash, NBR_NONE, sizeof(t->hash));
+
+	/* All slots unused, on the update list in any order */
+	for (i = 0; i < NBR_SLOTS; i++) {
+		t->n[i].prev = (i == 0) ? NBR_NONE : i - 1;
+		t->n[i].next = (i == NBR_SLOTS - 1) ? NBR_NONE : i + 1;
+	}
+	t->head = 0;
+	t->tail = NBR_SLOTS - 1;
+}
+
+struct nbr *
+nbr_lookup(struct nbr_table *t, unsigned short addr)
+{
+	unsigned char i;
+
+	for (i = t->hash[NBR_BUCKET(addr)]; i != NBR_NONE; i = t->n[i].hnext)
+		if (t->n[i].addr == addr)
+			return &t->n[i];
+
+	return (void *)0;
+}
+
+static void
+nbr_unlink(struct nbr_table *t, unsigned char i)
+{
+	struct nbr *n = &t->n[i];
+
+	if (n->prev != NBR_NONE)
+		t->n[n->prev].next = n->next;
+	else
+		t->head = n->next;
+
+	if (n->next != NBR_NONE)
+		t->n[n->next].prev = n->prev;
+	else
+		t->tail = n->prev;
+}
+
+static void
+nbr_hash_remove(struct nbr_table *t, unsigned char i)
+{
+	unsigned char *p = &t->hash[NBR_BUCKET(t->n[i].addr)];
+
+	while (*p != i)
+		p = &t->n[*p].hnext;
+	*p = t->n[i].hnext;
+}
+
+/* Find or create the entry for addr and make it the most recent one */
+static struct nbr *
+nbr_get(struct nbr_table *t, unsigned short addr)
+{
+	struct nbr *n = nbr_lookup(t, addr);
+	unsigned char i, b;
+
+	if (n != (void *)0) {
+		i = n - t->n;
+	} else {
+		/* Take the least recently updated slot */
+		i = t->tail;
+		n = &t->n[i];
+		if (n->used) {
+			nbr_hash_remove(t, i);
+			++t->stats.evictions;
+		}
+		++t->stats.inserts;
+
+		n->addr = addr;
+		n->lqi = n->rssi = n->etx = 0;
+		n->seen = t->now;
+		n->txpower = n->tx_run = 0;
+		n->used = 1;
+
+		b = NBR_BUCKET(addr);
+		n->hnext = t->hash[b];
+		t->hash[b] = i;
+	}
+
+	if (t->head != i) {
+		nbr_unlink(t, i);
+		n->prev = NBR_NONE;
+		n->next = t->head;
+		t->n[t->head].prev = i;
+		t->head = i;
+	}
+
+	return n;
+}
+
+/* Account a frame from addr, with LQI and RSSI as read with it */
+struct nbr *
+nbr_rx(struct nbr_table *t, unsigned short addr, unsigned char lqi,
+    unsigned char rssi)
+{
+	struct nbr *n = nbr_get(t, addr);
+
+	if (n->lqi == 0 && n->rssi == 0) {
+		n->lqi = lqi * NBR_ONE;
+		n->rssi = rssi * NBR_ONE;
+	} else {
+		n->lqi = nbr_ewma(n->lqi, lqi * NBR_ONE, NBR_RX_SHIFT);
+		n->rssi = nbr_ewma(n->rssi, rssi * NBR_ONE, NBR_RX_SHIFT);
+	}
+	n->seen = t->now;
+	++t->stats.rx_updates;
+
+	return n;
+}
+
+/*
+ * Account the end of a transmission to addr, with the results of
+ * mrf24j40_txpkt_intcb() and mrf24j40_txpkt_retries(). A frame that
+ * failed CCA never went out and leaves ETX alone.
+ */
+struct nbr *
+nbr_tx(struct nbr_table *t, unsigned short addr, int retries, int err)
+{
+	struct nbr *n = nbr_get(t, addr);
+	unsigned short sample;
+
+	if (err == EBUSY)
+		return n;
+
+	if (err) {
+		sample = NBR_ETX_FAIL;
+	} else {
+		sample = (retries + 1) * NBR_ONE;
+		n->seen = t->now;
+	}
+
+	n->etx = (n->etx == 0) ? sample :
+	    nbr_ewma(n->etx, sample, NBR_ETX_SHIFT);
+	++t->stats.tx_updates;
+
+	return n;
+}
+
+/* Advance the clock; call it at a fixed interval */
+void
+nbr_tick(struct nbr_table *t)
+{
+	++t->now;
+}
+
+/* Ticks since n was last heard from or acknowledged a frame */
+unsigned short
+nbr_age(struct nbr_table *t, struct nbr *n)
+{
+	return t->now - n->seen;
+}
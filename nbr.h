@@ -0,0 +1,105 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef _NBR_H_
+#define _NBR_H_
+
+#include "MRF24J40.h"
+
+/*
+ * Neighbor table with per-link quality estimates.
+ *
+ * For every neighbor (by short address) the table keeps exponentially
+ * weighted moving averages of LQI and RSSI of the frames heard from it,
+ * the expected transmission count (ETX) of frames sent to it, derived
+ * from the hardware retry count and failures, and the tick it was last
+ * heard from or acknowledged a frame. Ticks are counted by nbr_tick().
+ *
+ * Entries are found through a hash of the address and kept on a list
+ * ordered by the last update; when the table is full, a new neighbor
+ * replaces the least recently updated one. Update and lookup take
+ * constant time, memory is fixed at NBR_SLOTS entries.
+ *
+ * LQI, RSSI (raw RSSI register scale, see the datasheet for the dBm
+ * mapping) and ETX are kept scaled by NBR_ONE.
+ */
+#ifndef NBR_SLOTS
+#define NBR_SLOTS	16	/* at most 255 */
+#endif
+
+#ifndef NBR_HASH
+#define NBR_HASH	16	/* buckets, a power of two */
+#endif
+
+#define NBR_ONE		16
+
+/* EWMA weights, 1 / 2^shift */
+#define NBR_RX_SHIFT	3
+#define NBR_ETX_SHIFT	2
+
+/* ETX sample for a frame that was never acknowledged */
+#define NBR_ETX_FAIL	(8 * NBR_ONE)
+
+#define NBR_LQI(n)	((n)->lqi / NBR_ONE)
+#define NBR_RSSI(n)	((n)->rssi / NBR_ONE)
+
+struct nbr {
+	unsigned short	addr;
+	unsigned short	lqi;
+	unsigned short	rssi;
+	unsigned short	etx;		/* 0 until the first transmission */
+	unsigned short	seen;		/* tick */
+	unsigned char	txpower;	/* level chosen by tpc.c */
+	unsigned char	tx_run;		/* frames ACKed first time in a row */
+	unsigned char	used;
+	unsigned char	hnext;		/* hash chain */
+	unsigned char	prev;		/* update order */
+	unsigned char	next;
+};
+
+struct nbr_stats {
+	unsigned short	rx_updates;
+	unsigned short	tx_updates;
+	unsigned short	inserts;
+	unsigned short	evictions;
+};
+
+struct nbr_table {
+	struct nbr	n[NBR_SLOTS];
+	unsigned char	hash[NBR_HASH];
+	unsigned char	head;		/* most recently updated */
+	unsigned char	tail;		/* least recently updated, or unused */
+	unsigned short	now;
+	struct nbr_stats stats;
+};
+
+void nbr_init(struct nbr_table *t);
+struct nbr *nbr_lookup(struct nbr_table *t, unsigned short addr);
+struct nbr *nbr_rx(struct nbr_table *t, unsigned short addr,
+    unsigned char lqi, unsigned char rssi);
+struct nbr *nbr_tx(struct nbr_table *t, unsigned short addr, int retries,
+    int err);
+void nbr_tick(struct nbr_table *t);
+unsigned short nbr_age(struct nbr_table *t, struct nbr *n);
+
+#endif /* _NBR_H_ */
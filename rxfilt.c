@@ -0,0 +1,299 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include "ieee802154.h"
+#include "rxfilt.h"
+
+#define RXFILT_EMPTY	0xFFFFFFFFUL	/* PAN 0xFFFF is never an entry */
+
+#define KEY(pan, addr)	(((unsigned long)(pan) << 16) | (addr))
+
+/* 32 bit mix (MurmurHash3 finalizer) */
+static unsigned long
+rxfilt_hash(unsigned long k)
+{
+	k ^= k >> 16;
+	k = (k * 0x85EBCA6BUL) & 0xFFFFFFFFUL;
+	k ^= k >> 13;
+	k = (k * 0xC2B2AE35UL) & 0xFFFFFFFFUL;
+	k ^= k >> 16;
+
+	return k;
+}
+
+#define BLOOM_SET(f, b)	((f)->bloom[(b) >> 3] |= 1 << ((b) & 7))
+#define BLOOM_GET(f, b)	((f)->bloom[(b) >> 3] & (1 << ((b) & 7)))
+
+static int
+pow2(unsigned int n)
+{
+	return (n != 0 && (n & (n - 1)) == 0);
+}
+
+/*
+ * Caller-allocated storage for up to max entries: keys[max],
+ * slots[nslots] and bloom[nbloom]. Returns EIO if the sizes do not
+ * fit, see rxfilt.h. All frame types pass until rxfilt_set_types().
+ */
+int
+rxfilt_init(struct rxfilt *f, unsigned long *keys, int max,
+    unsigned long *slots, unsigned int nslots, unsigned char *bloom,
+    unsigned int nbloom)
+{
+	if (!pow2(nslots) || nslots < 2 * (unsigned int)max ||
+	    nslots - 1 > 0xFFFF || !pow2(nbloom) || nbloom > 8192)
+		return EIO;
+
+	memset(f, 0, sizeof(*f));
+	f->keys = keys;
+	f->max = max;
+	f->slots = slots;
+	f->slot_mask = nslots - 1;
+	f->bloom = bloom;
+	f->bloom_mask = nbloom * 8 - 1;
+	f->types = 0xFF;
+
+	rxfilt_commit(f);
+
+	return 0;
+}
+
+/* Index of the first key not below k */
+static int
+rxfilt_find(struct rxfilt *f, unsigned long k)
+{
+	int lo = 0, hi = f->nkeys, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) >> 1;
+		if (f->keys[mid] < k)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* Returns ENOMEM if the table is full, EIO for PAN 0xFFFF */
+int
+rxfilt_add(struct rxfilt *f, unsigned short pan, unsigned short addr)
+{
+	unsigned long k = KEY(pan, addr);
+	int i;
+
+	if (pan == IEEE802154_BCAST)
+		return EIO;
+
+	i = rxfilt_find(f, k);
+	if (i < f->nkeys && f->keys[i] == k)
+		return 0;
+	if (f->nkeys == f->max)
+		return ENOMEM;
+
+	memmove(&f->keys[i + 1], &f->keys[i],
+	    (f->nkeys - i) * sizeof(f->keys[0]));
+	f->keys[i] = k;
+	f->nkeys++;
+
+	return 0;
+}
+
+/* Returns ENOENT if there is no such entry */
+int
+rxfilt_del(struct rxfilt *f, unsigned short pan, unsigned short addr)
+{
+	unsigned long k = KEY(pan, addr);
+	int i;
+
+	i = rxfilt_find(f, k);
+	if (i == f->nkeys || f->keys[i] != k)
+		return ENOENT;
+
+	f->nkeys--;
+	memmove(&f->keys[i], &f->keys[i + 1],
+	    (f->nkeys - i) * sizeof(f->keys[0]));
+
+	return 0;
+}
+
+void
+rxfilt_clear(struct rxfilt *f)
+{
+	f->nkeys = 0;
+}
+
+/* types is a mask of RXFILT_TYPE() bits, flags of RXFILT_F_* */
+void
+rxfilt_set_types(struct rxfilt *f, int types, int flags)
+{
+	f->types = types;
+	f->flags = flags;
+}
+
+void
+rxfilt_commit(struct rxfilt *f)
+{
+	unsigned long h, i;
+	unsigned int s;
+
+	for (i = 0; i <= f->slot_mask; i++)
+		f->slots[i] = RXFILT_EMPTY;
+	memset(f->bloom, 0, (f->bloom_mask >> 3) + 1);
+
+	for (i = 0; i < (unsigned long)f->nkeys; i++) {
+		h = rxfilt_hash(f->keys[i]);
+
+		BLOOM_SET(f, h & f->bloom_mask);
+		BLOOM_SET(f, (h >> 16) & f->bloom_mask);
+
+		for (s = h & f->slot_mask; f->slots[s] != RXFILT_EMPTY;
+		    s = (s + 1) & f->slot_mask)
+			;
+		f->slots[s] = f->keys[i];
+	}
+}
+
+static int
+rxfilt_lookup(const struct rxfilt *f, unsigned long k)
+{
+	unsigned long h = rxfilt_hash(k);
+	unsigned int s;
+
+	if (!BLOOM_GET(f, h & f->bloom_mask) ||
+	    !BLOOM_GET(f, (h >> 16) & f->bloom_mask))
+		return 0;
+
+	/* At most half full, so a probe ends at an empty slot */
+	for (s = h & f->slot_mask; f->slots[s] != RXFILT_EMPTY;
+	    s = (s + 1) & f->slot_mask) {
+		if (f->slots[s] == k)
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Bloom filter test only: 0 if (pan, addr) is certainly not an entry */
+int
+rxfilt_maybe(const struct rxfilt *f, unsigned short pan, unsigned short addr)
+{
+	unsigned long h = rxfilt_hash(KEY(pan, addr));
+
+	return (BLOOM_GET(f, h & f->bloom_mask) &&
+	    BLOOM_GET(f, (h >> 16) & f->bloom_mask));
+}
+
+int
+rxfilt_has(const struct rxfilt *f, unsigned short pan, unsigned short addr)
+{
+	return rxfilt_lookup(f, KEY(pan, addr));
+}
+
+/*
+ * Decide on a frame from its first len bytes, starting at the frame
+ * control field; RXFILT_HDR_LEN are enough. Returns 1 if it passes.
+ */
+int
+rxfilt_match(const struct rxfilt *f, const unsigned char *hdr, int len)
+{
+	unsigned short pan, addr;
+	int dmode, smode;
+
+	if (len < 2 || !(f->types & RXFILT_TYPE(FCFRTYP(hdr[0]))))
+		return 0;
+
+	dmode = (hdr[1] >> 2) & 0x03;
+	smode = (hdr[1] >> 6) & 0x03;
+	if (dmode == 0x01 || smode == 0x01)
+		return 0;
+
+	if (dmode == FCADDR_NONE && smode == FCADDR_NONE)
+		return 1;
+
+	/* Destination PAN, or the source PAN if there is no destination */
+	if (len < 5)
+		return 0;
+	pan = hdr[3] | (hdr[4] << 8);
+
+	if (dmode != FCADDR_SHORT)
+		return rxfilt_lookup(f, KEY(pan, RXFILT_ANY));
+
+	if (len < 7)
+		return 0;
+	addr = hdr[5] | (hdr[6] << 8);
+
+	if (addr == IEEE802154_BCAST && (f->flags & RXFILT_F_BCAST))
+		return 1;
+	if (pan == IEEE802154_BCAST)
+		return 0;
+
+	return (rxfilt_lookup(f, KEY(pan, addr)) ||
+	    rxfilt_lookup(f, KEY(pan, RXFILT_ANY)));
+}
+
+#ifndef MRF24J40_NO_PART_RX
+/*
+ * Receive the frame at the head of the RXFIFO if it passes the filter,
+ * like mrf24j40_rxpkt_intcb(): d[0] is the length, the frame follows,
+ * so d holds len + 1 bytes. Otherwise only its header is read and the
+ * frame is flushed; returns ENOENT then, or ENOMEM if it is longer than
+ * len. The header is read aside, so d is not written past len either
+ * way.
+ */
+int
+rxfilt_rx(const struct rxfilt *f, unsigned char *d, int len,
+    unsigned char *plqi, unsigned char *prssi)
+{
+	struct mrf24j40_rx_cursor c;
+	unsigned char hdr[RXFILT_HDR_LEN];
+	int flen, n;
+
+	flen = mrf24j40_rx_open(&c);
+	n = mrf24j40_rx_read(&c, hdr, RXFILT_HDR_LEN);
+
+	if (!rxfilt_match(f, hdr, (n < flen - 2) ? n : flen - 2)) {
+		mrf24j40_rx_close(&c);
+		return ENOENT;
+	}
+	if (flen > len) {
+		mrf24j40_rx_close(&c);
+		return ENOMEM;
+	}
+
+	d[0] = flen;
+	memcpy(d + 1, hdr, n);
+	mrf24j40_rx_read(&c, d + 1 + n, flen - n);
+
+	if (plqi != (void *)0)
+		*plqi = c.lqi;
+	if (prssi != (void *)0)
+		*prssi = c.rssi;
+
+	mrf24j40_rx_close(&c);
+
+	return 0;
+}
+#endif
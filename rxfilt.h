@@ -0,0 +1,97 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef _RXFILT_H_
+#define _RXFILT_H_
+
+#include "MRF24J40.h"
+
+#ifndef ENOENT
+#define ENOENT			2
+#endif
+
+/*
+ * Software address filter for promiscuous reception.
+ *
+ * In promiscuous mode (mrf24j40_set_promiscuous) the chip passes on
+ * every frame. The filter decides from the first RXFILT_HDR_LEN bytes
+ * of a frame whether it is wanted, so rxfilt_rx() can read just those
+ * from the RXFIFO and flush the frame without reading the rest.
+ *
+ * A frame passes if its type is in the type mask and its destination
+ * is in the table: the (PAN, short address) pair, or the PAN with
+ * RXFILT_ANY as the address, which stands for all of it. Frames to an
+ * extended address are matched by PAN only, frames without destination
+ * by their source PAN, and broadcasts (address 0xFFFF) pass with
+ * RXFILT_F_BCAST, otherwise they need a RXFILT_ANY entry. Frames with
+ * no addresses at all (ACKs) are matched by type only.
+ *
+ * The entries are kept sorted in the keys array; rxfilt_commit()
+ * rebuilds an open addressing hash table (nslots, a power of two of at
+ * least twice max) and a Bloom filter of 2 bits per entry (nbloom
+ * bytes, a power of two; 1 per entry gives about 5% false positives)
+ * from them, so a lookup is a Bloom test that turns away most misses,
+ * then a short probe. Changes take effect with the commit; the table
+ * must not be used by a receiving thread meanwhile.
+ */
+#define RXFILT_HDR_LEN		7	/* fc, seq, PAN, short address */
+#define RXFILT_ANY		0xFFFF
+
+#define RXFILT_F_BCAST		0x01
+
+#define RXFILT_TYPE(t)		(1 << (t))	/* FCFRTYP_* */
+
+struct rxfilt {
+	unsigned long	*keys;		/* sorted, PAN << 16 | address */
+	int		nkeys;
+	int		max;
+
+	unsigned long	*slots;
+	unsigned short	slot_mask;
+	unsigned char	*bloom;
+	unsigned short	bloom_mask;	/* in bits */
+
+	unsigned char	types;
+	unsigned char	flags;
+};
+
+int rxfilt_init(struct rxfilt *f, unsigned long *keys, int max,
+    unsigned long *slots, unsigned int nslots, unsigned char *bloom,
+    unsigned int nbloom);
+int rxfilt_add(struct rxfilt *f, unsigned short pan, unsigned short addr);
+int rxfilt_del(struct rxfilt *f, unsigned short pan, unsigned short addr);
+void rxfilt_clear(struct rxfilt *f);
+void rxfilt_set_types(struct rxfilt *f, int types, int flags);
+void rxfilt_commit(struct rxfilt *f);
+
+int rxfilt_maybe(const struct rxfilt *f, unsigned short pan,
+    unsigned short addr);
+int rxfilt_has(const struct rxfilt *f, unsigned short pan,
+    unsigned short addr);
+int rxfilt_match(const struct rxfilt *f, const unsigned char *hdr, int len);
+#ifndef MRF24J40_NO_PART_RX
+int rxfilt_rx(const struct rxfilt *f, unsigned char *d, int len,
+    unsigned char *plqi, unsigned char *prssi);
+#endif
+
+#endif /* _RXFILT_H_ */
@@ -0,0 +1,275 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include "scan.h"
+
+void
+scan_init(struct scan *s, struct scan_result *res, int max)
+{
+	memset(s, 0, sizeof(*s));
+	s->res = res;
+	s->max = max;
+}
+
+static void
+scan_request(struct scan *s)
+{
+	unsigned char hdr[7], cmd = SCAN_CMD_BEACON_REQ;
+	struct mrf24j40_iov iov[2];
+
+	hdr[0] = FCFRTYP_MCMD;
+	hdr[1] = FCDADDRM(FCADDR_SHORT);
+	hdr[2] = s->seq++;
+	hdr[3] = hdr[4] = 0xFF;
+	hdr[5] = hdr[6] = 0xFF;
+
+	iov[0].base = hdr;
+	iov[0].len = sizeof(hdr);
+	iov[1].base = &cmd;
+	iov[1].len = 1;
+
+	mrf24j40_txpkt_iov(iov, 2, 1, 0);
+	++s->stats.requests;
+}
+
+/* Move to the next channel in the mask; returns 0 if there is none */
+static int
+scan_next(struct scan *s)
+{
+	unsigned char ch;
+
+	for (ch = 11; ch <= 26; ch++) {
+		if (s->channels & (1UL << ch))
+			break;
+	}
+	if (ch > 26)
+		return 0;
+
+	s->channels &= ~(1UL << ch);
+	s->ch = ch;
+	s->left = s->dwell;
+
+	mrf24j40_set_channel(ch);
+	if (s->flags & SCAN_F_ACTIVE)
+		scan_request(s);
+
+	return 1;
+}
+
+static void
+scan_done(struct scan *s)
+{
+	s->ch = 0;
+	s->channels = 0;
+
+	if (!(s->flags & SCAN_F_ALL_FRAMES))
+		mrf24j40_set_rx_filter(s->cfg.rxflush);
+	/* cfg.channel is 0 for channel 11 */
+	mrf24j40_set_channel(11 + s->cfg.channel);
+	if (s->cfg.set & MRF24J40_CFG_PAN)
+		mrf24j40_set_pan(s->cfg.pan);
+}
+
+/*
+ * Start a scan of the channels set in the mask (bit n for channel n,
+ * SCAN_CHANNELS_ALL for 11 - 26), dwell ticks each. The result table
+ * is cleared. Returns EIO if no channel is selected, EBUSY if a scan
+ * is running already.
+ */
+int
+scan_start(struct scan *s, unsigned long channels, unsigned short dwell,
+    int flags)
+{
+	if (s->ch != 0)
+		return EBUSY;
+
+	channels &= SCAN_CHANNELS_ALL;
+	if (channels == 0)
+		return EIO;
+
+	mrf24j40_get_config(&s->cfg);
+
+	s->n = 0;
+	s->channels = channels;
+	s->dwell = dwell ? dwell : 1;
+	s->flags = flags;
+
+	mrf24j40_set_pan(IEEE802154_BCAST);
+	if (!(flags & SCAN_F_ALL_FRAMES))
+		mrf24j40_set_rx_filter(BCNONLY);
+
+	scan_next(s);
+
+	return 0;
+}
+
+/*
+ * Call it at a fixed interval while scanning, with no transmission in
+ * flight across the end of a dwell. Returns 1 once the scan is over,
+ * with the radio's configuration restored.
+ */
+int
+scan_tick(struct scan *s)
+{
+	if (s->ch == 0)
+		return 1;
+
+	if (--s->left > 0)
+		return 0;
+
+	if (scan_next(s))
+		return 0;
+
+	scan_done(s);
+	return 1;
+}
+
+void
+scan_abort(struct scan *s)
+{
+	if (s->ch != 0)
+		scan_done(s);
+}
+
+int
+scan_running(struct scan *s)
+{
+	return (s->ch != 0);
+}
+
+static int
+scan_same(struct scan_result *r, struct ieee802154_addr *a)
+{
+	if (r->coord.mode != a->mode || r->coord.pan != a->pan)
+		return 0;
+	if (a->mode == FCADDR_EXT)
+		return (memcmp(r->coord.ext, a->ext, 8) == 0);
+	return (r->coord.short_addr == a->short_addr);
+}
+
+/*
+ * Hand a received frame to the scan. Beacons are recorded, or their
+ * entry updated; returns 1 for a beacon, 0 for anything else.
+ */
+int
+scan_input(struct scan *s, struct ieee802154_frame *fr, unsigned char lqi,
+    unsigned char rssi)
+{
+	struct scan_result *r;
+	int i;
+
+	if (s->ch == 0)
+		return 0;
+
+	if (FCFRTYP(fr->fc_low) != FCFRTYP_BEACON ||
+	    fr->src.mode == FCADDR_NONE || fr->payload_len < 2) {
+		++s->stats.other;
+		return 0;
+	}
+
+	++s->stats.beacons;
+
+	for (i = 0, r = s->res; i < s->n; i++, r++) {
+		if (r->channel == s->ch && scan_same(r, &fr->src))
+			break;
+	}
+
+	if (i == s->n) {
+		if (s->n == s->max) {
+			++s->stats.full;
+			return 1;
+		}
+		++s->n;
+		r->channel = s->ch;
+		r->coord = fr->src;
+		r->lqi = 0;
+	}
+
+	r->superframe = fr->payload[0] | (fr->payload[1] << 8);
+	if (lqi >= r->lqi) {
+		r->lqi = lqi;
+		r->rssi = rssi;
+	}
+
+	return 1;
+}
+
+/* Index of the result with the best LQI, -1 if there is none */
+int
+scan_best(struct scan *s)
+{
+	int i, best = -1;
+
+	for (i = 0; i < s->n; i++) {
+		if (best < 0 || s->res[i].lqi > s->res[best].lqi)
+			best = i;
+	}
+
+	return best;
+}
+
+int
+scan_is_beacon_req(struct ieee802154_frame *fr)
+{
+	return (FCFRTYP(fr->fc_low) == FCFRTYP_MCMD &&
+	    fr->payload_len >= 1 && fr->payload[0] == SCAN_CMD_BEACON_REQ);
+}
+
+/*
+ * Send a beacon of the configured PAN and short address, with no GTS
+ * and no pending addresses, followed by len bytes of beacon payload.
+ */
+void
+scan_beacon(unsigned char bsn, unsigned short superframe,
+    unsigned char *payload, int len)
+{
+	struct mrf24j40_config cfg;
+	unsigned char hdr[7], sf[4];
+	struct mrf24j40_iov iov[3];
+
+	mrf24j40_get_config(&cfg);
+
+	hdr[0] = FCFRTYP_BEACON;
+	hdr[1] = FCSADDRM(FCADDR_SHORT);
+	hdr[2] = bsn;
+	hdr[3] = cfg.pan & 0xFF;
+	hdr[4] = cfg.pan >> 8;
+	hdr[5] = cfg.short_addr & 0xFF;
+	hdr[6] = cfg.short_addr >> 8;
+
+	sf[0] = superframe & 0xFF;
+	sf[1] = superframe >> 8;
+	sf[2] = 0;			/* GTS specification */
+	sf[3] = 0;			/* pending addresses */
+
+	iov[0].base = hdr;
+	iov[0].len = sizeof(hdr);
+	iov[1].base = sf;
+	iov[1].len = sizeof(sf);
+	iov[2].base = payload;
+	iov[2].len = len;
+
+	mrf24j40_txpkt_iov(iov, len > 0 ? 3 : 2, 1, 0);
+}
@@ -0,0 +1,108 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef _SCAN_H_
+#define _SCAN_H_
+
+#include "MRF24J40.h"
+#include "ieee802154.h"
+
+/*
+ * Beacon scan for network discovery.
+ *
+ * scan_start() walks the channels in a mask, lowest first, staying
+ * dwell ticks (scan_tick) on each. In an active scan a beacon request
+ * (MAC command 0x07, to PAN and address 0xFFFF) goes out on arrival at
+ * a channel; a passive scan only listens. Meanwhile the RX filter is
+ * set to beacons only (BCNONLY), so the application's receive path is
+ * handed nothing else, and the PAN ID is 0xFFFF as the beacon filter
+ * of the chip requires. Both are restored at the end, as is the
+ * channel; the PAN ID only if it was set with mrf24j40_set_pan().
+ *
+ * Received frames go to scan_input(), which records every distinct
+ * (channel, PAN, coordinator) with the best LQI and RSSI seen.
+ *
+ * The MRF24J40 does not answer beacon requests by itself; coordinators
+ * check their received frames with scan_is_beacon_req() and answer
+ * with scan_beacon().
+ */
+#define SCAN_F_ACTIVE		0x01	/* send beacon requests */
+#define SCAN_F_ALL_FRAMES	0x02	/* leave the RX filter alone */
+
+#define SCAN_CMD_BEACON_REQ	0x07
+
+/* Superframe specification of a non-beacon enabled PAN coordinator */
+#define SCAN_SF_NONBEACON	0xCFFF	/* BO = SO = 15, final CAP slot
+					   15, PAN coordinator, association
+					   permit */
+
+#define SCAN_CHANNELS_ALL	0x07FFF800UL	/* 11 - 26 */
+
+struct scan_result {
+	unsigned char	channel;	/* 11 - 26 */
+	unsigned char	lqi;
+	unsigned char	rssi;
+	unsigned short	superframe;
+	struct ieee802154_addr coord;	/* with the PAN ID */
+};
+
+struct scan_stats {
+	unsigned short	requests;
+	unsigned short	beacons;
+	unsigned short	other;		/* non-beacon frames handed in */
+	unsigned short	full;		/* beacons not recorded, no room */
+};
+
+struct scan {
+	struct scan_result *res;
+	int		max;
+	int		n;
+
+	unsigned long	channels;	/* still to visit */
+	unsigned char	flags;
+	unsigned char	ch;		/* current, 0 when idle */
+	unsigned char	seq;
+	unsigned short	dwell;
+	unsigned short	left;
+
+	/* Restored at the end */
+	struct mrf24j40_config cfg;
+
+	struct scan_stats stats;
+};
+
+void scan_init(struct scan *s, struct scan_result *res, int max);
+int scan_start(struct scan *s, unsigned long channels, unsigned short dwell,
+    int flags);
+int scan_tick(struct scan *s);
+void scan_abort(struct scan *s);
+int scan_running(struct scan *s);
+int scan_input(struct scan *s, struct ieee802154_frame *fr, unsigned char lqi,
+    unsigned char rssi);
+int scan_best(struct scan *s);
+
+int scan_is_beacon_req(struct ieee802154_frame *fr);
+void scan_beacon(unsigned char bsn, unsigned short superframe,
+    unsigned char *payload, int len);
+
+#endif /* _SCAN_H_ */
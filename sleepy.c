@@ -0,0 +1,220 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include "sleepy.h"
+
+/*
+ * The coordinator has the short address coord in this node's PAN.
+ * Intervals are in ticks of sleepy_tick(), min at least 1.
+ */
+void
+sleepy_init(struct sleepy *s, unsigned short coord, unsigned short min,
+    unsigned short max, unsigned short rx_wait, int flags)
+{
+	memset(s, 0, sizeof(*s));
+
+	s->coord = coord;
+	s->flags = flags;
+	s->min = min ? min : 1;
+	s->max = (max > s->min) ? max : s->min;
+	s->interval = s->min;
+	s->rx_wait = rx_wait ? rx_wait : 1;
+}
+
+static void
+sleepy_request(struct sleepy *s)
+{
+	struct mrf24j40_config cfg;
+	unsigned char hdr[9], cmd = SLEEPY_CMD_DATA_REQ;
+	struct mrf24j40_iov iov[2];
+
+	mrf24j40_get_config(&cfg);
+
+	hdr[0] = FCFRTYP_MCMD | FCREQACK | FCPANCOMP;
+	hdr[1] = FCDADDRM(FCADDR_SHORT) | FCSADDRM(FCADDR_SHORT);
+	hdr[2] = s->seq++;
+	hdr[3] = cfg.pan & 0xFF;
+	hdr[4] = cfg.pan >> 8;
+	hdr[5] = s->coord & 0xFF;
+	hdr[6] = s->coord >> 8;
+	hdr[7] = cfg.short_addr & 0xFF;
+	hdr[8] = cfg.short_addr >> 8;
+
+	iov[0].base = hdr;
+	iov[0].len = sizeof(hdr);
+	iov[1].base = &cmd;
+	iov[1].len = 1;
+
+	s->state = SLEEPY_REQ;
+	s->left = SLEEPY_TX_WAIT;
+	++s->stats.polls;
+
+	mrf24j40_txpkt_iov(iov, 2, 1, 0);
+}
+
+/* Adapt the interval to what the wakeup brought and go to sleep */
+static void
+sleepy_finish(struct sleepy *s)
+{
+	unsigned short step;
+
+	if (s->got > 0) {
+		s->interval >>= 1;
+		if (s->interval < s->min)
+			s->interval = s->min;
+	} else {
+		step = (s->interval >> 2) + 1;
+		if (s->max - s->interval < step)
+			s->interval = s->max;
+		else
+			s->interval += step;
+	}
+
+	s->state = SLEEPY_SLEEP;
+	s->left = s->interval;
+	mrf24j40_sleep(s->flags & SLEEPY_F_SPI_WAKE);
+}
+
+/* Put the radio to sleep until the first poll, min ticks away */
+void
+sleepy_start(struct sleepy *s)
+{
+	s->state = SLEEPY_SLEEP;
+	s->left = s->interval;
+	mrf24j40_sleep(s->flags & SLEEPY_F_SPI_WAKE);
+}
+
+/* Call it at a fixed interval */
+void
+sleepy_tick(struct sleepy *s)
+{
+	if (--s->left > 0)
+		return;
+
+	switch (s->state) {
+	case SLEEPY_SLEEP:
+		sleepy_poll_now(s);
+		break;
+	case SLEEPY_REQ:
+		/* TX completion lost */
+		++s->stats.fails;
+		sleepy_finish(s);
+		break;
+	case SLEEPY_RX:
+		if (s->got == 0)
+			++s->stats.empty;
+		sleepy_finish(s);
+		break;
+	}
+}
+
+/* Poll without waiting for the interval, e.g. when a reply is due */
+void
+sleepy_poll_now(struct sleepy *s)
+{
+	if (s->state != SLEEPY_SLEEP)
+		return;
+
+	mrf24j40_wakeup(s->flags & SLEEPY_F_SPI_WAKE);
+	s->got = 0;
+	sleepy_request(s);
+}
+
+int
+sleepy_awake(struct sleepy *s)
+{
+	return (s->state != SLEEPY_SLEEP);
+}
+
+/*
+ * Pass on the result of mrf24j40_txpkt_intcb(). Returns 1 if the
+ * transmission was the data request, 0 otherwise.
+ */
+int
+sleepy_tx_done(struct sleepy *s, int err)
+{
+	if (s->state != SLEEPY_REQ)
+		return 0;
+
+	if (err) {
+		++s->stats.fails;
+		sleepy_finish(s);
+	} else if (mrf24j40_txpkt_pending()) {
+		++s->stats.pending;
+		s->state = SLEEPY_RX;
+		s->left = s->rx_wait;
+	} else {
+		sleepy_finish(s);
+	}
+
+	return 1;
+}
+
+/*
+ * Pass on received frames. Returns 1 for a data frame taken as the
+ * answer to a poll, 0 otherwise.
+ */
+int
+sleepy_input(struct sleepy *s, struct ieee802154_frame *fr)
+{
+	if (s->state == SLEEPY_SLEEP ||
+	    FCFRTYP(fr->fc_low) != FCFRTYP_DATA)
+		return 0;
+
+	/* Sent again after our ACK got lost; the ACK went out once more */
+	if (fr->src.mode == FCADDR_SHORT && fr->src.short_addr == s->coord) {
+		if (s->rx_seq_valid && fr->seq == s->rx_seq) {
+			++s->stats.dups;
+			return 0;
+		}
+		s->rx_seq = fr->seq;
+		s->rx_seq_valid = 1;
+	}
+
+	++s->stats.frames;
+	++s->got;
+
+	/* Ahead of the request's TXNIF; sleepy_tx_done() goes on */
+	if (s->state == SLEEPY_REQ)
+		return 1;
+
+	/* Either way the ACK to this frame goes out first */
+	if (fr->fc_low & FCFRPEN) {
+		sleepy_request(s);
+	} else {
+		s->state = SLEEPY_RX;
+		s->left = 2;
+	}
+
+	return 1;
+}
+
+/* For coordinators: a data request from one of their devices */
+int
+sleepy_is_data_req(struct ieee802154_frame *fr)
+{
+	return (FCFRTYP(fr->fc_low) == FCFRTYP_MCMD &&
+	    fr->payload_len >= 1 && fr->payload[0] == SLEEPY_CMD_DATA_REQ);
+}
@@ -0,0 +1,114 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef _SLEEPY_H_
+#define _SLEEPY_H_
+
+#include "MRF24J40.h"
+#include "ieee802154.h"
+
+/*
+ * Indirect data polling for sleepy end devices.
+ *
+ * The radio sleeps between polls. Every interval ticks (sleepy_tick)
+ * it is woken (mrf24j40_wakeup) and sends a MAC data request command
+ * to the coordinator. If the ACK has the frame pending bit clear
+ * (mrf24j40_txpkt_pending), the radio goes straight back to sleep;
+ * otherwise it stays in RX for up to rx_wait ticks for the frame. A
+ * frame that has the frame pending bit set itself is followed by
+ * another data request at once; after the last one the radio sleeps
+ * a tick later, which leaves time for its ACK.
+ *
+ * The interval adapts to the downstream traffic between min and max:
+ * it is halved after a poll that brought data, and grows by a quarter
+ * after one that did not, so a busy link is polled often and an idle
+ * one backs off to max.
+ *
+ * A frame whose ACK got lost is sent again by the coordinator's MAC
+ * with the same sequence number; such repeats of its last frame are
+ * dropped (and counted), so they neither reach the application twice
+ * nor trigger another data request.
+ *
+ * The MRF24J40 sets the frame pending bit of all its ACKs alike
+ * (mrf24j40_set_frame_pending), so coordinators set it while they hold
+ * data for any device; a poll that gets it but no frame is counted as
+ * empty. The application sends nothing while sleepy_awake() and has to
+ * pass on TX completions and received frames.
+ */
+#define SLEEPY_CMD_DATA_REQ	0x04
+
+/*
+ * Ticks to wait for the TX completion of a data request before it is
+ * taken as lost. The radio stays awake meanwhile: CSMA-CA backoffs and
+ * MAC retries can take some 150 ms on a busy channel, and a device
+ * asleep by then has the coordinator send its frame into the void.
+ */
+#ifndef SLEEPY_TX_WAIT
+#define SLEEPY_TX_WAIT		250
+#endif
+
+#define SLEEPY_F_SPI_WAKE	0x01	/* wake by register, not the pin */
+
+#define SLEEPY_SLEEP		0
+#define SLEEPY_REQ		1	/* data request in flight */
+#define SLEEPY_RX		2	/* waiting for the pending frame */
+
+struct sleepy_stats {
+	unsigned short	polls;
+	unsigned short	pending;	/* ACKs with the frame pending bit */
+	unsigned short	frames;
+	unsigned short	empty;		/* pending, but no frame in time */
+	unsigned short	fails;		/* data request not acknowledged */
+	unsigned short	dups;		/* MAC level repeats dropped */
+};
+
+struct sleepy {
+	unsigned short	coord;
+	unsigned char	state;
+	unsigned char	flags;
+	unsigned char	seq;
+	unsigned char	got;		/* frames since the wakeup */
+	unsigned char	rx_seq;		/* of the last frame taken */
+	unsigned char	rx_seq_valid;
+
+	unsigned short	min;
+	unsigned short	max;
+	unsigned short	interval;
+	unsigned short	rx_wait;
+	unsigned short	left;
+
+	struct sleepy_stats stats;
+};
+
+void sleepy_init(struct sleepy *s, unsigned short coord, unsigned short min,
+    unsigned short max, unsigned short rx_wait, int flags);
+void sleepy_start(struct sleepy *s);
+void sleepy_tick(struct sleepy *s);
+void sleepy_poll_now(struct sleepy *s);
+int sleepy_awake(struct sleepy *s);
+int sleepy_tx_done(struct sleepy *s, int err);
+int sleepy_input(struct sleepy *s, struct ieee802154_frame *fr);
+
+int sleepy_is_data_req(struct ieee802154_frame *fr);
+
+#endif /* _SLEEPY_H_ */
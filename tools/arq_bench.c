@@ -0,0 +1,291 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Bulk transfer benchmark for the selective-repeat ARQ (arq.c) on the
+ * simulated medium: one sender pushes a block of data to one receiver
+ * over a lossy link, for a range of window sizes. Window 1 is plain
+ * stop-and-wait.
+ *
+ * Link loss (-p) costs MAC level retries; a data frame only goes missing
+ * when all of them fail, and then the sender learns that from the
+ * transmission status, so the receiver never sees a hole. -d makes the
+ * receiver drop that share of the data frames after the MAC ACK went
+ * out, as an application that ran out of buffers would; those holes are
+ * reported in the ACKs and retransmitted on the NACK (column nack).
+ * Build on the host with:
+ *
+ *   cc -O2 -I. -DMRF24J40_HAL_HOST -DMRF24J40_MULTI -o arq_bench \
+ *	tools/arq_bench.c arq.c ieee802154.c hal_sim.c hal_host.c \
+ *	MRF24J40.c -lm
+ *
+ * Usage: arq_bench [-w win[,win...]] [-s bytes] [-c chunk] [-p loss %]
+ *	[-d drop %] [-a ack every] [-k tick us]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hal_sim.h"
+#include "arq.h"
+
+#define TX		0
+#define RX		1
+#define PAN		0x1234
+#define LIMIT		SIM_SEC(600)
+
+static struct {
+	int		size;
+	int		chunk;
+	int		loss;
+	int		drop;		/* % of data frames dropped after ACK */
+	int		ack_every;
+	int		tick_us;
+} cfg = { 65536, ARQ_DATA_MAX, 10, 2, 4, 250 };
+
+static unsigned char *image, *copy;
+static unsigned char *got;
+static int nchunks, nput, ngot, ndropped;
+static sim_time_t done_at;
+static int rx_busy;
+
+static struct arq_tx atx;
+static struct arq_rx arx;
+static struct sim *cur_sim;
+
+static void
+refill(void)
+{
+	int len;
+
+	while (nput < nchunks) {
+		len = cfg.size - nput * cfg.chunk;
+		if (len > cfg.chunk)
+			len = cfg.chunk;
+		if (arq_tx_put(&atx, image + nput * cfg.chunk, len) != 0)
+			break;
+		nput++;
+	}
+
+	arq_tx_poll(&atx);
+}
+
+static int
+recv_frame(struct ieee802154_frame *fr, unsigned char *buf)
+{
+	if (mrf24j40_rxpkt_intcb(buf, 127, (void *)0, (void *)0) != 0) {
+		mrf24j40_rxfifo_flush();
+		return -1;
+	}
+
+	return ieee802154_parse(buf + 1, buf[0] - 2, fr);
+}
+
+static void
+tx_irq(struct sim_node *n, void *arg)
+{
+	struct ieee802154_frame fr;
+	unsigned char buf[128];
+	int ev;
+
+	ev = mrf24j40_int_tasks();
+	if ((ev & MRF24J40_INT_RX) && recv_frame(&fr, buf) == 0)
+		arq_tx_input(&atx, &fr);
+	if (ev & MRF24J40_INT_TX)
+		arq_tx_done(&atx, mrf24j40_txpkt_intcb());
+
+	refill();
+}
+
+static void
+tx_tick(struct sim_node *n, void *arg)
+{
+	arq_tx_tick(&atx);
+	refill();
+
+	if (done_at == 0)
+		sim_timer(n, SIM_US(cfg.tick_us), tx_tick, arg);
+}
+
+static void
+deliver(unsigned short seq, unsigned char *data, int len)
+{
+	if (seq >= nchunks || got[seq])
+		return;
+
+	got[seq] = 1;
+	memcpy(copy + seq * cfg.chunk, data, len);
+	ngot++;
+}
+
+static void
+rx_irq(struct sim_node *n, void *arg)
+{
+	struct ieee802154_frame fr;
+	unsigned char buf[128];
+	int ev;
+
+	ev = mrf24j40_int_tasks();
+	if (ev & MRF24J40_INT_TX) {
+		mrf24j40_txpkt_intcb();
+		rx_busy = 0;
+	}
+	if ((ev & MRF24J40_INT_RX) && recv_frame(&fr, buf) == 0) {
+		if ((int)(sim_random(cur_sim) % 100) < cfg.drop)
+			ndropped++;
+		else
+			arq_rx_input(&arx, &fr, deliver);
+		if (ngot == nchunks && done_at == 0)
+			done_at = sim_now(cur_sim);
+	}
+
+	if (!rx_busy)
+		rx_busy = arq_rx_poll(&arx);
+}
+
+static void
+rx_tick(struct sim_node *n, void *arg)
+{
+	arq_rx_tick(&arx);
+	if (!rx_busy)
+		rx_busy = arq_rx_poll(&arx);
+
+	if (done_at == 0)
+		sim_timer(n, SIM_US(cfg.tick_us), rx_tick, arg);
+}
+
+static void
+run(int win)
+{
+	struct sim *sim;
+	struct sim_node *n;
+	double secs;
+	int i;
+
+	nchunks = (cfg.size + cfg.chunk - 1) / cfg.chunk;
+	nput = ngot = ndropped = 0;
+	done_at = 0;
+	rx_busy = 0;
+	memset(got, 0, nchunks);
+	memset(copy, 0, cfg.size);
+
+	sim = cur_sim = sim_create(2, 0x5EED + win);
+	sim_link(sim, TX, RX, -60, cfg.loss);
+	sim_link(sim, RX, TX, -60, cfg.loss);
+
+	for (i = 0; i < 2; i++) {
+		n = sim_node(sim, i);
+		sim_select(n);
+		mrf24j40_init(0);
+		mrf24j40_set_pan(PAN);
+		mrf24j40_set_short_addr(i);
+		sim_set_irq(n, i == TX ? tx_irq : rx_irq, (void *)0);
+		sim_timer(n, SIM_US(cfg.tick_us), i == TX ? tx_tick : rx_tick,
+		    (void *)0);
+	}
+
+	sim_select(sim_node(sim, TX));
+	arq_tx_init(&atx, RX, 1, win);
+	sim_select(sim_node(sim, RX));
+	arq_rx_init(&arx, 1, win, cfg.ack_every);
+
+	sim_select(sim_node(sim, TX));
+	refill();
+
+	sim_run(sim, LIMIT);
+
+	secs = (done_at ? done_at : LIMIT) / 1e9;
+	printf("%4d %8.2f %8.1f %7u %6d %6u %6u %6u %6u %5u %s\n",
+	    win, secs, cfg.size * 8 / secs / 1000.0,
+	    atx.stats.frames, ndropped, atx.stats.retx_nack,
+	    atx.stats.retx_timeout,
+	    atx.stats.tx_errors, arx.stats.acks, atx.rto,
+	    (done_at && memcmp(image, copy, cfg.size) == 0) ? "ok" :
+	    "INCOMPLETE");
+
+	sim_destroy(sim);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *list = "1,2,4,8,16,32";
+	char *s, *tok, *dup;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "w:s:c:p:d:a:k:")) != -1) {
+		switch (c) {
+		case 'w':
+			list = optarg;
+			break;
+		case 's':
+			cfg.size = atoi(optarg);
+			break;
+		case 'c':
+			cfg.chunk = atoi(optarg);
+			break;
+		case 'p':
+			cfg.loss = atoi(optarg);
+			break;
+		case 'd':
+			cfg.drop = atoi(optarg);
+			break;
+		case 'a':
+			cfg.ack_every = atoi(optarg);
+			break;
+		case 'k':
+			cfg.tick_us = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-w win,...] [-s bytes] "
+			    "[-c chunk] [-p loss] [-d drop] [-a ack every] "
+			    "[-k tick us]\n",
+			    argv[0]);
+			return 1;
+		}
+	}
+
+	if (cfg.chunk < 1 || cfg.chunk > ARQ_DATA_MAX)
+		cfg.chunk = ARQ_DATA_MAX;
+
+	image = malloc(cfg.size);
+	copy = malloc(cfg.size);
+	got = malloc(cfg.size / cfg.chunk + 1);
+	for (i = 0; i < cfg.size; i++)
+		image[i] = rand();
+
+	printf("%d bytes in %d byte chunks, %d%% loss, %d%% dropped after "
+	    "ACK, tick %d us\n",
+	    cfg.size, cfg.chunk, cfg.loss, cfg.drop, cfg.tick_us);
+	printf("%4s %8s %8s %7s %6s %6s %6s %6s %6s %5s\n",
+	    "win", "secs", "kbit/s", "frames", "drop", "nack", "rto_x", "macerr",
+	    "acks", "rto");
+
+	dup = strdup(list);
+	for (s = dup; (tok = strtok(s, ",")) != (void *)0; s = (void *)0)
+		run(atoi(tok));
+	free(dup);
+
+	return 0;
+}
@@ -0,0 +1,84 @@
+#!/bin/sh
+#
+# Copyright (C) 2011, Alex Hornung
+#
+# Permission is hereby granted, free of charge, to any person obtaining a
+# copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+# DEALINGS IN THE SOFTWARE.
+#
+
+#
+# Code and RAM footprint of the driver per feature configuration (the
+# MRF24J40_NO_* macros in MRF24J40.h). Every configuration is compiled
+# once; reported are the text, data and bss sizes of MRF24J40.o and the
+# size of struct mrf24j40_state.
+#
+# By default this is a cross-check build for the host HAL. For target
+# numbers, point it at the cross toolchain, e.g.
+#
+#   CC=xc16-gcc SIZE=xc16-size CFLAGS="-mcpu=24FJ64GA002 -O1" HAL= \
+#	tools/footprint.sh
+#
+# Extra arguments are added to every configuration, e.g. -DHAL_INLINE.
+#
+
+CC=${CC:-cc}
+SIZE=${SIZE:-size}
+CFLAGS=${CFLAGS:--Os}
+HAL=${HAL--DMRF24J40_HAL_HOST}
+
+top=$(cd "$(dirname "$0")/.." && pwd)
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+cat > "$tmp/state.c" <<EOS
+#include "MRF24J40.h"
+unsigned char footprint_state[sizeof(struct mrf24j40_state)];
+EOS
+
+# size(1) in Berkeley format: text data bss dec hex filename
+sizes()
+{
+	$SIZE "$1" | awk 'NR == 2 { print $1, $2, $3 }'
+}
+
+printf '%-14s %8s %6s %6s %6s\n' config text data bss state
+
+while read -r name defs; do
+	if ! $CC $CFLAGS $HAL "$@" $defs -I"$top" -c "$top/MRF24J40.c" \
+	    -o "$tmp/drv.o" 2> "$tmp/err" ||
+	   ! $CC $CFLAGS "$@" $defs -I"$top" -c "$tmp/state.c" \
+	    -o "$tmp/state.o" 2>> "$tmp/err"; then
+		echo "$name: build failed" >&2
+		cat "$tmp/err" >&2
+		exit 1
+	fi
+
+	printf '%-14s %8s %6s %6s %6s\n' "$name" \
+	    $(sizes "$tmp/drv.o") $(sizes "$tmp/state.o" | cut -d' ' -f3)
+done <<EOC
+full
+no-sec		-DMRF24J40_NO_SEC
+no-upenc	-DMRF24J40_NO_UPENC
+no-part-rx	-DMRF24J40_NO_PART_RX
+no-sleep	-DMRF24J40_NO_SLEEP
+no-promisc	-DMRF24J40_NO_PROMISC
+no-rx-poll	-DMRF24J40_NO_RX_POLL
+no-fwd		-DMRF24J40_NO_FWD
+no-timestamp	-DMRF24J40_NO_TIMESTAMP
+minimal		-DMRF24J40_MINIMAL
+EOC
@@ -0,0 +1,221 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Gateway engine throughput benchmark.
+ *
+ * Every radio is backed by a loopback device that always has a frame
+ * waiting, so this measures the driver, HAL dispatch and queueing cost
+ * per frame, and how aggregate throughput scales with the number of
+ * radios. Build on the host with:
+ *
+ *   cc -O2 -pthread -I. -DMRF24J40_HAL_HOST -DMRF24J40_MULTI \
+ *	-DMRF24J40_TLS=_Thread_local -o gw_bench \
+ *	tools/gw_bench.c gateway.c rxfilt.c hal_host.c MRF24J40.c
+ *
+ * Usage: gw_bench [max radios] [seconds per run]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gateway.h"
+
+#define LB_FRAME_LEN	40
+
+/* Minimal register model: enough for init, INTSTAT and RXFIFO reads */
+struct lb {
+	unsigned char	mem[0x400];
+	int		nbytes;
+	int		addr;
+	int		is_long;
+	int		is_write;
+};
+
+static void
+lb_cs(void *ctx, int level)
+{
+	struct lb *lb = ctx;
+
+	if (level == 0)
+		lb->nbytes = 0;
+}
+
+static void
+lb_pin(void *ctx, int level)
+{
+}
+
+static void
+lb_write(void *ctx, unsigned char v)
+{
+	struct lb *lb = ctx;
+
+	switch (lb->nbytes++) {
+	case 0:
+		lb->is_long = v & 0x80;
+		if (lb->is_long) {
+			lb->addr = (v & 0x7F) << 3;
+		} else {
+			lb->addr = (v >> 1) & 0x3F;
+			lb->is_write = v & 0x01;
+		}
+		return;
+	case 1:
+		if (lb->is_long) {
+			lb->addr |= v >> 5;
+			lb->is_write = v & 0x10;
+			return;
+		}
+		break;
+	}
+
+	/* Long addresses auto-increment on sequential access */
+	if (lb->is_write)
+		lb->mem[lb->addr & 0x3FF] = v;
+	if (lb->is_long)
+		lb->addr++;
+}
+
+static unsigned char
+lb_read(void *ctx)
+{
+	struct lb *lb = ctx;
+	int addr = lb->addr;
+
+	lb->nbytes++;
+	if (lb->is_long)
+		lb->addr++;
+
+	if (!lb->is_long) {
+		switch (addr) {
+		case INTSTAT:
+			return RXIF;
+		case SOFTRST:
+			return 0;
+		}
+	} else if (addr == RXFIFO) {
+		return LB_FRAME_LEN;
+	} else if (addr > RXFIFO && addr <= RXFIFO + LB_FRAME_LEN) {
+		return addr - RXFIFO;
+	}
+
+	return lb->mem[addr & 0x3FF];
+}
+
+static void
+lb_delay_us(void *ctx, unsigned int us)
+{
+}
+
+static int
+lb_wait_irq(void *ctx, int timeout_ms)
+{
+	return 1;
+}
+
+static const struct hal_host_ops lb_ops = {
+	.cs = lb_cs,
+	.reset = lb_pin,
+	.wake = lb_pin,
+	.write = lb_write,
+	.read = lb_read,
+	.delay_us = lb_delay_us,
+	.wait_irq = lb_wait_irq,
+};
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double
+run(int nradios, double secs)
+{
+	static struct gw gw;
+	static struct gw_frame f[64];
+	static struct lb lbs[GW_MAX_RADIOS];
+	struct gw_radio_cfg cfg;
+	unsigned long frames = 0;
+	double t0, t;
+	long ncpu;
+	int i;
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+	gw_init(&gw);
+	memset(lbs, 0, sizeof(lbs));
+
+	for (i = 0; i < nradios; i++) {
+		cfg.channel = 11 + i;
+		cfg.pan = 0x1234;
+		cfg.short_addr = 0x0001;
+		/* Leave CPU 0 to the consumer */
+		cfg.cpu = (ncpu > 1) ? 1 + i % (ncpu - 1) : -1;
+		cfg.ops = &lb_ops;
+		cfg.hal = &lbs[i];
+		cfg.filt = (void *)0;
+		gw_add_radio(&gw, &cfg);
+	}
+
+	gw_start(&gw);
+
+	t0 = now();
+	do {
+		frames += gw_recv(&gw, f, 64);
+		t = now();
+	} while (t - t0 < secs);
+
+	gw_stop(&gw);
+	frames += gw_recv(&gw, f, 64);
+
+	return frames / (t - t0);
+}
+
+int
+main(int argc, char **argv)
+{
+	int max = (argc > 1) ? atoi(argv[1]) : 4;
+	double secs = (argc > 2) ? atof(argv[2]) : 1.0;
+	double fps, base = 0;
+	int n;
+
+	if (max < 1 || max > GW_MAX_RADIOS)
+		max = GW_MAX_RADIOS;
+
+	printf("%6s %14s %9s\n", "radios", "frames/s", "scaling");
+	for (n = 1; n <= max; n++) {
+		fps = run(n, secs);
+		if (n == 1)
+			base = fps;
+		printf("%6d %14.0f %8.2fx\n", n, fps, fps / base);
+	}
+
+	return 0;
+}
@@ -0,0 +1,394 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Check of hal_linux.c against a fake spidev and gpiochip.
+ *
+ * The fake implements struct hal_linux_io: SPI_IOC_MESSAGE transfers
+ * are clocked byte by byte into the chip model of hal_sim.c, GPIO line
+ * requests get fake descriptors whose RESET and WAKE values go to the
+ * model as well. Each driver operation below runs twice on the same
+ * chip, once with the simulator's own ops wrapped to count CS cycles
+ * (SPI transactions as the driver sees them) and once through
+ * hal_linux.c, counting ioctls and bytes. The check fails unless every
+ * transaction takes exactly one SPI_IOC_MESSAGE ioctl, and unless a
+ * failing ioctl shows up in hal_linux.errors. Build on the host with:
+ *
+ *   cc -O2 -I. -DMRF24J40_HAL_HOST -DMRF24J40_MULTI -o hal_linux_check \
+ *	tools/hal_linux_check.c hal_linux.c hal_sim.c hal_host.c \
+ *	MRF24J40.c -lm
+ *
+ * Usage: hal_linux_check
+ */
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+#include <linux/spi/spidev.h>
+
+#include "hal_linux.h"
+#include "hal_sim.h"
+
+#define FD_SPI		3
+#define FD_CHIP		4
+#define FD_LINE		5	/* + line offset */
+
+#define LINE_RESET	0
+#define LINE_WAKE	1
+#define LINE_IRQ	2
+
+#define PAYLOAD		100
+
+static struct {
+	const struct hal_host_ops *ops;	/* chip model */
+	void		*ctx;
+
+	/* CS cycle in progress */
+	int		active;
+	int		pos;
+	int		alen;
+	int		rd;
+
+	unsigned long	ioctls;
+	unsigned long	bytes;
+	int		fail_next;
+} fake;
+
+static struct hal_linux hl;
+
+/* Counting wrapper around the simulator's ops */
+static struct hal_host_ops cnt_ops;
+static unsigned long cycles;
+
+static void
+cnt_cs(void *ctx, int level)
+{
+	if (!level)
+		cycles++;
+	fake.ops->cs(ctx, level);
+}
+
+/*
+ * Fake spidev. Whether a byte is written or read follows from the
+ * MRF24J40 address at the start of the CS cycle, like on the chip.
+ */
+static void
+fake_byte(const unsigned char *tx, unsigned char *rx)
+{
+	unsigned char b = tx ? *tx : 0;
+
+	if (fake.pos == 0) {
+		fake.alen = (b & 0x80) ? 2 : 1;
+		fake.rd = !(b & 0x01);
+	} else if (fake.pos == 1 && fake.alen == 2) {
+		fake.rd = !(b & 0x10);
+	}
+
+	if (fake.pos < fake.alen || !fake.rd) {
+		fake.ops->write(fake.ctx, b);
+		if (rx)
+			*rx = 0;
+	} else {
+		b = fake.ops->read(fake.ctx);
+		if (rx)
+			*rx = b;
+	}
+
+	fake.pos++;
+}
+
+static int
+fake_spi_message(struct spi_ioc_transfer *t, int n)
+{
+	unsigned int i, j;
+
+	fake.ioctls++;
+	if (fake.fail_next) {
+		fake.fail_next = 0;
+		return -1;
+	}
+
+	for (i = 0; i < (unsigned int)n; i++) {
+		if (!fake.active) {
+			fake.ops->cs(fake.ctx, 0);
+			fake.active = 1;
+			fake.pos = 0;
+		}
+
+		for (j = 0; j < t[i].len; j++)
+			fake_byte(t[i].tx_buf ?
+			    (unsigned char *)(unsigned long)t[i].tx_buf + j :
+			    (void *)0,
+			    t[i].rx_buf ?
+			    (unsigned char *)(unsigned long)t[i].rx_buf + j :
+			    (void *)0);
+		fake.bytes += t[i].len;
+	}
+
+	/* cs_change on the last transfer keeps CS asserted */
+	if (n == 0 || !t[n - 1].cs_change) {
+		fake.ops->cs(fake.ctx, 1);
+		fake.active = 0;
+	}
+
+	return 0;
+}
+
+static int
+fake_ioctl(int fd, unsigned long req, void *arg)
+{
+	struct gpio_v2_line_request *lr;
+	struct gpio_v2_line_values *v;
+
+	if (fd == FD_SPI) {
+		if (_IOC_TYPE(req) == SPI_IOC_MAGIC && _IOC_NR(req) == 0)
+			return fake_spi_message(arg,
+			    _IOC_SIZE(req) / sizeof(struct spi_ioc_transfer));
+		return 0;	/* mode, word size, speed */
+	}
+
+	if (fd == FD_CHIP && req == GPIO_V2_GET_LINE_IOCTL) {
+		lr = arg;
+		lr->fd = FD_LINE + lr->offsets[0];
+		return 0;
+	}
+
+	if (req == GPIO_V2_LINE_SET_VALUES_IOCTL) {
+		v = arg;
+		if (fd == FD_LINE + LINE_RESET)
+			fake.ops->reset(fake.ctx, v->bits & 1);
+		else if (fd == FD_LINE + LINE_WAKE)
+			fake.ops->wake(fake.ctx, v->bits & 1);
+		return 0;
+	}
+
+	if (req == GPIO_V2_LINE_GET_VALUES_IOCTL) {
+		v = arg;
+		v->bits = 0;
+		return 0;
+	}
+
+	return -1;
+}
+
+static int
+fake_open(const char *path, int flags)
+{
+	(void)flags;
+	return strstr(path, "spidev") ? FD_SPI : FD_CHIP;
+}
+
+static int
+fake_close(int fd)
+{
+	(void)fd;
+	return 0;
+}
+
+static long
+fake_read(int fd, void *buf, size_t len)
+{
+	(void)fd;
+	(void)buf;
+	(void)len;
+	return 0;
+}
+
+static int
+fake_poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+	(void)fds;
+	(void)nfds;
+	(void)timeout;
+	return 0;
+}
+
+static const struct hal_linux_io fake_io = {
+	.open = fake_open,
+	.close = fake_close,
+	.ioctl = fake_ioctl,
+	.read = fake_read,
+	.poll = fake_poll,
+};
+
+/*
+ * Operations, run once per binding
+ */
+static unsigned char pkt[PAYLOAD];
+static unsigned char rxbuf[128];
+
+static void
+op_short_read(void)
+{
+	mrf24j40_txpkt_retries();
+}
+
+static void
+op_long_read(void)
+{
+	mrf24j40_get_channel();
+}
+
+static void
+op_set_pan(void)
+{
+	mrf24j40_set_pan(0x1234);
+}
+
+static void
+op_txpkt(void)
+{
+	mrf24j40_txpkt(0x0002, pkt, PAYLOAD, 0);
+}
+
+static void
+op_int_tasks(void)
+{
+	mrf24j40_int_tasks();
+}
+
+static void
+op_rxpkt(void)
+{
+	mrf24j40_rxpkt_intcb(rxbuf, 127, (void *)0, (void *)0);
+}
+
+static struct sim *sim;
+static int failed;
+
+static void
+peer_send(void)
+{
+	struct sim_node *peer = sim_node(sim, 1);
+
+	sim_select(peer);
+	mrf24j40_txpkt(0x0001, pkt, PAYLOAD, 0);
+	sim_run(sim, sim_now(sim) + SIM_MS(20));
+}
+
+/*
+ * Run op with the counting ops, then through hal_linux. For RX the
+ * peer sends a frame before each run, and the INT flag is left alone.
+ */
+static void
+measure(const char *name, void (*op)(void), int rx)
+{
+	struct sim_node *n = sim_node(sim, 0);
+	unsigned long tr, io, by;
+
+	if (rx)
+		peer_send();
+	sim_select(n);
+	hal_host_bind(&cnt_ops, fake.ctx);
+	cycles = 0;
+	op();
+	tr = cycles;
+
+	if (rx)
+		peer_send();
+	sim_select(n);
+	hal_host_bind(&hal_linux_ops, &hl);
+	fake.ioctls = fake.bytes = 0;
+	op();
+	io = fake.ioctls;
+	by = fake.bytes;
+
+	printf("%-22s %12lu %8lu %8lu %s\n", name, tr, io, by,
+	    tr == io ? "ok" : "FAIL");
+	if (tr != io)
+		failed = 1;
+}
+
+static void
+rx_irq(struct sim_node *n, void *arg)
+{
+	/* Serviced by the measured operations */
+	(void)n;
+	(void)arg;
+}
+
+int
+main(void)
+{
+	struct hal_linux_cfg cfg;
+	struct sim_node *n;
+
+	sim = sim_create(2, 1);
+	memset(pkt, 0x5A, sizeof(pkt));
+
+	/* The peer sends frames to node 0 */
+	n = sim_node(sim, 1);
+	sim_select(n);
+	sim_set_pos(n, 2, 0);
+	mrf24j40_init(0);
+	mrf24j40_set_pan(0x1234);
+	mrf24j40_set_short_addr(0x0002);
+
+	n = sim_node(sim, 0);
+	sim_select(n);
+	sim_set_pos(n, 0, 0);
+	sim_set_irq(n, rx_irq, (void *)0);
+	hal_host_bound(&fake.ops, &fake.ctx);
+	cnt_ops = *fake.ops;
+	cnt_ops.cs = cnt_cs;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.spidev = "/dev/spidev0.0";
+	cfg.gpiochip = "/dev/gpiochip0";
+	cfg.reset_line = LINE_RESET;
+	cfg.wake_line = LINE_WAKE;
+	cfg.irq_line = LINE_IRQ;
+	cfg.io = &fake_io;
+	if (hal_linux_open(&hl, &cfg) != 0) {
+		fprintf(stderr, "hal_linux_open failed\n");
+		return 1;
+	}
+
+	/* Initialize node 0 through hal_linux */
+	hal_host_bind(&hal_linux_ops, &hl);
+	mrf24j40_init(0);
+	mrf24j40_set_pan(0x1234);
+	mrf24j40_set_short_addr(0x0001);
+
+	printf("%-22s %12s %8s %8s\n", "operation", "transactions",
+	    "ioctls", "bytes");
+	measure("short register read", op_short_read, 0);
+	measure("long register read", op_long_read, 0);
+	measure("set_pan", op_set_pan, 0);
+	measure("txpkt 100 bytes", op_txpkt, 0);
+	measure("int_tasks", op_int_tasks, 1);
+	measure("rxpkt_intcb 100 bytes", op_rxpkt, 0);
+
+	/* A failing transfer has to be counted */
+	fake.fail_next = 1;
+	op_short_read();
+	printf("%-22s %12s %8s %8lu %s\n", "failed ioctl counted", "", "",
+	    hl.errors, hl.errors == 1 ? "ok" : "FAIL");
+	if (hl.errors != 1)
+		failed = 1;
+
+	hal_linux_close(&hl);
+	sim_destroy(sim);
+
+	return failed;
+}
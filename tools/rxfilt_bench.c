@@ -0,0 +1,243 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * RX filter lookup cost against table size.
+ *
+ * A table of N (PAN, short address) entries spread over P PANs is
+ * built, then rxfilt_match() is run on random frame headers, a share
+ * -h of them to an entry and the rest to other addresses in the same
+ * PANs and in foreign ones. Reported per table size are the time per
+ * match, the same for a linear search of the sorted keys, the false
+ * positive rate of the Bloom filter on misses, and the SPI bytes read
+ * per frame of -l bytes with rxfilt_rx() (length, header prefix, LQI
+ * and RSSI for a rejected frame) against reading every frame whole.
+ * Build on the host with:
+ *
+ *   cc -O2 -I. -DMRF24J40_HAL_HOST -o rxfilt_bench tools/rxfilt_bench.c \
+ *	rxfilt.c hal_host.c MRF24J40.c
+ *
+ * Usage: rxfilt_bench [-n entries[,entries...]] [-p PANs] [-h hit ratio]
+ *	[-l frame bytes] [-m matches]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ieee802154.h"
+#include "rxfilt.h"
+
+#define NHDR		4096	/* distinct headers, cycled through */
+
+static struct {
+	int		npans;
+	double		hit;
+	int		len;
+	long		matches;
+} cfg = { 8, 0.1, 60, 4000000 };
+
+static unsigned long rnd_state = 0x2545F491UL;
+
+static unsigned long
+rnd(void)
+{
+	/* xorshift32 */
+	rnd_state ^= (rnd_state << 13) & 0xFFFFFFFFUL;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= (rnd_state << 5) & 0xFFFFFFFFUL;
+	return rnd_state & 0xFFFFFFFFUL;
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+linear(const unsigned long *keys, int n, const unsigned char *h)
+{
+	unsigned long k = ((unsigned long)(h[3] | (h[4] << 8)) << 16) |
+	    (h[5] | (h[6] << 8));
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (keys[i] == k)
+			return 1;
+	}
+	return 0;
+}
+
+static void
+run(int n)
+{
+	struct rxfilt f;
+	unsigned long *keys, *slots;
+	unsigned char *bloom, (*hdr)[RXFILT_HDR_LEN];
+	unsigned int nslots, nbloom;
+	unsigned short pan, addr;
+	unsigned long fp = 0, misses = 0, hits = 0;
+	volatile int sink = 0;
+	double t, t_hash, t_lin, spi;
+	long i;
+
+	for (nslots = 2; nslots < 2 * (unsigned int)n; nslots <<= 1)
+		;
+	for (nbloom = 1; nbloom < (unsigned int)n && nbloom < 8192;
+	    nbloom <<= 1)
+		;
+
+	keys = calloc(n, sizeof(*keys));
+	slots = calloc(nslots, sizeof(*slots));
+	bloom = calloc(nbloom, 1);
+	hdr = calloc(NHDR, sizeof(*hdr));
+
+	if (rxfilt_init(&f, keys, n, slots, nslots, bloom, nbloom) != 0) {
+		fprintf(stderr, "bad sizes for %d entries\n", n);
+		exit(1);
+	}
+	rxfilt_set_types(&f, RXFILT_TYPE(FCFRTYP_DATA) |
+	    RXFILT_TYPE(FCFRTYP_MCMD), 0);
+
+	while (f.nkeys < n)
+		rxfilt_add(&f, 0x1000 + rnd() % cfg.npans, rnd() % 0xFFFE);
+	rxfilt_commit(&f);
+
+	for (i = 0; i < NHDR; i++) {
+		if (rnd() % 1000 < cfg.hit * 1000) {
+			pan = keys[rnd() % n] >> 16;
+			addr = keys[rnd() % n] & 0xFFFF;
+			if (!rxfilt_has(&f, pan, addr)) {
+				addr = keys[0] & 0xFFFF;
+				pan = keys[0] >> 16;
+			}
+		} else {
+			pan = (rnd() & 1) ? 0x1000 + rnd() % cfg.npans :
+			    0x2000 + rnd() % 256;
+			addr = rnd() % 0xFFFE;
+		}
+
+		hdr[i][0] = FCFRTYP_DATA | FCPANCOMP;
+		hdr[i][1] = FCDADDRM(FCADDR_SHORT) | FCSADDRM(FCADDR_SHORT);
+		hdr[i][2] = i;
+		hdr[i][3] = pan & 0xFF;
+		hdr[i][4] = pan >> 8;
+		hdr[i][5] = addr & 0xFF;
+		hdr[i][6] = addr >> 8;
+
+		if (rxfilt_match(&f, hdr[i], RXFILT_HDR_LEN) !=
+		    linear(keys, n, hdr[i])) {
+			fprintf(stderr, "mismatch at header %ld\n", i);
+			exit(1);
+		}
+
+		if (rxfilt_has(&f, pan, addr)) {
+			hits++;
+		} else {
+			misses++;
+			if (rxfilt_maybe(&f, pan, addr))
+				fp++;
+		}
+	}
+
+	t = now();
+	for (i = 0; i < cfg.matches; i++)
+		sink += rxfilt_match(&f, hdr[i & (NHDR - 1)], RXFILT_HDR_LEN);
+	t_hash = (now() - t) / cfg.matches;
+
+	/* Fewer rounds for the linear search, it gets slow */
+	t = now();
+	for (i = 0; i < cfg.matches / 100; i++)
+		sink += linear(keys, n, hdr[i & (NHDR - 1)]);
+	t_lin = (now() - t) / (cfg.matches / 100);
+
+	/* Length byte, then the header prefix or the frame, LQI and RSSI */
+	spi = (hits * (1.0 + cfg.len + 2) +
+	    misses * (1.0 + RXFILT_HDR_LEN + 2)) / NHDR;
+
+	printf("%7d %8u %6u %9.1f %9.1f %7.2f%% %8.1f %8d\n", n, nslots,
+	    nbloom, t_hash * 1e9, t_lin * 1e9,
+	    misses ? 100.0 * fp / misses : 0.0, spi, 1 + cfg.len + 2);
+
+	free(keys);
+	free(slots);
+	free(bloom);
+	free(hdr);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *list = "10,100,1000,4000";
+	char *s, *tok, *copy;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:p:h:l:m:")) != -1) {
+		switch (c) {
+		case 'n':
+			list = optarg;
+			break;
+		case 'p':
+			cfg.npans = atoi(optarg);
+			break;
+		case 'h':
+			cfg.hit = atof(optarg);
+			break;
+		case 'l':
+			cfg.len = atoi(optarg);
+			break;
+		case 'm':
+			cfg.matches = atol(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n entries,...] [-p pans] "
+			    "[-h hit] [-l len] [-m matches]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (cfg.npans < 1)
+		cfg.npans = 1;
+	if (cfg.len < RXFILT_HDR_LEN + 2)
+		cfg.len = RXFILT_HDR_LEN + 2;
+	if (cfg.len > 127)
+		cfg.len = 127;
+	if (cfg.matches < 100)
+		cfg.matches = 100;
+
+	printf("%7s %8s %6s %9s %9s %8s %8s %8s\n", "entries", "slots",
+	    "bloom", "ns/match", "ns/linear", "bloom fp", "spi B/f",
+	    "unfilt");
+
+	copy = strdup(list);
+	for (s = copy; (tok = strtok(s, ",")) != (void *)0; s = (void *)0)
+		run(atoi(tok));
+	free(copy);
+
+	return 0;
+}
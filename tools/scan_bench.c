@@ -0,0 +1,327 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Beacon scan on the simulated RF medium.
+ *
+ * A joiner (node 0) scans all 16 channels for the coordinators placed
+ * at random around it, each on a random channel with its own PAN. The
+ * coordinators answer beacon requests after a random delay of up to
+ * 2ms; with -P they send a beacon every -i ms instead, for a passive
+ * scan. With -b each coordinator also broadcasts data frames at the
+ * given rate, which the BCNONLY filter keeps from the joiner unless -a
+ * turns it off. For every dwell time the scan is run once; reported
+ * are the coordinators found, the scan time and the frames the joiner
+ * had to read. Build on the host with:
+ *
+ *   cc -O2 -I. -DMRF24J40_HAL_HOST -DMRF24J40_MULTI -o scan_bench \
+ *	tools/scan_bench.c scan.c ieee802154.c hal_sim.c hal_host.c \
+ *	MRF24J40.c -lm
+ *
+ * Usage: scan_bench [-n coordinators] [-d dwell ms[,dwell ms...]]
+ *	[-b pkts/s per coordinator] [-a] [-P] [-i beacon interval ms]
+ *	[-R radius m]
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hal_sim.h"
+#include "scan.h"
+
+#define JOINER		0
+#define TICK		SIM_MS(1)
+#define MAX_RESULTS	64
+
+struct node_app {
+	int		busy;
+	int		beacon_due;
+	unsigned char	bsn;
+	unsigned char	seq;
+};
+
+static struct {
+	int		ncoord;
+	double		rate;
+	int		all;
+	int		passive;
+	int		interval;
+	double		radius;
+} cfg = { 8, 0.0, 0, 0, 100, 20.0 };
+
+static struct node_app *apps;
+static struct scan scan;
+static struct scan_result results[MAX_RESULTS];
+static unsigned long rx_read;
+static sim_time_t scan_end;
+
+static double
+expo(struct sim *sim, double rate)
+{
+	double u = (sim_random(sim) + 1.0) / 4294967297.0;
+
+	return -log(u) / rate;
+}
+
+static void
+joiner_irq(struct sim_node *n, void *arg)
+{
+	struct ieee802154_frame fr;
+	unsigned char buf[128], lqi, rssi;
+	int ev;
+
+	ev = mrf24j40_int_tasks();
+
+	if (ev & MRF24J40_INT_RX) {
+		if (scan_running(&scan))
+			rx_read++;
+		if (mrf24j40_rxpkt_intcb(buf, 127, &lqi, &rssi) == 0 &&
+		    ieee802154_parse(buf + 1, buf[0] - 2, &fr) == 0)
+			scan_input(&scan, &fr, lqi, rssi);
+	}
+
+	if (ev & MRF24J40_INT_TX)
+		mrf24j40_txpkt_intcb();
+}
+
+static void
+joiner_tick(struct sim_node *n, void *arg)
+{
+	if (scan_tick(&scan)) {
+		scan_end = sim_now(sim_node_sim(n));
+		return;
+	}
+
+	sim_timer(n, TICK, joiner_tick, arg);
+}
+
+static void
+coord_beacon(struct sim_node *n, void *arg)
+{
+	struct node_app *a = &apps[sim_node_id(n)];
+
+	if (a->busy) {
+		a->beacon_due = 1;
+		return;
+	}
+
+	scan_beacon(a->bsn++, SCAN_SF_NONBEACON, (void *)0, 0);
+	a->busy = 1;
+}
+
+static void
+coord_periodic(struct sim_node *n, void *arg)
+{
+	coord_beacon(n, arg);
+	sim_timer(n, SIM_MS(cfg.interval), coord_periodic, arg);
+}
+
+static void
+coord_data(struct sim_node *n, void *arg)
+{
+	struct node_app *a = &apps[sim_node_id(n)];
+	struct sim *sim = sim_node_sim(n);
+	unsigned char hdr[9], pkt[40];
+	struct mrf24j40_iov iov[2];
+
+	/* Broadcast to all PANs, so it passes the joiner's PAN filter */
+	if (!a->busy) {
+		hdr[0] = FCFRTYP_DATA | FCPANCOMP;
+		hdr[1] = FCDADDRM(FCADDR_SHORT) | FCSADDRM(FCADDR_SHORT);
+		hdr[2] = a->seq++;
+		memset(&hdr[3], 0xFF, 4);
+		hdr[7] = hdr[8] = 0x00;
+		memset(pkt, a->seq, sizeof(pkt));
+
+		iov[0].base = hdr;
+		iov[0].len = sizeof(hdr);
+		iov[1].base = pkt;
+		iov[1].len = sizeof(pkt);
+		mrf24j40_txpkt_iov(iov, 2, 1, 0);
+		a->busy = 1;
+	}
+
+	sim_timer(n, (sim_time_t)(expo(sim, cfg.rate) * 1e9), coord_data, arg);
+}
+
+static void
+coord_irq(struct sim_node *n, void *arg)
+{
+	struct node_app *a = &apps[sim_node_id(n)];
+	struct sim *sim = sim_node_sim(n);
+	struct ieee802154_frame fr;
+	unsigned char buf[128];
+	int ev;
+
+	ev = mrf24j40_int_tasks();
+
+	if (ev & MRF24J40_INT_RX) {
+		if (mrf24j40_rxpkt_intcb(buf, 127, (void *)0, (void *)0) == 0 &&
+		    ieee802154_parse(buf + 1, buf[0] - 2, &fr) == 0 &&
+		    scan_is_beacon_req(&fr) && !cfg.passive)
+			sim_timer(n, SIM_US(sim_random(sim) % 2000),
+			    coord_beacon, (void *)0);
+	}
+
+	if (ev & MRF24J40_INT_TX) {
+		mrf24j40_txpkt_intcb();
+		a->busy = 0;
+		if (a->beacon_due) {
+			a->beacon_due = 0;
+			coord_beacon(n, arg);
+		}
+	}
+}
+
+static void
+run(int dwell)
+{
+	struct sim *sim;
+	struct sim_node *n;
+	unsigned char ch[256];
+	double ang, r;
+	int i, j, found;
+
+	apps = calloc(cfg.ncoord + 1, sizeof(*apps));
+	rx_read = 0;
+	scan_end = 0;
+
+	sim = sim_create(cfg.ncoord + 1, 0x5CA11EDUL);
+
+	for (i = 0; i <= cfg.ncoord; i++) {
+		n = sim_node(sim, i);
+		sim_select(n);
+		mrf24j40_init(0);
+
+		if (i == JOINER) {
+			sim_set_pos(n, 0, 0);
+			sim_set_irq(n, joiner_irq, (void *)0);
+			continue;
+		}
+
+		ang = (sim_random(sim) % 3600) * M_PI / 1800;
+		r = cfg.radius * sqrt((sim_random(sim) % 10000) / 1e4);
+		sim_set_pos(n, r * cos(ang), r * sin(ang));
+
+		ch[i] = 11 + sim_random(sim) % 16;
+		mrf24j40_set_channel(ch[i]);
+		mrf24j40_set_pan(0x1000 + i);
+		mrf24j40_set_short_addr(0x0000);
+		mrf24j40_set_coordinator();
+		mrf24j40_set_cca(1, 2, 0x60);
+		sim_set_irq(n, coord_irq, (void *)0);
+
+		if (cfg.passive)
+			sim_timer(n, SIM_US(sim_random(sim) %
+			    (cfg.interval * 1000)), coord_periodic, (void *)0);
+		if (cfg.rate > 0)
+			sim_timer(n, (sim_time_t)(expo(sim, cfg.rate) * 1e9),
+			    coord_data, (void *)0);
+	}
+
+	n = sim_node(sim, JOINER);
+	sim_select(n);
+	scan_init(&scan, results, MAX_RESULTS);
+	scan_start(&scan, SCAN_CHANNELS_ALL, dwell,
+	    (cfg.passive ? 0 : SCAN_F_ACTIVE) |
+	    (cfg.all ? SCAN_F_ALL_FRAMES : 0));
+	sim_timer(n, TICK, joiner_tick, (void *)0);
+
+	sim_run(sim, SIM_SEC(16) * (dwell + 1) / 1000 + SIM_SEC(1));
+
+	found = 0;
+	for (i = 1; i <= cfg.ncoord; i++) {
+		for (j = 0; j < scan.n; j++) {
+			if (results[j].coord.pan == 0x1000 + i &&
+			    results[j].channel == ch[i]) {
+				found++;
+				break;
+			}
+		}
+	}
+
+	printf("%6d %6d/%-6d %9.1f %8lu %8u %8u\n", dwell, found,
+	    cfg.ncoord, scan_end / 1e6, rx_read, scan.stats.beacons,
+	    scan.stats.other);
+
+	sim_destroy(sim);
+	free(apps);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *list = "5,10,20,50,100";
+	char *s, *tok, *copy;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:d:b:aPi:R:")) != -1) {
+		switch (c) {
+		case 'n':
+			cfg.ncoord = atoi(optarg);
+			break;
+		case 'd':
+			list = optarg;
+			break;
+		case 'b':
+			cfg.rate = atof(optarg);
+			break;
+		case 'a':
+			cfg.all = 1;
+			break;
+		case 'P':
+			cfg.passive = 1;
+			break;
+		case 'i':
+			cfg.interval = atoi(optarg);
+			break;
+		case 'R':
+			cfg.radius = atof(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n coordinators] "
+			    "[-d dwell,...] [-b rate] [-a] [-P] [-i interval] "
+			    "[-R radius]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (cfg.ncoord < 1)
+		cfg.ncoord = 1;
+	if (cfg.ncoord > 255)
+		cfg.ncoord = 255;
+	if (cfg.interval < 1)
+		cfg.interval = 1;
+
+	printf("%6s %13s %9s %8s %8s %8s\n", "dwell", "found", "scan ms",
+	    "rx read", "beacons", "other");
+
+	copy = strdup(list);
+	for (s = copy; (tok = strtok(s, ",")) != (void *)0; s = (void *)0)
+		run(atoi(tok));
+	free(copy);
+
+	return 0;
+}
@@ -0,0 +1,361 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Network-scale throughput benchmark on the simulated RF medium.
+ *
+ * N nodes are placed at random within a disc around a sink and send
+ * fixed size data frames to it, with exponentially distributed
+ * inter-arrival times. Each node runs the real driver. Reported are
+ * goodput at the sink, latency percentiles (enqueue to reception) and
+ * the histogram of hardware retries per frame. Build on the host with:
+ *
+ *   cc -O2 -I. -DMRF24J40_HAL_HOST -DMRF24J40_MULTI -o sim_bench \
+ *	tools/sim_bench.c cca.c hal_sim.c hal_host.c MRF24J40.c -lm
+ *
+ * Usage: sim_bench [-n nodes[,nodes...]] [-r pkts/s per node]
+ *	[-l payload bytes] [-t seconds] [-R radius m] [-T]
+ *	[-N noise dBm] [-c CCA mode] [-e]
+ *
+ * -N adds background noise at every node but the sink, -c sets the CCA mode
+ * (mrf24j40_set_cca) and -e runs the adaptive CCA threshold of cca.c,
+ * sampling the RSSI every CCA_PERIOD while a node is idle.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cca.h"
+#include "hal_sim.h"
+
+#define SINK		0
+#define SINK_ADDR	0x0000
+#define PAN		0x1234
+#define QLEN		8
+#define HDR_LEN		9
+#define CCA_PERIOD	SIM_MS(5)
+
+struct node_app {
+	sim_time_t	q[QLEN];	/* enqueue times */
+	int		qhead;
+	int		qlen;
+	int		busy;
+	unsigned short	seq;
+	unsigned short	last_seq;	/* at the sink, for duplicates */
+	int		seen;
+	struct cca	cca;
+};
+
+static struct {
+	int		nnodes;
+	double		rate;
+	int		len;
+	double		secs;
+	double		radius;
+	int		turbo;
+	int		noise;
+	int		cca_mode;
+	int		cca_adapt;
+} cfg = { 0, 2.0, 20, 10.0, 30.0, 0, -100, 3, 0 };
+
+static struct node_app *apps;
+static double *lat;
+static unsigned long nlat, lat_size;
+static unsigned long delivered, dups, offered, qdrops;
+static unsigned long retry_hist[4], tx_fail, tx_ccafail;
+
+static double
+expo(struct sim *sim, double rate)
+{
+	double u = (sim_random(sim) + 1.0) / 4294967297.0;
+
+	return -log(u) / rate;
+}
+
+static void
+send_next(struct sim_node *n)
+{
+	struct node_app *a = &apps[sim_node_id(n)];
+	unsigned char pkt[127];
+	sim_time_t t = a->q[a->qhead];
+
+	memset(pkt, 0, cfg.len);
+	memcpy(pkt, &t, sizeof(t));
+	memcpy(pkt + sizeof(t), &a->seq, sizeof(a->seq));
+	a->seq++;
+
+	mrf24j40_txpkt(SINK_ADDR, pkt, cfg.len, 0);
+	a->busy = 1;
+}
+
+static void
+gen(struct sim_node *n, void *arg)
+{
+	struct sim *sim = sim_node_sim(n);
+	struct node_app *a = &apps[sim_node_id(n)];
+
+	offered++;
+	if (a->qlen == QLEN) {
+		qdrops++;
+	} else {
+		a->q[(a->qhead + a->qlen++) % QLEN] = sim_now(sim);
+		if (!a->busy)
+			send_next(n);
+	}
+
+	sim_timer(n, (sim_time_t)(expo(sim, cfg.rate) * 1e9), gen, arg);
+}
+
+static void
+node_irq(struct sim_node *n, void *arg)
+{
+	struct node_app *a = &apps[sim_node_id(n)];
+	int ev, err, r;
+
+	ev = mrf24j40_int_tasks();
+	if (!(ev & MRF24J40_INT_TX))
+		return;
+
+	err = mrf24j40_txpkt_intcb();
+	r = sim_peek(n, TXSTAT, 0) >> 6;
+	if (err == EBUSY)
+		tx_ccafail++;
+	else if (err)
+		tx_fail++;
+	else
+		retry_hist[r]++;
+
+	if (cfg.cca_adapt)
+		cca_tx_done(&a->cca, err);
+
+	a->qhead = (a->qhead + 1) % QLEN;
+	a->qlen--;
+	a->busy = 0;
+	if (a->qlen > 0)
+		send_next(n);
+}
+
+static void
+cca_timer(struct sim_node *n, void *arg)
+{
+	struct node_app *a = &apps[sim_node_id(n)];
+
+	if (!a->busy)
+		cca_sample(&a->cca);
+
+	sim_timer(n, CCA_PERIOD, cca_timer, arg);
+}
+
+static void
+sink_irq(struct sim_node *n, void *arg)
+{
+	struct sim *sim = sim_node_sim(n);
+	unsigned char buf[128];
+	struct node_app *src;
+	unsigned short seq, saddr;
+	sim_time_t t;
+	int ev;
+
+	ev = mrf24j40_int_tasks();
+	if (!(ev & MRF24J40_INT_RX))
+		return;
+
+	if (mrf24j40_rxpkt_intcb(buf, 127, (void *)0, (void *)0) != 0) {
+		mrf24j40_rxfifo_flush();
+		return;
+	}
+
+	/* buf[0] is the length, the MAC header follows */
+	saddr = buf[1 + 7] | (buf[1 + 8] << 8);
+	if (saddr == 0 || saddr > cfg.nnodes)
+		return;
+
+	memcpy(&t, &buf[1 + HDR_LEN], sizeof(t));
+	memcpy(&seq, &buf[1 + HDR_LEN + sizeof(t)], sizeof(seq));
+
+	/* Retransmissions after a lost ACK */
+	src = &apps[saddr];
+	if (src->seen && seq == src->last_seq) {
+		dups++;
+		return;
+	}
+	src->seen = 1;
+	src->last_seq = seq;
+
+	delivered++;
+	if (nlat == lat_size) {
+		lat_size = lat_size ? 2 * lat_size : 4096;
+		lat = realloc(lat, lat_size * sizeof(*lat));
+	}
+	lat[nlat++] = (sim_now(sim) - t) / 1e6;
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+static double
+pct(double p)
+{
+	if (nlat == 0)
+		return 0;
+	return lat[(unsigned long)(p * (nlat - 1))];
+}
+
+static void
+run(int nnodes)
+{
+	struct sim *sim;
+	struct sim_node *n;
+	struct sim_stats st;
+	double a, r;
+	unsigned long edth;
+	int i;
+
+	cfg.nnodes = nnodes - 1;
+	apps = calloc(nnodes, sizeof(*apps));
+	nlat = delivered = dups = offered = qdrops = 0;
+	tx_fail = tx_ccafail = 0;
+	memset(retry_hist, 0, sizeof(retry_hist));
+
+	sim = sim_create(nnodes, 0x2545F491UL + nnodes);
+
+	for (i = 0; i < nnodes; i++) {
+		n = sim_node(sim, i);
+		if (i == SINK) {
+			sim_set_pos(n, 0, 0);
+		} else {
+			a = (sim_random(sim) % 3600) * M_PI / 1800;
+			r = cfg.radius * sqrt((sim_random(sim) % 10000) / 1e4);
+			sim_set_pos(n, r * cos(a), r * sin(a));
+		}
+
+		sim_select(n);
+		mrf24j40_init(0);
+		mrf24j40_set_pan(PAN);
+		mrf24j40_set_short_addr(i == SINK ? SINK_ADDR : i);
+		if (cfg.turbo)
+			mrf24j40_set_turbo(1);
+		mrf24j40_set_cca(cfg.cca_mode, 2, 0x60);
+		if (i != SINK)
+			sim_set_noise(n, cfg.noise);
+
+		sim_set_irq(n, i == SINK ? sink_irq : node_irq, (void *)0);
+		if (i != SINK)
+			sim_timer(n, (sim_time_t)(expo(sim, cfg.rate) * 1e9),
+			    gen, (void *)0);
+		if (i != SINK && cfg.cca_adapt) {
+			cca_init(&apps[i].cca, 0x10, 0xF0);
+			sim_timer(n, CCA_PERIOD, cca_timer, (void *)0);
+		}
+	}
+
+	sim_run(sim, (sim_time_t)(cfg.secs * 1e9));
+	sim_get_stats(sim, &st);
+
+	edth = 0;
+	for (i = 0; i < nnodes; i++)
+		edth += sim_peek(sim_node(sim, i), CCAEDTH, 0);
+
+	qsort(lat, nlat, sizeof(*lat), cmp_double);
+
+	printf("%6d %8lu %8lu %6.1f%% %9.1f %7.1f %7.1f %7.1f "
+	    "%6lu %6lu %6lu %6lu %6lu %6lu %8lu %5lu\n",
+	    nnodes, offered, delivered,
+	    offered ? 100.0 * delivered / offered : 0.0,
+	    delivered * cfg.len * 8 / cfg.secs / 1000.0,
+	    pct(0.5), pct(0.9), pct(0.99),
+	    retry_hist[0], retry_hist[1], retry_hist[2], retry_hist[3],
+	    tx_fail, tx_ccafail, st.collisions, edth / nnodes);
+
+	sim_destroy(sim);
+	free(apps);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *list = "10,50,100,500,1000";
+	char *s, *tok, *copy;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:r:l:t:R:TN:c:e")) != -1) {
+		switch (c) {
+		case 'n':
+			list = optarg;
+			break;
+		case 'r':
+			cfg.rate = atof(optarg);
+			break;
+		case 'l':
+			cfg.len = atoi(optarg);
+			break;
+		case 't':
+			cfg.secs = atof(optarg);
+			break;
+		case 'R':
+			cfg.radius = atof(optarg);
+			break;
+		case 'T':
+			cfg.turbo = 1;
+			break;
+		case 'N':
+			cfg.noise = atoi(optarg);
+			break;
+		case 'c':
+			cfg.cca_mode = atoi(optarg);
+			break;
+		case 'e':
+			cfg.cca_adapt = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n nodes,...] [-r rate] "
+			    "[-l len] [-t secs] [-R radius] [-T] [-N noise] [-c mode] "
+			    "[-e]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (cfg.len < 10)
+		cfg.len = 10;
+	if (cfg.len > 127 - HDR_LEN - 2)
+		cfg.len = 127 - HDR_LEN - 2;
+
+	printf("%6s %8s %8s %7s %9s %7s %7s %7s "
+	    "%6s %6s %6s %6s %6s %6s %8s %5s\n",
+	    "nodes", "offered", "deliv", "ratio", "kbit/s",
+	    "p50ms", "p90ms", "p99ms",
+	    "r0", "r1", "r2", "r3", "fail", "ccaf", "collide", "edth");
+
+	copy = strdup(list);
+	for (s = copy; (tok = strtok(s, ",")) != (void *)0; s = (void *)0)
+		run(atoi(tok));
+	free(copy);
+
+	return 0;
+}
@@ -0,0 +1,460 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Sleepy end device polling on the simulated RF medium.
+ *
+ * N devices around a coordinator (node 0) sleep and poll it for data
+ * with sleepy.c. The coordinator queues downstream frames per device,
+ * arriving in bursts: each device alternates between active periods
+ * (mean -o s) with frames at -r per second and idle periods (mean -f
+ * s). It sets the frame pending bit of its ACKs while any queue holds
+ * a frame. Each min:max pair of poll intervals (in ms; min = max is a
+ * fixed interval) is run once. Reported are the radio duty cycle of
+ * the devices, polls per device and second, the share of wakeups that
+ * found the frame pending bit set but no frame, the delivery ratio,
+ * duplicates and the downlink latency from enqueue to reception. The
+ * coordinator numbers its frames like a MAC does; repeats after a lost
+ * ACK are dropped by sleepy.c (rpts), while frames it sent anew after
+ * one reach the application twice (dups). Build on the host with:
+ *
+ *   cc -O2 -I. -DMRF24J40_HAL_HOST -DMRF24J40_MULTI -o sleepy_bench \
+ *	tools/sleepy_bench.c sleepy.c ieee802154.c hal_sim.c hal_host.c \
+ *	MRF24J40.c -lm
+ *
+ * Usage: sleepy_bench [-n devices] [-i min:max[,min:max...]]
+ *	[-r pkts/s] [-o active s] [-f idle s] [-t seconds]
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hal_sim.h"
+#include "sleepy.h"
+
+#define COORD_NODE	0
+#define PAN		0x1234
+#define TICK		SIM_MS(1)
+#define RX_WAIT		10	/* ticks */
+#define QLEN		16
+#define HDR_LEN		9
+#define PAYLOAD		20
+
+struct node_app {
+	/* Coordinator: frames queued for this device */
+	sim_time_t	q[QLEN];
+	unsigned short	qseq[QLEN];
+	int		qhead;
+	int		qlen;
+	int		active;
+	unsigned short	seq;
+
+	/* Device */
+	struct sleepy	sl;
+	unsigned short	last_seq;	/* for duplicates */
+	int		seen;
+	sim_time_t	on_since;
+	sim_time_t	on_time;
+};
+
+static struct {
+	int		ndev;
+	double		rate;
+	double		on;
+	double		off;
+	double		secs;
+} cfg = { 10, 10.0, 2.0, 10.0, 60.0 };
+
+static struct node_app *apps;
+static struct {
+	int		dev;
+	sim_time_t	t;
+} *req;					/* data requests to serve */
+static int req_head, req_len, req_size;
+static unsigned char coord_dsn;
+static int coord_busy, coord_dst, queued;
+static double *lat;
+static unsigned long nlat, lat_size;
+static unsigned long offered, qdrops, dups;
+
+static double
+expo(struct sim *sim, double mean)
+{
+	double u = (sim_random(sim) + 1.0) / 4294967297.0;
+
+	return -log(u) * mean;
+}
+
+/*
+ * Coordinator
+ */
+static void
+coord_send(struct sim_node *n)
+{
+	struct node_app *a;
+	unsigned char hdr[HDR_LEN], pkt[PAYLOAD];
+	struct mrf24j40_iov iov[2];
+	sim_time_t now = sim_now(sim_node_sim(n));
+	int d;
+
+	while (!coord_busy && req_len > 0) {
+		d = req[req_head].dev;
+		if (now - req[req_head].t > SIM_MS(RX_WAIT - 2))
+			d = 0;		/* the device no longer listens */
+		req_head = (req_head + 1) % req_size;
+		req_len--;
+
+		a = &apps[d];
+		if (d == 0 || a->qlen == 0)
+			continue;
+
+		hdr[0] = FCFRTYP_DATA | FCREQACK | FCPANCOMP;
+		if (a->qlen > 1)
+			hdr[0] |= FCFRPEN;
+		hdr[1] = FCDADDRM(FCADDR_SHORT) | FCSADDRM(FCADDR_SHORT);
+		hdr[2] = coord_dsn++;
+		hdr[3] = PAN & 0xFF;
+		hdr[4] = PAN >> 8;
+		hdr[5] = d & 0xFF;
+		hdr[6] = d >> 8;
+		hdr[7] = hdr[8] = 0;
+
+		memset(pkt, 0, sizeof(pkt));
+		memcpy(pkt, &a->q[a->qhead], sizeof(sim_time_t));
+		memcpy(pkt + sizeof(sim_time_t), &a->qseq[a->qhead],
+		    sizeof(unsigned short));
+
+		iov[0].base = hdr;
+		iov[0].len = sizeof(hdr);
+		iov[1].base = pkt;
+		iov[1].len = sizeof(pkt);
+		mrf24j40_txpkt_iov(iov, 2, 1, 0);
+
+		coord_busy = 1;
+		coord_dst = d;
+	}
+}
+
+static void
+coord_irq(struct sim_node *n, void *arg)
+{
+	struct ieee802154_frame fr;
+	struct node_app *a;
+	unsigned char buf[128];
+	int ev, i;
+
+	ev = mrf24j40_int_tasks();
+
+	if (ev & MRF24J40_INT_RX) {
+		if (mrf24j40_rxpkt_intcb(buf, 127, (void *)0, (void *)0) == 0 &&
+		    ieee802154_parse(buf + 1, buf[0] - 2, &fr) == 0 &&
+		    sleepy_is_data_req(&fr) && fr.src.mode == FCADDR_SHORT &&
+		    fr.src.short_addr >= 1 && fr.src.short_addr <= cfg.ndev &&
+		    req_len < req_size) {
+			i = (req_head + req_len++) % req_size;
+			req[i].dev = fr.src.short_addr;
+			req[i].t = sim_now(sim_node_sim(n));
+		}
+	}
+
+	if (ev & MRF24J40_INT_TX) {
+		/* A frame that was not acknowledged waits for the next poll */
+		if (mrf24j40_txpkt_intcb() == 0) {
+			a = &apps[coord_dst];
+			a->qhead = (a->qhead + 1) % QLEN;
+			a->qlen--;
+			if (--queued == 0)
+				mrf24j40_set_frame_pending(0);
+		}
+		coord_busy = 0;
+	}
+
+	coord_send(n);
+}
+
+static void
+gen(struct sim_node *coord, void *arg)
+{
+	struct sim *sim = sim_node_sim(coord);
+	struct node_app *a = arg;
+
+	if (!a->active)
+		return;
+
+	offered++;
+	if (a->qlen == QLEN) {
+		qdrops++;
+	} else {
+		a->q[(a->qhead + a->qlen) % QLEN] = sim_now(sim);
+		a->qseq[(a->qhead + a->qlen++) % QLEN] = a->seq++;
+		if (queued++ == 0) {
+			sim_select(coord);
+			mrf24j40_set_frame_pending(1);
+		}
+	}
+
+	sim_timer(coord, (sim_time_t)(expo(sim, 1.0 / cfg.rate) * 1e9), gen,
+	    arg);
+}
+
+static void
+phase(struct sim_node *coord, void *arg)
+{
+	struct sim *sim = sim_node_sim(coord);
+	struct node_app *a = arg;
+
+	a->active = !a->active;
+	if (a->active)
+		sim_timer(coord, (sim_time_t)(expo(sim, 1.0 / cfg.rate) * 1e9),
+		    gen, arg);
+
+	sim_timer(coord, (sim_time_t)(expo(sim, a->active ? cfg.on :
+	    cfg.off) * 1e9), phase, arg);
+}
+
+/*
+ * Devices
+ */
+static void
+track(struct sim_node *n, struct node_app *a, int was_awake)
+{
+	sim_time_t now = sim_now(sim_node_sim(n));
+
+	if (!was_awake && sleepy_awake(&a->sl))
+		a->on_since = now;
+	else if (was_awake && !sleepy_awake(&a->sl))
+		a->on_time += now - a->on_since;
+}
+
+static void
+deliver(struct sim *sim, struct node_app *a, unsigned char *p)
+{
+	unsigned short seq;
+	sim_time_t t;
+
+	memcpy(&t, p, sizeof(t));
+	memcpy(&seq, p + sizeof(t), sizeof(seq));
+
+	/* Sent anew by the coordinator, after a lost ACK */
+	if (a->seen && seq == a->last_seq) {
+		dups++;
+		return;
+	}
+	a->seen = 1;
+	a->last_seq = seq;
+
+	if (nlat == lat_size) {
+		lat_size = lat_size ? 2 * lat_size : 4096;
+		lat = realloc(lat, lat_size * sizeof(*lat));
+	}
+	lat[nlat++] = (sim_now(sim) - t) / 1e6;
+}
+
+static void
+dev_irq(struct sim_node *n, void *arg)
+{
+	struct node_app *a = &apps[sim_node_id(n)];
+	struct ieee802154_frame fr;
+	unsigned char buf[128];
+	int ev, awake = sleepy_awake(&a->sl);
+
+	ev = mrf24j40_int_tasks();
+
+	if (ev & MRF24J40_INT_RX) {
+		if (mrf24j40_rxpkt_intcb(buf, 127, (void *)0, (void *)0) == 0 &&
+		    ieee802154_parse(buf + 1, buf[0] - 2, &fr) == 0 &&
+		    sleepy_input(&a->sl, &fr) && fr.payload_len >= 10)
+			deliver(sim_node_sim(n), a, fr.payload);
+	}
+
+	if (ev & MRF24J40_INT_TX)
+		sleepy_tx_done(&a->sl, mrf24j40_txpkt_intcb());
+
+	track(n, a, awake);
+}
+
+static void
+dev_tick(struct sim_node *n, void *arg)
+{
+	struct node_app *a = &apps[sim_node_id(n)];
+	int awake = sleepy_awake(&a->sl);
+
+	sleepy_tick(&a->sl);
+	track(n, a, awake);
+
+	sim_timer(n, TICK, dev_tick, arg);
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+static double
+pct(double p)
+{
+	if (nlat == 0)
+		return 0;
+	return lat[(unsigned long)(p * (nlat - 1))];
+}
+
+static void
+run(int min, int max)
+{
+	struct sim *sim;
+	struct sim_node *n;
+	struct sleepy_stats st;
+	sim_time_t on = 0;
+	double ang, r, sum = 0;
+	unsigned long i;
+	int d;
+
+	apps = calloc(cfg.ndev + 1, sizeof(*apps));
+	req_size = 4 * cfg.ndev;
+	req = calloc(req_size, sizeof(*req));
+	req_head = req_len = coord_busy = queued = 0;
+	nlat = offered = qdrops = dups = 0;
+	memset(&st, 0, sizeof(st));
+
+	sim = sim_create(cfg.ndev + 1, 0x51EE9UL);
+
+	for (d = 0; d <= cfg.ndev; d++) {
+		n = sim_node(sim, d);
+		sim_select(n);
+		mrf24j40_init(0);
+		mrf24j40_set_pan(PAN);
+		mrf24j40_set_short_addr(d);
+		/*
+		 * Devices up to 20 m apart are below the default energy
+		 * threshold; sense each other's carrier so their data
+		 * requests do not collide as hidden nodes.
+		 */
+		mrf24j40_set_cca(1, 2, 0x60);
+
+		if (d == COORD_NODE) {
+			sim_set_pos(n, 0, 0);
+			mrf24j40_set_coordinator();
+			sim_set_irq(n, coord_irq, (void *)0);
+			continue;
+		}
+
+		ang = (sim_random(sim) % 3600) * M_PI / 1800;
+		r = 10.0 * sqrt((sim_random(sim) % 10000) / 1e4);
+		sim_set_pos(n, r * cos(ang), r * sin(ang));
+
+		sleepy_init(&apps[d].sl, COORD_NODE, min, max, RX_WAIT,
+		    SLEEPY_F_SPI_WAKE);
+		sleepy_start(&apps[d].sl);
+		sim_set_irq(n, dev_irq, (void *)0);
+		sim_timer(n, TICK + SIM_US(sim_random(sim) % 1000), dev_tick,
+		    (void *)0);
+		sim_timer(sim_node(sim, COORD_NODE),
+		    (sim_time_t)(expo(sim, cfg.off) * 1e9), phase, &apps[d]);
+	}
+
+	sim_run(sim, (sim_time_t)(cfg.secs * 1e9));
+
+	for (d = 1; d <= cfg.ndev; d++) {
+		on += apps[d].on_time;
+		if (sleepy_awake(&apps[d].sl))
+			on += sim_now(sim) - apps[d].on_since;
+		st.polls += apps[d].sl.stats.polls;
+		st.pending += apps[d].sl.stats.pending;
+		st.empty += apps[d].sl.stats.empty;
+		st.fails += apps[d].sl.stats.fails;
+		st.dups += apps[d].sl.stats.dups;
+	}
+
+	qsort(lat, nlat, sizeof(*lat), cmp_double);
+	for (i = 0; i < nlat; i++)
+		sum += lat[i];
+
+	printf("%5d:%-5d %7.2f%% %8.1f %7.1f%% %7.1f%% %6lu %6u %8.1f %8.1f "
+	    "%8.1f\n", min, max, 100.0 * on / (cfg.secs * 1e9 * cfg.ndev),
+	    st.polls / cfg.secs / cfg.ndev,
+	    st.polls ? 100.0 * st.empty / st.polls : 0.0,
+	    offered ? 100.0 * nlat / offered : 0.0, dups, st.dups,
+	    nlat ? sum / nlat : 0.0, pct(0.5), pct(0.9));
+
+	sim_destroy(sim);
+	free(apps);
+	free(req);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *list = "20:20,100:100,500:500,20:500,10:1000";
+	char *s, *tok, *copy;
+	int c, min, max;
+
+	while ((c = getopt(argc, argv, "n:i:r:o:f:t:")) != -1) {
+		switch (c) {
+		case 'n':
+			cfg.ndev = atoi(optarg);
+			break;
+		case 'i':
+			list = optarg;
+			break;
+		case 'r':
+			cfg.rate = atof(optarg);
+			break;
+		case 'o':
+			cfg.on = atof(optarg);
+			break;
+		case 'f':
+			cfg.off = atof(optarg);
+			break;
+		case 't':
+			cfg.secs = atof(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n devices] "
+			    "[-i min:max,...] [-r rate] [-o active] [-f idle] "
+			    "[-t secs]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (cfg.ndev < 1)
+		cfg.ndev = 1;
+
+	printf("%11s %8s %8s %8s %8s %6s %6s %8s %8s %8s\n", "interval",
+	    "duty", "polls/s", "empty", "deliv", "dups", "rpts", "mean ms",
+	    "p50ms", "p90ms");
+
+	copy = strdup(list);
+	for (s = copy; (tok = strtok(s, ",")) != (void *)0; s = (void *)0) {
+		min = atoi(tok);
+		max = strchr(tok, ':') ? atoi(strchr(tok, ':') + 1) : min;
+		run(min, max);
+	}
+	free(copy);
+
+	return 0;
+}
@@ -0,0 +1,239 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Replays an SPI trace recorded by hal_trace.c against a simulated radio
+ * (hal_sim.c) and summarizes where the SPI traffic went, per driver
+ * call. Reads that come back different from the recorded ones are
+ * counted; they show where the simulated chip state diverged from the
+ * traced one (ACKs, received frames, interrupt timing). Build on the host
+ * with:
+ *
+ *   cc -O2 -I. -DMRF24J40_HAL_HOST -DMRF24J40_MULTI -DHAL_TRACE \
+ *	-o trace_replay \
+ *	tools/trace_replay.c hal_sim.c hal_host.c MRF24J40.c -lm
+ *
+ * Usage: trace_replay [-f SPI clock Hz] trace
+ *
+ * Columns: calls, SPI transactions, bytes on the bus, SPI time as
+ * recorded, SPI time computed from the bytes at the given clock, time
+ * spent in the calls as recorded, and diverging reads. The times are
+ * in microseconds; traces from the simulator have none recorded.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hal_sim.h"
+#include "hal_trace.h"
+
+#define OUTSIDE		HAL_TRACE_NAMES		/* accesses outside any call */
+
+struct fn_stats {
+	char		name[256];
+	unsigned long	calls;
+	unsigned long	xfers;
+	unsigned long	bytes;
+	unsigned long	spi_us;
+	unsigned long	call_us;
+	unsigned long	mismatch;
+};
+
+static struct fn_stats fns[HAL_TRACE_NAMES + 1];
+static unsigned long hz = 5000000;
+
+static unsigned long
+get32(FILE *f)
+{
+	unsigned long v = 0;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		v |= (unsigned long)(getc(f) & 0xFF) << (8 * i);
+
+	return v;
+}
+
+static int
+cmp_bytes(const void *a, const void *b)
+{
+	const struct fn_stats *x = a, *y = b;
+
+	return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+}
+
+static void
+print(struct fn_stats *s)
+{
+	printf("%-28s %7lu %7lu %8lu %9lu %9.0f %9lu %6lu\n",
+	    s->name, s->calls, s->xfers, s->bytes, s->spi_us,
+	    s->bytes * 8e6 / hz, s->call_us, s->mismatch);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct sim *sim;
+	struct sim_node *node;
+	struct fn_stats *cur, total;
+	unsigned char *ring, *r, d[256];
+	unsigned long dropped, used, now = 0, cs_start = 0, call_start = 0;
+	unsigned int off, len, alen, dlen;
+	int c, i, nnames, rd;
+	FILE *f;
+
+	while ((c = getopt(argc, argv, "f:")) != -1) {
+		switch (c) {
+		case 'f':
+			hz = strtoul(optarg, (void *)0, 0);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || hz == 0)
+		goto usage;
+
+	if ((f = fopen(argv[optind], "rb")) == (void *)0) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	if (fread(d, 1, 5, f) != 5 || memcmp(d, HAL_TRACE_MAGIC, 4) != 0 ||
+	    d[4] != HAL_TRACE_VERSION) {
+		fprintf(stderr, "%s: not a trace\n", argv[optind]);
+		return 1;
+	}
+
+	nnames = getc(f);
+	for (i = 0; i < nnames && i < HAL_TRACE_NAMES; i++) {
+		len = getc(f) & 0xFF;
+		if (fread(fns[i].name, 1, len, f) != len)
+			break;
+	}
+	strcpy(fns[OUTSIDE].name, "(outside driver calls)");
+
+	dropped = get32(f);
+	used = get32(f);
+	ring = malloc(used + 1);
+	if (ring == (void *)0 || fread(ring, 1, used, f) != used) {
+		fprintf(stderr, "%s: truncated\n", argv[optind]);
+		return 1;
+	}
+	fclose(f);
+
+	/* A radio in its reset state, unless the trace starts with init */
+	sim = sim_create(1, 1);
+	node = sim_node(sim, 0);
+	sim_select(node);
+
+	cur = &fns[OUTSIDE];
+	for (off = 0; off + HAL_TRACE_HDR <= used; off += HAL_TRACE_HDR + len) {
+		r = &ring[off];
+		len = r[1];
+		if (off + HAL_TRACE_HDR + len > used)
+			break;
+
+		/* Let the simulated chip run for the time that passed */
+		now += r[2] | (r[3] << 8);
+		sim_run(sim, SIM_US(now));
+		sim_select(node);
+
+		r += HAL_TRACE_HDR;
+		switch (ring[off]) {
+		case HAL_TRACE_ENTER:
+			cur = &fns[r[0] < nnames ? r[0] : OUTSIDE];
+			cur->calls++;
+			call_start = now;
+			break;
+		case HAL_TRACE_LEAVE:
+			cur->call_us += now - call_start;
+			cur = &fns[OUTSIDE];
+			break;
+		case HAL_TRACE_CS:
+			hal_host_cs(r[0]);
+			if (r[0] == 0) {
+				cs_start = now;
+			} else {
+				cur->xfers++;
+				cur->spi_us += now - cs_start;
+			}
+			break;
+		case HAL_TRACE_WRITE:
+			spi_write(r[0]);
+			cur->bytes++;
+			break;
+		case HAL_TRACE_READ:
+			if (spi_read() != r[0])
+				cur->mismatch++;
+			cur->bytes++;
+			break;
+		case HAL_TRACE_XFER:
+			alen = r[2] & ~HAL_TRACE_XFER_RD;
+			rd = (r[2] & HAL_TRACE_XFER_RD) != 0;
+			dlen = len - 3 - alen;
+			memcpy(d, &r[3 + alen], dlen);
+			spi_xfer(&r[3], alen, d, dlen, rd);
+			if (rd && memcmp(d, &r[3 + alen], dlen) != 0)
+				cur->mismatch++;
+			cur->xfers++;
+			cur->bytes += alen + dlen;
+			cur->spi_us += r[0] | (r[1] << 8);
+			break;
+		}
+	}
+
+	memset(&total, 0, sizeof(total));
+	strcpy(total.name, "total");
+	for (i = 0; i <= OUTSIDE; i++) {
+		total.calls += fns[i].calls;
+		total.xfers += fns[i].xfers;
+		total.bytes += fns[i].bytes;
+		total.spi_us += fns[i].spi_us;
+		total.call_us += fns[i].call_us;
+		total.mismatch += fns[i].mismatch;
+	}
+
+	qsort(fns, OUTSIDE + 1, sizeof(fns[0]), cmp_bytes);
+
+	printf("%lu bytes of records, %lu records dropped, %lu us\n\n",
+	    used, dropped, now);
+	printf("%-28s %7s %7s %8s %9s %9s %9s %6s\n", "function",
+	    "calls", "xfers", "bytes", "spi us", "model us", "call us",
+	    "diverg");
+	for (i = 0; i <= OUTSIDE; i++) {
+		if (fns[i].calls != 0 || fns[i].bytes != 0)
+			print(&fns[i]);
+	}
+	print(&total);
+
+	sim_destroy(sim);
+	free(ring);
+
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-f hz] trace\n", argv[0]);
+	return 1;
+}
@@ -0,0 +1,376 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Delivery ratio of TSCH versus single channel CSMA-CA, on the
+ * simulated RF medium.
+ *
+ * The nodes form clusters of -C nodes: a head and members placed around
+ * it, the heads at random within a disc. Members send fixed size frames
+ * to their head with exponentially distributed inter-arrival times.
+ * With CSMA every node sits on channel 11. With TSCH, cluster k uses
+ * channel offset k % 16 and each member a dedicated cell to its head;
+ * clusters beyond the first 16 get further slots, so the schedule is
+ * free of collisions. Build on the host with:
+ *
+ *   cc -O2 -I. -DMRF24J40_HAL_HOST -DMRF24J40_MULTI -o tsch_bench \
+ *	tools/tsch_bench.c tsch.c hal_sim.c hal_host.c MRF24J40.c -lm
+ *
+ * Usage: tsch_bench [-n nodes[,nodes...]] [-C cluster size]
+ *	[-r pkts/s per node] [-l payload bytes] [-t seconds] [-R radius m]
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hal_sim.h"
+#include "tsch.h"
+
+#define PAN		0x1234
+#define QLEN		TSCH_QLEN
+#define HDR_LEN		9
+#define NCH		16
+#define CLUSTER_RADIUS	8.0
+
+struct node_app {
+	int		head;		/* node id of the cluster head */
+	struct tsch	tsch;
+
+	/* Frames queued, with their enqueue times */
+	unsigned char	buf[QLEN][MRF24J40_TXPKT_MAX];
+	sim_time_t	q[QLEN];
+	int		qhead;
+	int		qlen;
+	int		busy;		/* CSMA: frame handed to the radio */
+	unsigned short	seq;
+
+	/* At a head, per member: last sequence number, for duplicates */
+	unsigned short	*last_seq;
+	unsigned char	*seen;
+};
+
+static struct {
+	int		nnodes;
+	int		csize;
+	double		rate;
+	int		len;
+	double		secs;
+	double		radius;
+	int		tsch;
+} cfg = { 0, 10, 0.5, 20, 10.0, 30.0, 0 };
+
+static struct node_app *apps, *cur;
+static double *lat;
+static unsigned long nlat, lat_size;
+static unsigned long delivered, dups, offered, qdrops, tx_fail;
+
+static double
+expo(struct sim *sim, double rate)
+{
+	double u = (sim_random(sim) + 1.0) / 4294967297.0;
+
+	return -log(u) / rate;
+}
+
+static void
+csma_send_next(struct node_app *a)
+{
+	mrf24j40_txpkt(a->head, a->buf[a->qhead], cfg.len, 0);
+	a->busy = 1;
+}
+
+/* Called from tsch_tx_done() in node_irq, for the node in cur */
+static void
+tx_done(unsigned short dest, unsigned char *data, int err)
+{
+	struct node_app *a = cur;
+
+	if (err)
+		tx_fail++;
+
+	a->qhead = (a->qhead + 1) % QLEN;
+	a->qlen--;
+}
+
+static void
+gen(struct sim_node *n, void *arg)
+{
+	struct sim *sim = sim_node_sim(n);
+	struct node_app *a = &apps[sim_node_id(n)];
+	unsigned char *pkt;
+	sim_time_t t = sim_now(sim);
+	int i;
+
+	offered++;
+	if (a->qlen == QLEN) {
+		qdrops++;
+	} else {
+		i = (a->qhead + a->qlen++) % QLEN;
+		pkt = a->buf[i];
+		memset(pkt, 0, cfg.len);
+		memcpy(pkt, &t, sizeof(t));
+		memcpy(pkt + sizeof(t), &a->seq, sizeof(a->seq));
+		a->seq++;
+
+		if (cfg.tsch)
+			tsch_send(&a->tsch, a->head, pkt, cfg.len);
+		else if (!a->busy)
+			csma_send_next(a);
+	}
+
+	sim_timer(n, (sim_time_t)(expo(sim, cfg.rate) * 1e9), gen, arg);
+}
+
+static void
+head_rx(struct sim_node *n)
+{
+	struct sim *sim = sim_node_sim(n);
+	struct node_app *h = &apps[sim_node_id(n)];
+	unsigned char buf[128];
+	unsigned short seq, saddr;
+	sim_time_t t;
+	int m;
+
+	if (mrf24j40_rxpkt_intcb(buf, 127, (void *)0, (void *)0) != 0) {
+		mrf24j40_rxfifo_flush();
+		return;
+	}
+
+	/* buf[0] is the length, the MAC header follows */
+	saddr = buf[1 + 7] | (buf[1 + 8] << 8);
+	if (saddr >= cfg.nnodes || apps[saddr].head != sim_node_id(n))
+		return;
+
+	memcpy(&t, &buf[1 + HDR_LEN], sizeof(t));
+	memcpy(&seq, &buf[1 + HDR_LEN + sizeof(t)], sizeof(seq));
+
+	/* Retransmissions after a lost ACK */
+	m = saddr - sim_node_id(n);
+	if (h->seen[m] && seq == h->last_seq[m]) {
+		dups++;
+		return;
+	}
+	h->seen[m] = 1;
+	h->last_seq[m] = seq;
+
+	delivered++;
+	if (nlat == lat_size) {
+		lat_size = lat_size ? 2 * lat_size : 4096;
+		lat = realloc(lat, lat_size * sizeof(*lat));
+	}
+	lat[nlat++] = (sim_now(sim) - t) / 1e6;
+}
+
+static void
+node_irq(struct sim_node *n, void *arg)
+{
+	struct node_app *a = &apps[sim_node_id(n)];
+	int ev;
+
+	ev = mrf24j40_int_tasks();
+
+	if (ev & MRF24J40_INT_TMR)
+		tsch_timer(&a->tsch);
+
+	if (ev & MRF24J40_INT_RX)
+		head_rx(n);
+
+	if (!(ev & MRF24J40_INT_TX))
+		return;
+
+	if (cfg.tsch) {
+		cur = a;
+		tsch_tx_done(&a->tsch);
+		return;
+	}
+
+	if (mrf24j40_txpkt_intcb() != 0)
+		tx_fail++;
+
+	a->qhead = (a->qhead + 1) % QLEN;
+	a->qlen--;
+	a->busy = 0;
+	if (a->qlen > 0)
+		csma_send_next(a);
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+static double
+pct(double p)
+{
+	if (nlat == 0)
+		return 0;
+	return lat[(unsigned long)(p * (nlat - 1))];
+}
+
+static void
+run(int nnodes)
+{
+	struct sim *sim;
+	struct sim_node *n;
+	struct node_app *a;
+	double x, y, ang, r, hx = 0, hy = 0;
+	int i, k, m, nclusters, sf_len;
+
+	cfg.nnodes = nnodes;
+	apps = calloc(nnodes, sizeof(*apps));
+	nlat = delivered = dups = offered = qdrops = tx_fail = 0;
+
+	nclusters = (nnodes + cfg.csize - 1) / cfg.csize;
+	sf_len = (cfg.csize - 1) * ((nclusters + NCH - 1) / NCH);
+
+	sim = sim_create(nnodes, 0x2545F491UL + nnodes);
+
+	for (i = 0; i < nnodes; i++) {
+		n = sim_node(sim, i);
+		a = &apps[i];
+		k = i / cfg.csize;
+		m = i % cfg.csize;
+		a->head = k * cfg.csize;
+
+		ang = (sim_random(sim) % 3600) * M_PI / 1800;
+		if (m == 0) {
+			r = cfg.radius * sqrt((sim_random(sim) % 10000) / 1e4);
+			hx = x = r * cos(ang);
+			hy = y = r * sin(ang);
+			a->last_seq = calloc(cfg.csize, sizeof(*a->last_seq));
+			a->seen = calloc(cfg.csize, 1);
+		} else {
+			r = CLUSTER_RADIUS *
+			    sqrt((sim_random(sim) % 10000) / 1e4);
+			x = hx + r * cos(ang);
+			y = hy + r * sin(ang);
+		}
+		sim_set_pos(n, x, y);
+
+		sim_select(n);
+		mrf24j40_init(0);
+		mrf24j40_set_pan(PAN);
+		mrf24j40_set_short_addr(i);
+		sim_set_irq(n, node_irq, (void *)0);
+
+		if (cfg.tsch) {
+			tsch_init(&a->tsch, sf_len, tx_done);
+			if (m == 0) {
+				for (m = 1; m < cfg.csize; m++)
+					tsch_add_cell(&a->tsch,
+					    (k / NCH) * (cfg.csize - 1) + m - 1,
+					    k % NCH, TSCH_CELL_RX, i + m);
+			} else {
+				tsch_add_cell(&a->tsch,
+				    (k / NCH) * (cfg.csize - 1) + m - 1,
+				    k % NCH, TSCH_CELL_TX, a->head);
+			}
+			tsch_start(&a->tsch, 0);
+		}
+
+		if (i != a->head)
+			sim_timer(n, (sim_time_t)(expo(sim, cfg.rate) * 1e9),
+			    gen, (void *)0);
+	}
+
+	sim_run(sim, (sim_time_t)(cfg.secs * 1e9));
+
+	qsort(lat, nlat, sizeof(*lat), cmp_double);
+
+	printf("%6d %5s %8lu %8lu %6.1f%% %9.1f %8.1f %8.1f %8.1f "
+	    "%6lu %6lu\n",
+	    nnodes, cfg.tsch ? "tsch" : "csma", offered, delivered,
+	    offered ? 100.0 * delivered / offered : 0.0,
+	    delivered * cfg.len * 8 / cfg.secs / 1000.0,
+	    pct(0.5), pct(0.9), pct(0.99), qdrops, tx_fail);
+
+	sim_destroy(sim);
+	for (i = 0; i < nnodes; i++) {
+		free(apps[i].last_seq);
+		free(apps[i].seen);
+	}
+	free(apps);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *list = "10,50,100,500,1000";
+	char *s, *tok, *copy;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:C:r:l:t:R:")) != -1) {
+		switch (c) {
+		case 'n':
+			list = optarg;
+			break;
+		case 'C':
+			cfg.csize = atoi(optarg);
+			break;
+		case 'r':
+			cfg.rate = atof(optarg);
+			break;
+		case 'l':
+			cfg.len = atoi(optarg);
+			break;
+		case 't':
+			cfg.secs = atof(optarg);
+			break;
+		case 'R':
+			cfg.radius = atof(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n nodes,...] [-C size] "
+			    "[-r rate] [-l len] [-t secs] [-R radius]\n",
+			    argv[0]);
+			return 1;
+		}
+	}
+
+	if (cfg.csize < 2)
+		cfg.csize = 2;
+	if (cfg.len < 10)
+		cfg.len = 10;
+	if (cfg.len > MRF24J40_TXPKT_MAX)
+		cfg.len = MRF24J40_TXPKT_MAX;
+
+	printf("%6s %5s %8s %8s %7s %9s %8s %8s %8s %6s %6s\n",
+	    "nodes", "mode", "offered", "deliv", "ratio", "kbit/s",
+	    "p50ms", "p90ms", "p99ms", "qdrop", "fail");
+
+	copy = strdup(list);
+	for (s = copy; (tok = strtok(s, ",")) != (void *)0; s = (void *)0) {
+		cfg.tsch = 0;
+		run(atoi(tok));
+		cfg.tsch = 1;
+		run(atoi(tok));
+	}
+	free(copy);
+
+	return 0;
+}
@@ -0,0 +1,207 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Time synchronization accuracy on the simulated RF medium.
+ *
+ * N nodes are placed at random within a disc around the root (node 0),
+ * far enough apart for several hops with a large radius. Every node's
+ * clock gets a random skew within +-S ppm and a random offset. Once a
+ * second the error of each synchronized node's global time against the
+ * root's clock is sampled; reported are the number of synchronized
+ * nodes, mean and maximum absolute error, and the mean error of the
+ * drift estimate against the true skew relative to the root. Build on the host with:
+ *
+ *   cc -O2 -I. -DMRF24J40_HAL_HOST -DMRF24J40_MULTI -o tsync_bench \
+ *	tools/tsync_bench.c tsync.c ieee802154.c hal_sim.c hal_host.c \
+ *	MRF24J40.c -lm
+ *
+ * Usage: tsync_bench [-n nodes] [-s skew ppm] [-p beacon period s]
+ *	[-t seconds] [-R radius m]
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "hal_sim.h"
+#include "tsync.h"
+
+#define ROOT		0
+#define PAN		0x1234
+#define TICK		SIM_MS(10)
+
+struct node_app {
+	struct tsync	ts;
+	double		ppm;
+};
+
+static struct {
+	int		nnodes;
+	double		skew;
+	double		period;
+	double		secs;
+	double		radius;
+} cfg = { 20, 40.0, 5.0, 120.0, 30.0 };
+
+static struct node_app *apps;
+
+static void
+node_irq(struct sim_node *n, void *arg)
+{
+	struct node_app *a = &apps[sim_node_id(n)];
+	struct ieee802154_frame fr;
+	unsigned char buf[128];
+	int ev;
+
+	ev = mrf24j40_int_tasks();
+
+	if (ev & MRF24J40_INT_RX) {
+		if (mrf24j40_rxpkt_intcb(buf, 127, (void *)0, (void *)0) == 0 &&
+		    ieee802154_parse(buf + 1, buf[0] - 2, &fr) == 0)
+			tsync_input(&a->ts, &fr, mrf24j40_rx_stamp());
+	}
+
+	if (ev & MRF24J40_INT_TX)
+		tsync_tx_done(&a->ts, mrf24j40_txpkt_intcb());
+}
+
+static void
+tick(struct sim_node *n, void *arg)
+{
+	struct node_app *a = &apps[sim_node_id(n)];
+
+	tsync_tick(&a->ts);
+	tsync_poll(&a->ts);
+
+	sim_timer(n, TICK, tick, arg);
+}
+
+static void
+report(struct sim_node *root, void *arg)
+{
+	struct sim *sim = sim_node_sim(root);
+	struct node_app *a;
+	unsigned long g = sim_local_us(root);
+	double err, sum = 0, max = 0, dsum = 0;
+	int i, synced = 0;
+
+	for (i = 0; i < cfg.nnodes; i++) {
+		a = &apps[i];
+		if (i == ROOT || !tsync_synced(&a->ts))
+			continue;
+
+		err = fabs((double)(long)(tsync_global(&a->ts,
+		    sim_local_us(sim_node(sim, i))) - g));
+		sum += err;
+		if (err > max)
+			max = err;
+		dsum += fabs(tsync_drift_ppm(&a->ts) -
+		    (a->ppm - apps[ROOT].ppm));
+		synced++;
+	}
+
+	printf("%6.0f %6d %10.1f %10.1f %10.2f\n", sim_now(sim) / 1e9,
+	    synced, synced ? sum / synced : 0.0, max,
+	    synced ? dsum / synced : 0.0);
+
+	sim_timer(root, SIM_SEC(1), report, arg);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct sim *sim;
+	struct sim_node *n;
+	double ang, r;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "n:s:p:t:R:")) != -1) {
+		switch (c) {
+		case 'n':
+			cfg.nnodes = atoi(optarg);
+			break;
+		case 's':
+			cfg.skew = atof(optarg);
+			break;
+		case 'p':
+			cfg.period = atof(optarg);
+			break;
+		case 't':
+			cfg.secs = atof(optarg);
+			break;
+		case 'R':
+			cfg.radius = atof(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n nodes] [-s ppm] "
+			    "[-p period] [-t secs] [-R radius]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (cfg.nnodes < 2)
+		cfg.nnodes = 2;
+
+	apps = calloc(cfg.nnodes, sizeof(*apps));
+	sim = sim_create(cfg.nnodes, 0x5DEECE66UL + cfg.nnodes);
+
+	for (i = 0; i < cfg.nnodes; i++) {
+		n = sim_node(sim, i);
+		if (i == ROOT) {
+			sim_set_pos(n, 0, 0);
+		} else {
+			ang = (sim_random(sim) % 3600) * M_PI / 1800;
+			r = cfg.radius * sqrt((sim_random(sim) % 10000) / 1e4);
+			sim_set_pos(n, r * cos(ang), r * sin(ang));
+		}
+
+		apps[i].ppm = cfg.skew *
+		    ((sim_random(sim) % 20001) / 10000.0 - 1.0);
+		sim_set_clock(n, apps[i].ppm, sim_random(sim) % 1000000000);
+
+		sim_select(n);
+		mrf24j40_init(0);
+		mrf24j40_set_pan(PAN);
+		mrf24j40_set_short_addr(i);
+
+		tsync_init(&apps[i].ts, ROOT,
+		    (unsigned short)(cfg.period * SIM_SEC(1) / TICK));
+		sim_set_irq(n, node_irq, (void *)0);
+
+		/* Random phase, so the beacons do not all collide */
+		sim_timer(n, sim_random(sim) % TICK +
+		    (sim_random(sim) % 100) * TICK, tick, (void *)0);
+	}
+
+	printf("%6s %6s %10s %10s %10s\n",
+	    "secs", "synced", "mean us", "max us", "drift ppm");
+
+	sim_timer(sim_node(sim, ROOT), SIM_SEC(1), report, (void *)0);
+	sim_run(sim, (sim_time_t)(cfg.secs * 1e9));
+
+	sim_destroy(sim);
+	free(apps);
+
+	return 0;
+}
@@ -0,0 +1,137 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include "ieee802154.h"
+#include "tpc.h"
+
+/* Attenuation of the RFCON3 small steps, in 0.1 dB */
+static const unsigned char tpc_small[8] = { 0, 5, 12, 19, 28, 37, 49, 63 };
+
+static int
+tpc_att(int level)
+{
+	return (level >> 3) * 100 + tpc_small[level & 0x07];
+}
+
+/* Highest level (lowest power) with at most att 0.1 dB attenuation */
+static int
+tpc_level(int att)
+{
+	int l, s;
+
+	l = att / 100;
+	if (l > 3)
+		return MRF24J40_TXPOWER_MAX;
+
+	for (s = 7; tpc_small[s] > att - l * 100; s--)
+		;
+
+	return (l << 3) | s;
+}
+
+static void
+tpc_set(struct tpc *p, struct nbr *n, int level)
+{
+	if (level < 0)
+		level = 0;
+	if (level > p->max_level)
+		level = p->max_level;
+
+	if (level > n->txpower)
+		++p->stats.lowered;
+	else if (level < n->txpower)
+		++p->stats.raised;
+
+	n->txpower = level;
+	n->tx_run = 0;
+}
+
+void
+tpc_init(struct tpc *p, unsigned char target_rssi, int margin_db,
+    int max_level)
+{
+	memset(p, 0, sizeof(*p));
+	p->target_rssi = target_rssi;
+	p->margin_db = margin_db;
+	p->max_level = (max_level > MRF24J40_TXPOWER_MAX) ?
+	    MRF24J40_TXPOWER_MAX : max_level;
+}
+
+/* Set the power level for a transmission to dest */
+void
+tpc_select(struct nbr_table *t, unsigned short dest)
+{
+	struct nbr *n = (void *)0;
+
+	if (dest != IEEE802154_BCAST)
+		n = nbr_lookup(t, dest);
+
+	mrf24j40_set_txpower((n != (void *)0) ? n->txpower : 0);
+}
+
+/*
+ * Account the end of a transmission to dest, with the results of
+ * mrf24j40_txpkt_intcb() and mrf24j40_txpkt_retries(). This also
+ * updates the neighbor table (nbr_tx).
+ */
+void
+tpc_tx_done(struct tpc *p, struct nbr_table *t, unsigned short dest,
+    int retries, int err)
+{
+	struct nbr *n;
+
+	if (dest == IEEE802154_BCAST || err == EBUSY)
+		return;
+
+	n = nbr_tx(t, dest, retries, err);
+
+	if (err)
+		tpc_set(p, n, n->txpower - TPC_FAIL_STEP);
+	else if (retries)
+		tpc_set(p, n, n->txpower - 1);
+	else if (++n->tx_run >= TPC_PROBE_RUN)
+		tpc_set(p, n, n->txpower + 1);
+}
+
+/* peer received our last frame(s) with the given RSSI */
+void
+tpc_feedback(struct tpc *p, struct nbr_table *t, unsigned short peer,
+    unsigned char rssi)
+{
+	struct nbr *n = nbr_lookup(t, peer);
+	int excess;
+
+	if (n == (void *)0)
+		return;
+
+	++p->stats.feedback;
+
+	excess = ((int)rssi - p->target_rssi) * 10 / TPC_RSSI_STEPS -
+	    p->margin_db * 10;
+	if (excess < -tpc_att(n->txpower))
+		tpc_set(p, n, 0);
+	else
+		tpc_set(p, n, tpc_level(tpc_att(n->txpower) + excess));
+}
@@ -0,0 +1,81 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef _TPC_H_
+#define _TPC_H_
+
+#include "MRF24J40.h"
+#include "nbr.h"
+
+/*
+ * Per-destination transmit power control.
+ *
+ * The power level for each neighbor (see mrf24j40_set_txpower) is kept
+ * in its nbr.c entry; unknown destinations and broadcasts get full
+ * power. tpc_select() sets the level before a transmission; the driver
+ * only writes RFCON3 when it changes.
+ *
+ * The level adapts from two inputs:
+ *
+ * - TX outcomes (tpc_tx_done): a frame that was not acknowledged raises
+ *   the power by TPC_FAIL_STEP levels, one that needed retries by one
+ *   level. After TPC_PROBE_RUN frames acknowledged at the first attempt
+ *   the power is lowered by one level.
+ *
+ * - The RSSI the peer measured on our frames, when the application's
+ *   protocol reports it back (tpc_feedback). The level is then set to
+ *   have frames arrive at the target RSSI plus a margin, as far as that
+ *   is known from the step sizes of RFCON3.
+ *
+ * RSSI values are on the raw RSSI register scale.
+ */
+#define TPC_FAIL_STEP	8	/* 10 dB */
+#define TPC_PROBE_RUN	16
+
+/* RSSI register steps per dB, roughly */
+#ifndef TPC_RSSI_STEPS
+#define TPC_RSSI_STEPS	3
+#endif
+
+struct tpc_stats {
+	unsigned short	raised;
+	unsigned short	lowered;
+	unsigned short	feedback;
+};
+
+struct tpc {
+	unsigned char	target_rssi;
+	unsigned char	margin_db;
+	unsigned char	max_level;	/* lowest power allowed */
+	struct tpc_stats stats;
+};
+
+void tpc_init(struct tpc *p, unsigned char target_rssi, int margin_db,
+    int max_level);
+void tpc_select(struct nbr_table *t, unsigned short dest);
+void tpc_tx_done(struct tpc *p, struct nbr_table *t, unsigned short dest,
+    int retries, int err);
+void tpc_feedback(struct tpc *p, struct nbr_table *t, unsigned short peer,
+    unsigned char rssi);
+
+#endif /* _TPC_H_ */
@@ -0,0 +1,227 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include "ieee802154.h"
+#include "tsch.h"
+
+/* The 16 channel hopping sequence of IEEE 802.15.4e, channel 11 -> 0 */
+static const unsigned char tsch_hop_default[16] = {
+	5, 6, 12, 7, 15, 4, 14, 11, 8, 0, 1, 2, 13, 3, 9, 10
+};
+
+void
+tsch_init(struct tsch *t, unsigned short sf_len, tsch_tx_cb cb)
+{
+	memset(t, 0, sizeof(*t));
+	t->sf_len = sf_len;
+	t->cb = cb;
+	t->tx_pkt = -1;
+	tsch_set_hopping(t, tsch_hop_default, sizeof(tsch_hop_default));
+}
+
+/* hop must stay valid while the schedule runs */
+void
+tsch_set_hopping(struct tsch *t, const unsigned char *hop, int len)
+{
+	t->hop = hop;
+	t->hop_len = len;
+}
+
+int
+tsch_add_cell(struct tsch *t, unsigned short slot, unsigned char ch_off,
+    unsigned char flags, unsigned short nbr)
+{
+	struct tsch_cell *c;
+
+	if (t->ncells == TSCH_CELLS_MAX)
+		return ENOMEM;
+
+	c = &t->cell[t->ncells++];
+	c->slot = slot;
+	c->ch_off = ch_off;
+	c->flags = flags;
+	c->nbr = nbr;
+
+	return 0;
+}
+
+/*
+ * Queue a frame for dest. Returns ENOMEM if it is too long, or EBUSY if
+ * the queue is full.
+ */
+int
+tsch_send(struct tsch *t, unsigned short dest, unsigned char *data, int len)
+{
+	struct tsch_pkt *p;
+
+	if (len > MRF24J40_TXPKT_MAX)
+		return ENOMEM;
+	if (t->qlen == TSCH_QLEN)
+		return EBUSY;
+
+	p = &t->q[t->qlen++];
+	p->data = data;
+	p->len = len;
+	p->tries = 0;
+	p->dest = dest;
+
+	return 0;
+}
+
+/* Oldest queued frame that may go out in cell c, or -1 */
+static int
+tsch_find(struct tsch *t, struct tsch_cell *c)
+{
+	int i;
+
+	for (i = 0; i < t->qlen; i++) {
+		if (c->nbr == IEEE802154_BCAST || t->q[i].dest == c->nbr)
+			return i;
+	}
+
+	return -1;
+}
+
+/* Start of slot t->asn: pick the cell and switch the channel */
+static void
+tsch_slot(struct tsch *t)
+{
+	struct tsch_cell *c, *tx = (void *)0, *rx = (void *)0;
+	unsigned short slot = t->asn % t->sf_len;
+	int i, p = -1;
+
+	++t->stats.slots;
+
+	/* Retries of the last frame still going on; sit this one out */
+	if (t->tx_busy) {
+		++t->stats.overruns;
+		return;
+	}
+	t->tx_pkt = -1;
+
+	for (i = 0; i < t->ncells; i++) {
+		c = &t->cell[i];
+		if (c->slot != slot)
+			continue;
+
+		if (tx == (void *)0 && (c->flags & TSCH_CELL_TX) &&
+		    (p = tsch_find(t, c)) >= 0)
+			tx = c;
+		else if (rx == (void *)0 && (c->flags & TSCH_CELL_RX))
+			rx = c;
+	}
+
+	c = (tx != (void *)0) ? tx : rx;
+	if (c == (void *)0)
+		return;
+
+	/* The driver takes 11 and up as IEEE channel numbers */
+	mrf24j40_set_channel_fast(11 +
+	    t->hop[(t->asn + c->ch_off) % t->hop_len]);
+
+	if (tx != (void *)0) {
+		mrf24j40_set_csma(tx->flags & TSCH_CELL_SHARED);
+		t->tx_pkt = p;
+		++t->stats.tx_slots;
+	} else {
+		++t->stats.rx_slots;
+	}
+}
+
+/*
+ * Start the schedule; the current time is the start of slot asn. The
+ * other nodes have to start at the same time.
+ */
+void
+tsch_start(struct tsch *t, unsigned long asn)
+{
+	t->asn = asn - 1;
+	t->phase = 0;
+	tsch_timer(t);
+}
+
+/* To be called on MRF24J40_INT_TMR */
+void
+tsch_timer(struct tsch *t)
+{
+	struct tsch_pkt *p;
+
+	if (t->phase == 0) {
+		mrf24j40_timer_start(TSCH_TX_OFFSET_HSYM -
+		    TSCH_TMR_LATENCY_HSYM);
+		t->phase = 1;
+
+		++t->asn;
+		tsch_slot(t);
+		return;
+	}
+
+	mrf24j40_timer_start(TSCH_SLOT_HSYM - TSCH_TX_OFFSET_HSYM -
+	    TSCH_TMR_LATENCY_HSYM);
+	t->phase = 0;
+
+	if (t->tx_pkt >= 0 && !t->tx_busy) {
+		p = &t->q[t->tx_pkt];
+		mrf24j40_txpkt(p->dest, p->data, p->len, 0);
+		t->tx_busy = 1;
+	}
+}
+
+/* To be called on MRF24J40_INT_TX */
+void
+tsch_tx_done(struct tsch *t)
+{
+	struct tsch_pkt *p;
+	unsigned short dest;
+	unsigned char *data;
+	int err;
+
+	err = mrf24j40_txpkt_intcb();
+	if (!t->tx_busy)
+		return;
+
+	t->tx_busy = 0;
+	p = &t->q[t->tx_pkt];
+
+	if (err && ++p->tries < TSCH_MAX_TRIES) {
+		++t->stats.tx_retries;
+		t->tx_pkt = -1;
+		return;
+	}
+
+	if (err)
+		++t->stats.tx_dropped;
+	else
+		++t->stats.tx_ok;
+
+	dest = p->dest;
+	data = p->data;
+	memmove(p, p + 1, (t->qlen - t->tx_pkt - 1) * sizeof(*p));
+	--t->qlen;
+	t->tx_pkt = -1;
+
+	if (t->cb != (void *)0)
+		t->cb(dest, data, err);
+}
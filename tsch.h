@@ -0,0 +1,138 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef _TSCH_H_
+#define _TSCH_H_
+
+#include "MRF24J40.h"
+
+/*
+ * Time-slotted channel hopping (after IEEE 802.15.4e TSCH).
+ *
+ * Time is divided into timeslots of TSCH_SLOT_HSYM half symbols,
+ * numbered by the absolute slot number (ASN) and grouped into
+ * slotframes of sf_len slots that repeat. The schedule is a set of
+ * cells (slot offset in the slotframe, channel offset, neighbor); in a
+ * slot the node either transmits, listens or is idle. The channel of a
+ * cell is
+ *
+ *   hop[(asn + ch_off) % hop_len]
+ *
+ * so the link hops over the channels from one slotframe to the next.
+ * Dedicated cells are sent without CSMA-CA; shared cells (any number of
+ * senders) use it.
+ *
+ * Slot timing comes from the radio's half symbol timer: the application
+ * passes MRF24J40_INT_TMR to tsch_timer() and MRF24J40_INT_TX to
+ * tsch_tx_done(). At the start of a slot the channel is switched
+ * (mrf24j40_set_channel_fast); a frame is sent TSCH_TX_OFFSET_HSYM
+ * later, after the PLL settled and the receiver is listening. Received
+ * frames are read by the application as usual.
+ *
+ * All nodes must start the schedule at the same slot boundary with the
+ * same ASN (tsch_start); keeping them aligned over time is up to a time
+ * synchronization service. The latency between the timer interrupt and
+ * tsch_timer() adds to every slot unless TSCH_TMR_LATENCY_HSYM accounts
+ * for it.
+ *
+ * Frames are queued by reference; the caller's buffer must stay valid
+ * until the callback reports the outcome. A frame goes out in the next
+ * cell to its destination (or a shared TX cell) and is retried in later
+ * cells up to TSCH_MAX_TRIES times.
+ */
+#define TSCH_SLOT_HSYM		1250	/* 10 ms */
+#define TSCH_TX_OFFSET_HSYM	275	/* 2.2 ms */
+
+#ifndef TSCH_TMR_LATENCY_HSYM
+#define TSCH_TMR_LATENCY_HSYM	0
+#endif
+
+#ifndef TSCH_CELLS_MAX
+#define TSCH_CELLS_MAX		16
+#endif
+
+#ifndef TSCH_QLEN
+#define TSCH_QLEN		8
+#endif
+
+#define TSCH_MAX_TRIES		4
+
+/* Cell flags */
+#define TSCH_CELL_TX		0x01
+#define TSCH_CELL_RX		0x02
+#define TSCH_CELL_SHARED	0x04
+
+struct tsch_cell {
+	unsigned short	slot;
+	unsigned char	ch_off;
+	unsigned char	flags;
+	unsigned short	nbr;		/* TX: destination, or any if bcast */
+};
+
+struct tsch_pkt {
+	unsigned char	*data;
+	unsigned char	len;
+	unsigned char	tries;
+	unsigned short	dest;
+};
+
+typedef void (*tsch_tx_cb)(unsigned short dest, unsigned char *data,
+    int err);
+
+struct tsch_stats {
+	unsigned short	slots;
+	unsigned short	tx_slots;
+	unsigned short	rx_slots;
+	unsigned short	tx_ok;
+	unsigned short	tx_retries;
+	unsigned short	tx_dropped;	/* TSCH_MAX_TRIES used up */
+	unsigned short	overruns;	/* slot started with TX on the air */
+};
+
+struct tsch {
+	unsigned long	asn;
+	unsigned short	sf_len;
+	unsigned char	ncells;
+	unsigned char	phase;		/* next timer: 0 slot, 1 TX offset */
+	unsigned char	tx_busy;
+	signed char	tx_pkt;		/* queue index sent in this slot */
+	unsigned char	hop_len;
+	const unsigned char *hop;	/* channels, 0 -> channel 11 */
+	struct tsch_cell cell[TSCH_CELLS_MAX];
+	struct tsch_pkt	q[TSCH_QLEN];
+	unsigned char	qlen;
+	tsch_tx_cb	cb;
+	struct tsch_stats stats;
+};
+
+void tsch_init(struct tsch *t, unsigned short sf_len, tsch_tx_cb cb);
+void tsch_set_hopping(struct tsch *t, const unsigned char *hop, int len);
+int tsch_add_cell(struct tsch *t, unsigned short slot, unsigned char ch_off,
+    unsigned char flags, unsigned short nbr);
+int tsch_send(struct tsch *t, unsigned short dest, unsigned char *data,
+    int len);
+void tsch_start(struct tsch *t, unsigned long asn);
+void tsch_timer(struct tsch *t);
+void tsch_tx_done(struct tsch *t);
+
+#endif /* _TSCH_H_ */
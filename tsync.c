@@ -0,0 +1,223 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include "tsync.h"
+
+/* The node whose short address is root provides the global time */
+void
+tsync_init(struct tsync *t, unsigned short root, unsigned short period)
+{
+	struct mrf24j40_config cfg;
+
+	memset(t, 0, sizeof(*t));
+	mrf24j40_get_config(&cfg);
+
+	t->root = root;
+	t->is_root = (cfg.short_addr == root);
+	t->period = period;
+}
+
+/* Advance the clock; call it at a fixed interval */
+void
+tsync_tick(struct tsync *t)
+{
+	++t->now;
+}
+
+int
+tsync_synced(struct tsync *t)
+{
+	return (t->is_root || t->npoints >= TSYNC_MIN_POINTS);
+}
+
+/*
+ * Send a beacon if one is due and the node has the global time. Call
+ * it when the radio is idle; returns 1 if a beacon went to the radio.
+ */
+int
+tsync_poll(struct tsync *t)
+{
+	unsigned char b[TSYNC_LEN];
+
+	if (t->tx_busy || (short)(t->now - t->next_tx) < 0 ||
+	    !tsync_synced(t))
+		return 0;
+
+	if (t->is_root)
+		++t->rseq;
+
+	b[0] = TSYNC_DISPATCH;
+	b[1] = t->root & 0xFF;
+	b[2] = t->root >> 8;
+	b[3] = t->rseq & 0xFF;
+	b[4] = t->rseq >> 8;
+	b[5] = t->bseq;
+	b[6] = t->prev_valid ? TSYNC_F_VALID : 0;
+	b[7] = t->prev_global & 0xFF;
+	b[8] = (t->prev_global >> 8) & 0xFF;
+	b[9] = (t->prev_global >> 16) & 0xFF;
+	b[10] = (t->prev_global >> 24) & 0xFF;
+
+	mrf24j40_txpkt(IEEE802154_BCAST, b, TSYNC_LEN, 0);
+	++t->stats.tx;
+
+	t->tx_busy = 1;
+	t->next_tx = t->now + t->period;
+
+	return 1;
+}
+
+/* End of a beacon transmission, with the result of mrf24j40_txpkt_intcb() */
+void
+tsync_tx_done(struct tsync *t, int err)
+{
+	t->tx_busy = 0;
+	++t->bseq;
+
+	t->prev_valid = (!err && tsync_synced(t));
+	if (t->prev_valid)
+		t->prev_global = tsync_global(t, mrf24j40_tx_stamp());
+}
+
+/* Least squares fit of the offsets over the local time */
+static void
+tsync_fit(struct tsync *t)
+{
+	struct tsync_point *ref;
+	float mx = 0, my = 0, sxx = 0, sxy = 0, dx, dy;
+	int i, n = t->npoints;
+
+	/* Relative to the newest point, to keep the precision */
+	ref = &t->pt[(t->pos + TSYNC_POINTS - 1) % TSYNC_POINTS];
+
+	for (i = 0; i < n; i++) {
+		mx += (long)(t->pt[i].local - ref->local);
+		my += t->pt[i].offset - ref->offset;
+	}
+	mx /= n;
+	my /= n;
+
+	for (i = 0; i < n; i++) {
+		dx = (long)(t->pt[i].local - ref->local) - mx;
+		dy = (t->pt[i].offset - ref->offset) - my;
+		sxx += dx * dx;
+		sxy += dx * dy;
+	}
+
+	t->skew = (sxx != 0) ? sxy / sxx : 0;
+	t->local_ref = ref->local + (long)mx;
+	t->offset = ref->offset + (long)my;
+}
+
+static struct tsync_pending *
+tsync_pending(struct tsync *t, unsigned short src)
+{
+	int i;
+
+	for (i = 0; i < TSYNC_PENDING; i++) {
+		if (t->pend[i].used && t->pend[i].src == src)
+			return &t->pend[i];
+	}
+
+	return (void *)0;
+}
+
+/*
+ * Handle a received frame (see ieee802154_parse) with its RX timestamp
+ * (mrf24j40_rx_stamp). Returns 1 if it was a beacon, 0 otherwise.
+ */
+int
+tsync_input(struct tsync *t, struct ieee802154_frame *fr, unsigned long stamp)
+{
+	unsigned char *p = fr->payload;
+	struct tsync_pending *e;
+	struct tsync_point *pt;
+	unsigned short src, rseq;
+	unsigned long g;
+
+	if (fr->payload_len != TSYNC_LEN || p[0] != TSYNC_DISPATCH)
+		return 0;
+
+	++t->stats.rx;
+	if (t->is_root || fr->src.mode != FCADDR_SHORT ||
+	    (p[1] | (p[2] << 8)) != t->root)
+		return 1;
+
+	src = fr->src.short_addr;
+	rseq = p[3] | (p[4] << 8);
+	e = tsync_pending(t, src);
+
+	/* The global time of the sender's previous beacon */
+	if (p[6] & TSYNC_F_VALID) {
+		g = p[7] | ((unsigned long)p[8] << 8) |
+		    ((unsigned long)p[9] << 16) | ((unsigned long)p[10] << 24);
+
+		if (e == (void *)0 || e->bseq != (unsigned char)(p[5] - 1)) {
+			++t->stats.unmatched;
+		} else if (t->npoints != 0 && (short)(rseq - t->rseq) <= 0) {
+			++t->stats.stale;
+		} else {
+			pt = &t->pt[t->pos];
+			pt->local = e->stamp;
+			pt->offset = (long)(g - e->stamp);
+			t->pos = (t->pos + 1) % TSYNC_POINTS;
+			if (t->npoints < TSYNC_POINTS)
+				++t->npoints;
+			t->rseq = rseq;
+			++t->stats.points;
+			tsync_fit(t);
+		}
+	}
+
+	/* Remember this beacon for the next one from src */
+	if (e == (void *)0) {
+		e = &t->pend[t->pend_pos];
+		t->pend_pos = (t->pend_pos + 1) % TSYNC_PENDING;
+	}
+	e->src = src;
+	e->bseq = p[5];
+	e->stamp = stamp;
+	e->used = 1;
+
+	return 1;
+}
+
+/* Global time at local time local; only meaningful once synchronized */
+unsigned long
+tsync_global(struct tsync *t, unsigned long local)
+{
+	if (t->is_root)
+		return local;
+
+	return local + t->offset +
+	    (long)(t->skew * (long)(local - t->local_ref));
+}
+
+/* Drift of the local clock against global time, in ppm (fast: > 0) */
+long
+tsync_drift_ppm(struct tsync *t)
+{
+	return (long)(-t->skew * 1e6);
+}
@@ -0,0 +1,122 @@
+/* 
+ * Copyright (C) 2011, Alex Hornung  
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions: 
+ *
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software. 
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef _TSYNC_H_
+#define _TSYNC_H_
+
+#include "MRF24J40.h"
+#include "ieee802154.h"
+
+/*
+ * Network time synchronization, after FTSP (flooding time sync).
+ *
+ * Global time is the local clock of the root node. The root, and every
+ * node synchronized to it, broadcasts a beacon every period ticks
+ * (tsync_tick):
+ *
+ *   TSYNC_DISPATCH | root:16 | rseq:16 | bseq | flags | global:32
+ *
+ * Timestamps come from the driver (mrf24j40_rx_stamp/tx_stamp, taken
+ * at RXIF and TXNIF; the HAL has to provide MRF24J40_TIMESTAMP). Since
+ * the TX timestamp is only known after the frame went out, a beacon
+ * carries the global time at which the sender's previous beacon
+ * (bseq - 1) ended; receivers keep the RX timestamps of the last few
+ * beacons to pair them up. Broadcasts are not acknowledged, so TXNIF and
+ * RXIF mark the same instant on both sides.
+ *
+ * rseq is the sequence number of the root beacon the information
+ * derives from; a node only takes a reference point from a beacon with
+ * a newer rseq than its last one, which floods each round of the root
+ * once through the network. The last TSYNC_POINTS reference points
+ * (local time, global - local) are fitted by linear regression, which
+ * gives the offset and the drift of the local clock.
+ *
+ * Times are in the units of MRF24J40_TIMESTAMP(), and the clocks must
+ * not differ by more than 2^31 units.
+ */
+#define TSYNC_DISPATCH		0x3D
+#define TSYNC_LEN		11
+
+#define TSYNC_POINTS		8
+#define TSYNC_MIN_POINTS	3	/* to count as synchronized */
+#define TSYNC_PENDING		4	/* beacons awaiting their time */
+
+#define TSYNC_F_VALID		0x01	/* global field is set */
+
+struct tsync_point {
+	unsigned long	local;
+	long		offset;		/* global - local */
+};
+
+struct tsync_pending {
+	unsigned long	stamp;
+	unsigned short	src;
+	unsigned char	bseq;
+	unsigned char	used;
+};
+
+struct tsync_stats {
+	unsigned short	tx;
+	unsigned short	rx;
+	unsigned short	points;
+	unsigned short	stale;		/* rseq not newer */
+	unsigned short	unmatched;	/* previous beacon not received */
+};
+
+struct tsync {
+	unsigned short	root;
+	unsigned char	is_root;
+	unsigned char	tx_busy;
+	unsigned short	rseq;
+	unsigned char	bseq;		/* of the next beacon */
+	unsigned char	prev_valid;
+	unsigned long	prev_global;	/* end of beacon bseq - 1 */
+
+	unsigned short	period;
+	unsigned short	now;		/* ticks */
+	unsigned short	next_tx;
+
+	/* global = local + offset + skew * (local - local_ref) */
+	unsigned long	local_ref;
+	long		offset;
+	float		skew;
+
+	unsigned char	npoints;
+	unsigned char	pos;
+	unsigned char	pend_pos;
+	struct tsync_point pt[TSYNC_POINTS];
+	struct tsync_pending pend[TSYNC_PENDING];
+	struct tsync_stats stats;
+};
+
+void tsync_init(struct tsync *t, unsigned short root, unsigned short period);
+void tsync_tick(struct tsync *t);
+int tsync_poll(struct tsync *t);
+void tsync_tx_done(struct tsync *t, int err);
+int tsync_input(struct tsync *t, struct ieee802154_frame *fr,
+    unsigned long stamp);
+int tsync_synced(struct tsync *t);
+unsigned long tsync_global(struct tsync *t, unsigned long local);
+long tsync_drift_ppm(struct tsync *t);
+
+#endif /* _TSYNC_H_ */